@@ -0,0 +1,143 @@
+// flow_reader.cpp — просмотр файлов таблиц потоков sniffer (--flow-store) без обращения к процессу захвата
+
+#include "flow_tracker/FlowTable.h"
+#include "flow_tracker/FlowSnapshot.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Файлы таблиц потоков по пути из командной строки
+ * @param path Каталог --flow-store (все файлы shard-N.flows) или файл таблицы
+ * @return Пути к файлам таблиц
+ */
+std::vector<std::string> collectTableFiles(const std::string& path)
+{
+    if(!std::filesystem::is_directory(path))
+    {
+        return {path};
+    }
+
+    // Файл роста читается вместе со своим основным файлом, отдельно не перечисляется
+    std::vector<std::string> files;
+    for(const auto& entry : std::filesystem::directory_iterator(path))
+    {
+        const std::string name = entry.path().filename().string();
+        if(name.starts_with("shard-") && name.ends_with(".flows"))
+        {
+            files.push_back(entry.path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> paths;
+    size_t count = 20;
+    bool all = false;
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if(arg == "--help" || arg == "-h")
+        {
+            std::cout << "Использование: " << argv[0] << " <dir|file.flows>... [--top N] [--all]\n";
+            std::cout << "\nЧитает таблицы потоков, которые sniffer ведёт с --flow-store, только на чтение:\n";
+            std::cout << "файлы отображаются в память, работающий захват не останавливается и не замедляется.\n";
+            std::cout << "\nОпции:\n";
+            std::cout << "  --top <N>   Количество самых быстрых потоков (по умолчанию 20)\n";
+            std::cout << "  --all       Все потоки\n";
+            std::cout << "\nПример:\n";
+            std::cout << "  " << argv[0] << " /var/lib/sniffer --top 50\n";
+            return 0;
+        }
+        if(arg == "--top" && i + 1 < argc)
+        {
+            try
+            {
+                count = std::stoul(argv[++i]);
+            }
+            catch(const std::exception&)
+            {
+                std::cerr << "[error] Некорректное количество потоков: " << argv[i] << "\n";
+                return 1;
+            }
+        }
+        else if(arg == "--all")
+        {
+            all = true;
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+    if(paths.empty())
+    {
+        std::cerr << "[error] Не указан каталог или файл таблицы потоков. Используйте --help для получения справки\n";
+        return 1;
+    }
+
+    // Потоки всех шардов собираются в столбцы снимка: выбор топа тот же, что и в отчёте sniffer
+    FlowColumns columns;
+    uint64_t latest_time = 0;
+    try
+    {
+        for(const std::string& path : paths)
+        {
+            for(const std::string& file : collectTableFiles(path))
+            {
+                const FlowTable table(file, FlowTable::FileAccess::ReadOnly);
+                std::cout << "[info] " << file << ": потоков " << table.size() << ", слотов " << table.capacity()
+                    << ", шардов в хранилище " << table.getShardCount()
+                    << (table.isMigrating() ? " (идёт рост таблицы)" : "") << "\n";
+                table.forEach([&columns, &latest_time](const FlowTuple& flow_tuple, const FlowStats& flow_stats)
+                {
+                    columns.append(flow_tuple, flow_stats);
+                    latest_time = std::max(latest_time, flow_stats.getLastPacketTime());
+                });
+            }
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "[error] " << e.what() << "\n";
+        return 1;
+    }
+
+    // Скорость считается на момент последнего пакета в файлах, а не по системным часам
+    const FlowSnapshot snapshot(std::move(columns), 1);
+    const std::vector<RankedFlow> top_flows = snapshot.getTopFlows(all ? snapshot.size() : count, latest_time);
+
+    std::cout << "\n=== ТОП-" << top_flows.size() << " TCP потоков по скорости передачи данных (из "
+        << snapshot.size() << ") ===\n";
+    std::cout << std::string(88, '=') << "\n";
+    std::cout << std::left
+        << std::setw(16) << "Source"
+        << std::setw(8) << "Port"
+        << std::setw(16) << "Destination"
+        << std::setw(8) << "Port"
+        << std::setw(12) << "Speed"
+        << std::setw(10) << "AvgSize"
+        << std::setw(10) << "Bytes"
+        << std::setw(8) << "Packets" << "\n";
+    std::cout << std::string(88, '-') << "\n";
+    for(const RankedFlow& flow : top_flows)
+    {
+        std::cout << std::left
+            << std::setw(16) << PacketParser::ipToString(flow.flow_tuple.src_ip)
+            << std::setw(8) << flow.flow_tuple.src_port
+            << std::setw(16) << PacketParser::ipToString(flow.flow_tuple.dst_ip)
+            << std::setw(8) << flow.flow_tuple.dst_port
+            << std::setw(12) << FlowStats::formatSpeed(flow.speed)
+            << std::setw(10) << std::fixed << std::setprecision(1) << flow.flow_stats.getAveragePacketSize()
+            << std::setw(10) << flow.flow_stats.getTotalBytes()
+            << std::setw(8) << flow.flow_stats.getPacketCount() << "\n";
+    }
+    std::cout << std::string(88, '=') << "\n";
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "CountMinSketch.h"
+#include "FlowTable.h"
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+CountMinSketch::CountMinSketch(size_t width)
+    : m_counters(DEPTH * std::bit_ceil(std::max<size_t>(width, 1)), 0)
+      , m_mask(std::bit_ceil(std::max<size_t>(width, 1)) - 1)
+{
+}
+
+void CountMinSketch::indexes(const FlowTuple& flow_tuple, size_t (&index)[DEPTH]) const
+{
+    // Строки различаются шагом h2: h1 + i * h2 (Kirsch-Mitzenmacher), h2 нечётный
+    const uint64_t hash = FlowTable::hash(flow_tuple);
+    const uint64_t h1 = hash >> 32;
+    const uint64_t h2 = (hash & 0xFFFFFFFFULL) | 1;
+    for(size_t row = 0; row < DEPTH; ++row)
+    {
+        index[row] = row * (m_mask + 1) + ((h1 + row * h2) & m_mask);
+    }
+}
+
+uint64_t CountMinSketch::add(const FlowTuple& flow_tuple, uint64_t weight)
+{
+    size_t index[DEPTH];
+    indexes(flow_tuple, index);
+
+    uint64_t current = std::numeric_limits<uint64_t>::max();
+    for(size_t row = 0; row < DEPTH; ++row)
+    {
+        current = std::min(current, m_counters[index[row]]);
+    }
+
+    // Консервативное обновление: счётчики выше новой оценки уже учитывают этот объём
+    const uint64_t updated = current + weight;
+    for(size_t row = 0; row < DEPTH; ++row)
+    {
+        m_counters[index[row]] = std::max(m_counters[index[row]], updated);
+    }
+    return updated;
+}
+
+uint64_t CountMinSketch::estimate(const FlowTuple& flow_tuple) const
+{
+    size_t index[DEPTH];
+    indexes(flow_tuple, index);
+
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+    for(size_t row = 0; row < DEPTH; ++row)
+    {
+        result = std::min(result, m_counters[index[row]]);
+    }
+    return result;
+}
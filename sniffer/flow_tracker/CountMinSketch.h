@@ -0,0 +1,66 @@
+#ifndef COUNT_MIN_SKETCH_H
+#define COUNT_MIN_SKETCH_H
+
+#include "../packet_processor/PacketParser.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Count-Min sketch объёма потоков с консервативным обновлением
+ *
+ * DEPTH строк по width счётчиков; поток увеличивает по одному счётчику в каждой строке,
+ * оценка - минимум из них. Оценка никогда не меньше истинного значения, а превышает его
+ * не более чем на e/width от суммарного объёма с вероятностью 1 - e^-DEPTH.
+ * Консервативное обновление поднимает только счётчики ниже новой оценки, что
+ * уменьшает переоценку, сохраняя гарантию снизу. Память постоянна.
+ */
+class CountMinSketch
+{
+public:
+    static constexpr size_t DEPTH = 4;
+
+    /**
+     * @brief Конструктор
+     * @param width Количество счётчиков в строке (округляется вверх до степени двойки)
+     */
+    explicit CountMinSketch(size_t width);
+
+    /**
+     * @brief Добавление объёма потока
+     * @param flow_tuple 4-tuple потока
+     * @param weight Добавляемый объём
+     * @return Оценка объёма потока с учётом добавленного (не меньше истинного)
+     */
+    uint64_t add(const FlowTuple& flow_tuple, uint64_t weight);
+
+    /**
+     * @brief Оценка объёма потока
+     * @param flow_tuple 4-tuple потока
+     * @return Оценка (не меньше истинного объёма)
+     */
+    [[nodiscard]] uint64_t estimate(const FlowTuple& flow_tuple) const;
+
+    /**
+     * @brief Количество счётчиков в строке
+     * @return Ширина sketch
+     */
+    [[nodiscard]] size_t width() const { return m_mask + 1; }
+
+    /**
+     * @brief Объём памяти счётчиков
+     * @return Размер в байтах
+     */
+    [[nodiscard]] size_t getMemoryUsage() const { return m_counters.size() * sizeof(uint64_t); }
+
+private:
+    /**
+     * @brief Индексы счётчиков потока во всех строках (двойное хеширование одного 64-битного хеша)
+     */
+    void indexes(const FlowTuple& flow_tuple, size_t (&index)[DEPTH]) const;
+
+    std::vector<uint64_t> m_counters; // DEPTH строк подряд
+    size_t m_mask; // width - 1
+};
+
+#endif // COUNT_MIN_SKETCH_H
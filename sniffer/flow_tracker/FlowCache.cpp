@@ -0,0 +1,100 @@
+#include "FlowCache.h"
+#include <algorithm>
+#include <bit>
+
+FlowCache::FlowCache(size_t entries)
+    : m_entries(std::bit_ceil(std::max<size_t>(entries, 1)))
+      , m_mask(m_entries.size() - 1)
+      , m_tick(0)
+      , m_hits(0)
+      , m_lookups(0)
+{
+}
+
+void FlowCache::apply(std::span<const PacketInfo> packets, FlowTracker& flow_tracker)
+{
+    m_misses.clear();
+    m_write_backs.clear();
+
+    uint64_t latest_timestamp = 0;
+    uint64_t hashes[PREFETCH_WINDOW];
+    for(size_t begin = 0; begin < packets.size(); begin += PREFETCH_WINDOW)
+    {
+        // Ячейки окна запрашиваются заранее: промах предсказания ветвления не ждёт загрузки ячейки
+        const std::span<const PacketInfo> window = packets.subspan(begin, std::min(PREFETCH_WINDOW,
+                                                                                   packets.size() - begin));
+        for(size_t i = 0; i < window.size(); ++i)
+        {
+            hashes[i] = FlowTable::hash(window[i].flow_tuple);
+            __builtin_prefetch(&m_entries[hashes[i] & m_mask], 1);
+        }
+        for(size_t i = 0; i < window.size(); ++i)
+        {
+            const PacketInfo& packet = window[i];
+            latest_timestamp = std::max(latest_timestamp, packet.timestamp);
+            Entry& entry = m_entries[hashes[i] & m_mask];
+            const bool same_flow = entry.occupied && entry.flow_tuple == packet.flow_tuple;
+            const bool control = (packet.tcp_flags & (TCP_FLAG_SYN | TCP_FLAG_FIN | TCP_FLAG_RST)) != 0;
+            if(same_flow && !control)
+            {
+                entry.pending.updateStats(packet.packet_size, packet.payload_size, packet.timestamp,
+                                          packet.tcp_flags);
+                ++m_hits;
+                continue;
+            }
+
+            if(same_flow)
+            {
+                // Статистика, накопленная до SYN, FIN или RST, попадает в трекер раньше него
+                writeBack(entry, m_misses.size());
+                entry.occupied = false;
+            }
+            else if(!control && entry.pending.getPacketCount() == 0)
+            {
+                // Ячейку занимает новый поток, только если прежний не получал пакетов с последнего сброса:
+                // горячий поток не вытесняется случайным и запись в трекер вне сброса не нужна
+                entry.flow_tuple = packet.flow_tuple;
+                entry.occupied = true;
+            }
+            m_misses.push_back(packet);
+        }
+    }
+    m_lookups += packets.size();
+
+    if(!m_misses.empty() || !m_write_backs.empty())
+    {
+        // Пачка только из горячих потоков не берёт блокировку трекера
+        flow_tracker.updateFlows(m_misses, m_write_backs);
+    }
+
+    // Перед переходом колеса таймеров в новый такт трекер получает всю отложенную статистику
+    const uint64_t tick = latest_timestamp / TimerWheel::TICK_US;
+    if(tick != m_tick)
+    {
+        m_tick = tick;
+        flush(flow_tracker);
+    }
+}
+
+void FlowCache::flush(FlowTracker& flow_tracker)
+{
+    m_write_backs.clear();
+    for(Entry& entry : m_entries)
+    {
+        writeBack(entry, 0);
+    }
+    if(!m_write_backs.empty())
+    {
+        flow_tracker.updateFlows({}, m_write_backs);
+    }
+}
+
+void FlowCache::writeBack(Entry& entry, size_t position)
+{
+    if(entry.pending.getPacketCount() == 0)
+    {
+        return;
+    }
+    m_write_backs.push_back(FlowDelta{entry.flow_tuple, FlowTable::hash(entry.flow_tuple), entry.pending, position});
+    entry.pending.reset();
+}
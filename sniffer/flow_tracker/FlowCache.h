@@ -0,0 +1,99 @@
+#ifndef FLOW_CACHE_H
+#define FLOW_CACHE_H
+
+#include "FlowTracker.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/**
+ * @brief Кэш горячих потоков одного потока захвата перед таблицей шарда
+ *
+ * Кэш прямого отображения: поток занимает ячейку hash & mask. Пакет потока, уже
+ * занимающего свою ячейку, копится в отложенной статистике ячейки без поиска в таблице
+ * и без блокировки трекера (отложенная запись). Промах отправляет пакет в трекер; ячейку
+ * он занимает, только если её поток не получал пакетов с последнего сброса, поэтому
+ * горячий поток не вытесняется случайным.
+ *
+ * Пакеты с SYN, FIN или RST всегда идут в трекер (они меняют состояние соединения),
+ * а отложенная статистика их потока записывается перед ними. Весь кэш сбрасывается,
+ * когда время пакетов переходит в следующий такт TimerWheel, поэтому истечение
+ * таймеров видит актуальное время последнего пакета, а отчёт отстаёт не больше чем
+ * на такт. В приближённом режиме трекера кэш не используется.
+ */
+class FlowCache
+{
+public:
+    static constexpr size_t DEFAULT_ENTRIES = 1024; // Ячеек по умолчанию (64 КБ, помещается в L2)
+    static constexpr size_t PREFETCH_WINDOW = 16; // Пакетов, ячейки которых запрашиваются заранее
+
+    /**
+     * @brief Конструктор
+     * @param entries Количество ячеек (округляется вверх до степени двойки)
+     */
+    explicit FlowCache(size_t entries = DEFAULT_ENTRIES);
+
+    /**
+     * @brief Учёт пачки пакетов
+     *
+     * Попадания копятся в кэше, промахи и записываемая статистика передаются трекеру
+     * одним вызовом updateFlows(); пачка из одних попаданий трекер не трогает.
+     *
+     * @param packets Разобранные пакеты
+     * @param flow_tracker Трекер шарда этого потока захвата
+     */
+    void apply(std::span<const PacketInfo> packets, FlowTracker& flow_tracker);
+
+    /**
+     * @brief Запись всей отложенной статистики в трекер
+     * @param flow_tracker Трекер шарда этого потока захвата
+     */
+    void flush(FlowTracker& flow_tracker);
+
+    /**
+     * @brief Количество пакетов, учтённых без обращения к таблице
+     * @return Попадания в кэш
+     */
+    [[nodiscard]] uint64_t getHits() const { return m_hits; }
+
+    /**
+     * @brief Количество пакетов, прошедших через кэш
+     * @return Обращения к кэшу
+     */
+    [[nodiscard]] uint64_t getLookups() const { return m_lookups; }
+
+    /**
+     * @brief Количество ячеек
+     * @return Размер кэша
+     */
+    [[nodiscard]] size_t size() const { return m_entries.size(); }
+
+private:
+    /**
+     * @brief Ячейка кэша (ровно одна строка кэша процессора)
+     */
+    struct alignas(64) Entry
+    {
+        FlowTuple flow_tuple;
+        bool occupied = false;
+        FlowStats pending; // Статистика пакетов, ещё не записанная в трекер
+    };
+
+    /**
+     * @brief Перенос отложенной статистики ячейки в список записи
+     * @param entry Ячейка
+     * @param position Количество промахов пачки, предшествующих записи
+     */
+    void writeBack(Entry& entry, size_t position);
+
+    std::vector<Entry> m_entries;
+    size_t m_mask;
+    std::vector<PacketInfo> m_misses; // Пакеты пачки для трекера (ёмкость переиспользуется)
+    std::vector<FlowDelta> m_write_backs; // Статистика, записываемая в трекер
+    uint64_t m_tick; // Такт TimerWheel последнего сброса
+    uint64_t m_hits;
+    uint64_t m_lookups;
+};
+
+#endif // FLOW_CACHE_H
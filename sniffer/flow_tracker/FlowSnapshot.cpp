@@ -0,0 +1,254 @@
+#include "FlowSnapshot.h"
+#include <algorithm>
+#include <cassert>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FLOW_SNAPSHOT_X86 1
+#endif
+
+namespace
+{
+    /**
+     * @brief Скорости потоков [0, count): bytes / ((now - first) / 1e6), 0 без пакетов или длительности
+     */
+    void speedsScalar(const uint64_t* bytes, const uint64_t* packet_counts, const uint64_t* first_packet_times,
+                      size_t count, uint64_t current_time, double* speeds)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            const uint64_t duration_us = current_time - first_packet_times[i];
+            const bool valid = packet_counts[i] != 0 && first_packet_times[i] != 0 && duration_us != 0;
+            speeds[i] = valid
+                            ? static_cast<double>(bytes[i]) / (static_cast<double>(duration_us) / 1000000.0)
+                            : 0.0;
+        }
+    }
+
+    /**
+     * @brief Средние размеры пакетов потоков [0, count), 0 без пакетов
+     */
+    void sizesScalar(const uint64_t* total_packet_sizes, const uint64_t* packet_counts, size_t count, double* sizes)
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            sizes[i] = packet_counts[i] != 0
+                           ? static_cast<double>(total_packet_sizes[i]) / static_cast<double>(packet_counts[i])
+                           : 0.0;
+        }
+    }
+
+#ifdef FLOW_SNAPSHOT_X86
+    /**
+     * @brief Точное преобразование 4 беззнаковых 64-битных чисел в double
+     *
+     * Старшая и младшая половины подставляются в мантиссы 2^84 и 2^52; вычитание
+     * смещений точное, единственное округление - при сложении, как у static_cast.
+     */
+    __attribute__((target("avx2")))
+    __m256d toDouble(__m256i value)
+    {
+        const __m256i high = _mm256_or_si256(_mm256_srli_epi64(value, 32),
+                                             _mm256_castpd_si256(_mm256_set1_pd(0x1.0p84)));
+        const __m256i low = _mm256_blend_epi32(value, _mm256_castpd_si256(_mm256_set1_pd(0x1.0p52)), 0xAA);
+        const __m256d high_value = _mm256_sub_pd(_mm256_castsi256_pd(high), _mm256_set1_pd(0x1.0p84 + 0x1.0p52));
+        return _mm256_add_pd(high_value, _mm256_castsi256_pd(low));
+    }
+
+    __attribute__((target("avx2")))
+    void speedsAvx2(const uint64_t* bytes, const uint64_t* packet_counts, const uint64_t* first_packet_times,
+                    size_t count, uint64_t current_time, double* speeds)
+    {
+        const __m256i now = _mm256_set1_epi64x(static_cast<long long>(current_time));
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256d microseconds = _mm256_set1_pd(1000000.0);
+        size_t i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first_packet_times + i));
+            const __m256i packets = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(packet_counts + i));
+            const __m256i volume = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + i));
+            const __m256i duration = _mm256_sub_epi64(now, first);
+
+            // Поток без пакетов, без времени начала или с нулевой длительностью получает 0
+            const __m256i invalid = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi64(packets, zero),
+                                                                    _mm256_cmpeq_epi64(first, zero)),
+                                                    _mm256_cmpeq_epi64(duration, zero));
+            const __m256d seconds = _mm256_div_pd(toDouble(duration), microseconds);
+            const __m256d speed = _mm256_div_pd(toDouble(volume), seconds);
+            _mm256_storeu_pd(speeds + i, _mm256_andnot_pd(_mm256_castsi256_pd(invalid), speed));
+        }
+        speedsScalar(bytes + i, packet_counts + i, first_packet_times + i, count - i, current_time, speeds + i);
+    }
+
+    __attribute__((target("avx2")))
+    void sizesAvx2(const uint64_t* total_packet_sizes, const uint64_t* packet_counts, size_t count, double* sizes)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        size_t i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            const __m256i packets = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(packet_counts + i));
+            const __m256i total = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(total_packet_sizes + i));
+            const __m256d size = _mm256_div_pd(toDouble(total), toDouble(packets));
+            const __m256i invalid = _mm256_cmpeq_epi64(packets, zero);
+            _mm256_storeu_pd(sizes + i, _mm256_andnot_pd(_mm256_castsi256_pd(invalid), size));
+        }
+        sizesScalar(total_packet_sizes + i, packet_counts + i, count - i, sizes + i);
+    }
+#endif
+
+    ScoringImpl detectImpl()
+    {
+#ifdef FLOW_SNAPSHOT_X86
+        if(__builtin_cpu_supports("avx2"))
+        {
+            return ScoringImpl::Avx2;
+        }
+#endif
+        return ScoringImpl::Scalar;
+    }
+
+    void speeds(const FlowColumns& columns, size_t begin, size_t count, uint64_t current_time, double* result)
+    {
+#ifdef FLOW_SNAPSHOT_X86
+        if(FlowSnapshot::getScoringImpl() == ScoringImpl::Avx2)
+        {
+            speedsAvx2(columns.bytes.data() + begin, columns.packet_counts.data() + begin,
+                       columns.first_packet_times.data() + begin, count, current_time, result);
+            return;
+        }
+#endif
+        speedsScalar(columns.bytes.data() + begin, columns.packet_counts.data() + begin,
+                     columns.first_packet_times.data() + begin, count, current_time, result);
+    }
+}
+
+void FlowColumns::append(const FlowTuple& flow_tuple, const FlowStats& flow_stats)
+{
+    flow_tuples.push_back(flow_tuple);
+    bytes.push_back(flow_stats.getTotalBytes());
+    packet_counts.push_back(flow_stats.getPacketCount());
+    total_packet_sizes.push_back(flow_stats.getTotalPacketSize());
+    first_packet_times.push_back(flow_stats.getFirstPacketTime());
+    last_packet_times.push_back(flow_stats.getLastPacketTime());
+    tcp_flags.push_back(flow_stats.getTcpFlags());
+}
+
+void FlowColumns::clear()
+{
+    flow_tuples.clear();
+    bytes.clear();
+    packet_counts.clear();
+    total_packet_sizes.clear();
+    first_packet_times.clear();
+    last_packet_times.clear();
+    tcp_flags.clear();
+}
+
+void FlowColumns::reserve(size_t flows)
+{
+    flow_tuples.reserve(flows);
+    bytes.reserve(flows);
+    packet_counts.reserve(flows);
+    total_packet_sizes.reserve(flows);
+    first_packet_times.reserve(flows);
+    last_packet_times.reserve(flows);
+    tcp_flags.reserve(flows);
+}
+
+FlowSnapshot::FlowSnapshot(FlowColumns columns, uint64_t epoch)
+    : m_columns(std::move(columns))
+      , m_epoch(epoch)
+{
+}
+
+FlowStats FlowSnapshot::getFlowStats(size_t index) const
+{
+    return FlowStats(m_columns.bytes[index], m_columns.packet_counts[index], m_columns.total_packet_sizes[index],
+                     m_columns.first_packet_times[index], m_columns.last_packet_times[index],
+                     m_columns.tcp_flags[index]);
+}
+
+void FlowSnapshot::scoreSpeeds(uint64_t current_time, std::span<double> speeds_out) const
+{
+    assert(speeds_out.size() >= size());
+    speeds(m_columns, 0, size(), current_time, speeds_out.data());
+}
+
+void FlowSnapshot::scoreAveragePacketSizes(std::span<double> sizes) const
+{
+    assert(sizes.size() >= size());
+#ifdef FLOW_SNAPSHOT_X86
+    if(getScoringImpl() == ScoringImpl::Avx2)
+    {
+        sizesAvx2(m_columns.total_packet_sizes.data(), m_columns.packet_counts.data(), size(), sizes.data());
+        return;
+    }
+#endif
+    sizesScalar(m_columns.total_packet_sizes.data(), m_columns.packet_counts.data(), size(), sizes.data());
+}
+
+std::vector<RankedFlow> FlowSnapshot::getTopFlows(size_t count, uint64_t current_time) const
+{
+    struct Candidate
+    {
+        double speed;
+        size_t index;
+    };
+
+    std::vector<RankedFlow> top;
+    if(count == 0)
+    {
+        return top;
+    }
+
+    // Куча с самым медленным из отобранных потоков в вершине
+    auto faster = [](const Candidate& a, const Candidate& b)
+    {
+        return a.speed > b.speed;
+    };
+
+    std::vector<Candidate> candidates;
+    candidates.reserve(std::min(count, size()));
+    double block[SCORE_BLOCK];
+    for(size_t begin = 0; begin < size(); begin += SCORE_BLOCK)
+    {
+        const size_t block_size = std::min(SCORE_BLOCK, size() - begin);
+        speeds(m_columns, begin, block_size, current_time, block);
+        for(size_t i = 0; i < block_size; ++i)
+        {
+            if(candidates.size() < count)
+            {
+                candidates.push_back(Candidate{block[i], begin + i});
+                std::ranges::push_heap(candidates, faster);
+            }
+            else if(block[i] > candidates.front().speed)
+            {
+                std::ranges::pop_heap(candidates, faster);
+                candidates.back() = Candidate{block[i], begin + i};
+                std::ranges::push_heap(candidates, faster);
+            }
+        }
+    }
+
+    // Статистика собирается из столбцов только для отобранных потоков
+    std::ranges::sort_heap(candidates, faster);
+    top.reserve(candidates.size());
+    for(const Candidate& candidate : candidates)
+    {
+        top.push_back(RankedFlow{getFlowTuple(candidate.index), getFlowStats(candidate.index), candidate.speed});
+    }
+    return top;
+}
+
+ScoringImpl FlowSnapshot::getScoringImpl()
+{
+    static const ScoringImpl impl = detectImpl();
+    return impl;
+}
+
+std::string FlowSnapshot::scoringImplToString(ScoringImpl impl)
+{
+    return impl == ScoringImpl::Avx2 ? "avx2" : "scalar";
+}
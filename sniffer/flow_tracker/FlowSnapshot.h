@@ -0,0 +1,167 @@
+#ifndef FLOW_SNAPSHOT_H
+#define FLOW_SNAPSHOT_H
+
+#include "../packet_processor/PacketParser.h"
+#include "FlowStats.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Поток с рассчитанной скоростью для выбора топ-N
+ */
+struct RankedFlow
+{
+    FlowTuple flow_tuple;
+    FlowStats flow_stats;
+    double speed; // Средняя скорость в байтах в секунду на момент выбора
+};
+
+/**
+ * @brief Статистика потоков по столбцам (struct-of-arrays)
+ *
+ * Поток i - i-й элемент каждого столбца. Оценка всех потоков читает только
+ * нужные столбцы подряд, что позволяет считать её векторными циклами.
+ */
+struct FlowColumns
+{
+    std::vector<FlowTuple> flow_tuples;
+    std::vector<uint64_t> bytes; // Объём полезной нагрузки
+    std::vector<uint64_t> packet_counts;
+    std::vector<uint64_t> total_packet_sizes; // Суммарный размер пакетов на уровне Ethernet
+    std::vector<uint64_t> first_packet_times;
+    std::vector<uint64_t> last_packet_times;
+    std::vector<uint8_t> tcp_flags;
+
+    /**
+     * @brief Добавление потока в конец столбцов
+     */
+    void append(const FlowTuple& flow_tuple, const FlowStats& flow_stats);
+
+    /**
+     * @brief Удаление всех потоков без освобождения памяти
+     */
+    void clear();
+
+    /**
+     * @brief Резервирование памяти во всех столбцах
+     * @param flows Количество потоков
+     */
+    void reserve(size_t flows);
+
+    /**
+     * @brief Количество потоков
+     */
+    [[nodiscard]] size_t size() const { return flow_tuples.size(); }
+};
+
+/**
+ * @brief Реализация оценки потоков снимка
+ */
+enum class ScoringImpl
+{
+    Scalar, ///< Поэлементный расчёт
+    Avx2 ///< 4 потока за шаг в 256-битных регистрах
+};
+
+/**
+ * @brief Неизменяемый снимок потоков шарда
+ *
+ * Публикуется трекером через std::shared_ptr (FlowTracker::publishSnapshot()) и читается
+ * без блокировок: пока читатель держит указатель, снимок не меняется и не освобождается.
+ * Статистика каждого потока скопирована целиком под блокировкой трекера; снимок
+ * собирается порциями, поэтому набор потоков соответствует интервалу сборки, а не
+ * одному моменту.
+ *
+ * Статистика хранится по столбцам (FlowColumns). Скорость и средний размер пакета
+ * всех потоков считаются векторными циклами (AVX2, выбирается при запуске) с тем же
+ * результатом, что и FlowStats::getAverageSpeed() / getAveragePacketSize().
+ */
+class FlowSnapshot
+{
+public:
+    static constexpr size_t SCORE_BLOCK = 1024; // Потоков, оцениваемых за шаг выбора топ-N
+
+    /**
+     * @brief Конструктор
+     * @param columns Потоки (порядок не определён)
+     * @param epoch Номер публикации (растёт с каждым снимком трекера)
+     */
+    FlowSnapshot(FlowColumns columns, uint64_t epoch);
+
+    /**
+     * @brief Столбцы статистики потоков
+     * @return Потоки в порядке обхода таблицы
+     */
+    [[nodiscard]] const FlowColumns& getColumns() const { return m_columns; }
+
+    /**
+     * @brief Номер публикации
+     * @return 0 для пустого снимка до первой публикации
+     */
+    [[nodiscard]] uint64_t getEpoch() const { return m_epoch; }
+
+    /**
+     * @brief Количество потоков
+     * @return Размер снимка
+     */
+    [[nodiscard]] size_t size() const { return m_columns.size(); }
+
+    /**
+     * @brief 4-tuple потока
+     * @param index Номер потока в снимке
+     */
+    [[nodiscard]] const FlowTuple& getFlowTuple(size_t index) const { return m_columns.flow_tuples[index]; }
+
+    /**
+     * @brief Статистика потока, собранная из столбцов
+     * @param index Номер потока в снимке
+     */
+    [[nodiscard]] FlowStats getFlowStats(size_t index) const;
+
+    /**
+     * @brief Средняя скорость всех потоков
+     * @param current_time Момент расчёта скорости в микросекундах
+     * @param speeds Результат, по элементу на поток (size() элементов)
+     */
+    void scoreSpeeds(uint64_t current_time, std::span<double> speeds) const;
+
+    /**
+     * @brief Средний размер пакета всех потоков
+     * @param sizes Результат, по элементу на поток (size() элементов)
+     */
+    void scoreAveragePacketSizes(std::span<double> sizes) const;
+
+    /**
+     * @brief Самые быстрые потоки снимка
+     *
+     * Скорости считаются блоками по SCORE_BLOCK потоков на стеке, кандидаты
+     * отбираются ограниченной min-кучей из count потоков: O(N log count) без
+     * выделения памяти под оценки.
+     *
+     * @param count Количество потоков
+     * @param current_time Момент расчёта скорости в микросекундах
+     * @return Потоки по убыванию средней скорости
+     */
+    [[nodiscard]] std::vector<RankedFlow> getTopFlows(size_t count, uint64_t current_time) const;
+
+    /**
+     * @brief Реализация оценки, выбранная при запуске
+     */
+    static ScoringImpl getScoringImpl();
+
+    /**
+     * @brief Название реализации оценки
+     */
+    static std::string scoringImplToString(ScoringImpl impl);
+
+private:
+    friend class FlowTracker; // Забирает столбцы вытесненного снимка для следующей сборки
+
+    FlowColumns m_columns;
+    uint64_t m_epoch;
+};
+
+#endif // FLOW_SNAPSHOT_H
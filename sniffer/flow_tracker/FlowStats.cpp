@@ -1,4 +1,7 @@
 #include "FlowStats.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 
 FlowStats::FlowStats()
     : total_bytes(0)
@@ -6,14 +9,27 @@ FlowStats::FlowStats()
       , m_total_packet_size(0)
       , m_first_packet_time(0)
       , m_last_packet_time(0)
+      , m_tcp_flags(0)
 {
 }
 
-void FlowStats::updateStats(uint32_t packet_size, uint32_t payload_size, uint64_t timestamp)
+FlowStats::FlowStats(uint64_t total_bytes, uint64_t packet_count, uint64_t total_packet_size,
+                     uint64_t first_packet_time, uint64_t last_packet_time, uint8_t tcp_flags)
+    : total_bytes(total_bytes)
+      , m_packet_count(packet_count)
+      , m_total_packet_size(total_packet_size)
+      , m_first_packet_time(first_packet_time)
+      , m_last_packet_time(last_packet_time)
+      , m_tcp_flags(tcp_flags)
+{
+}
+
+void FlowStats::updateStats(uint32_t packet_size, uint32_t payload_size, uint64_t timestamp, uint8_t tcp_flags)
 {
     total_bytes += payload_size;
     m_total_packet_size += packet_size;
     m_packet_count++;
+    m_tcp_flags |= tcp_flags;
 
     if(m_first_packet_time == 0)
     {
@@ -22,6 +38,20 @@ void FlowStats::updateStats(uint32_t packet_size, uint32_t payload_size, uint64_
     m_last_packet_time = timestamp;
 }
 
+void FlowStats::merge(const FlowStats& other)
+{
+    total_bytes += other.total_bytes;
+    m_total_packet_size += other.m_total_packet_size;
+    m_packet_count += other.m_packet_count;
+    m_tcp_flags |= other.m_tcp_flags;
+
+    if(m_first_packet_time == 0)
+    {
+        m_first_packet_time = other.m_first_packet_time;
+    }
+    m_last_packet_time = std::max(m_last_packet_time, other.m_last_packet_time);
+}
+
 double FlowStats::getAveragePacketSize() const
 {
     if(m_packet_count == 0)
@@ -49,6 +79,30 @@ double FlowStats::getAverageSpeed(uint64_t current_time) const
     return static_cast<double>(total_bytes) / duration_seconds;
 }
 
+std::string FlowStats::formatSpeed(double speed)
+{
+    std::ostringstream oss;
+
+    if(speed >= 1024 * 1024 * 1024) // >= 1 GB/s
+    {
+        oss << std::fixed << std::setprecision(1) << (speed / (1024 * 1024 * 1024)) << " GB/s";
+    }
+    else if(speed >= 1024 * 1024) // >= 1 MB/s
+    {
+        oss << std::fixed << std::setprecision(1) << (speed / (1024 * 1024)) << " MB/s";
+    }
+    else if(speed >= 1024) // >= 1 KB/s
+    {
+        oss << std::fixed << std::setprecision(1) << (speed / 1024) << " KB/s";
+    }
+    else
+    {
+        oss << std::fixed << std::setprecision(0) << speed << " B/s";
+    }
+
+    return oss.str();
+}
+
 void FlowStats::reset()
 {
     total_bytes = 0;
@@ -56,4 +110,5 @@ void FlowStats::reset()
     m_total_packet_size = 0;
     m_first_packet_time = 0;
     m_last_packet_time = 0;
+    m_tcp_flags = 0;
 }
@@ -2,6 +2,7 @@
 #define FLOW_STATS_H
 
 #include "../packet_processor/PacketParser.h"
+#include <string>
 
 /**
  * @brief Класс для хранения статистики потока
@@ -14,13 +15,32 @@ public:
      */
     FlowStats();
 
+    /**
+     * @brief Конструктор из сохранённых счётчиков (восстановление из снимка)
+     * @param total_bytes Объём полезной нагрузки
+     * @param packet_count Количество пакетов
+     * @param total_packet_size Суммарный размер пакетов на уровне Ethernet
+     * @param first_packet_time Время первого пакета
+     * @param last_packet_time Время последнего пакета
+     * @param tcp_flags Объединение флагов TCP
+     */
+    FlowStats(uint64_t total_bytes, uint64_t packet_count, uint64_t total_packet_size,
+              uint64_t first_packet_time, uint64_t last_packet_time, uint8_t tcp_flags);
+
     /**
      * @brief Обновление статистики новым пакетом
      * @param packet_size Размер пакета на уровне Ethernet
      * @param payload_size Размер полезной нагрузки TCP
      * @param timestamp Временная метка пакета
+     * @param tcp_flags Флаги TCP пакета (TCP_FLAG_*)
+     */
+    void updateStats(uint32_t packet_size, uint32_t payload_size, uint64_t timestamp, uint8_t tcp_flags = 0);
+
+    /**
+     * @brief Добавление статистики более поздних пакетов того же потока
+     * @param other Статистика пакетов, пришедших после уже учтённых
      */
-    void updateStats(uint32_t packet_size, uint32_t payload_size, uint64_t timestamp);
+    void merge(const FlowStats& other);
 
     /**
      * @brief Получение среднего размера пакета
@@ -40,6 +60,12 @@ public:
      */
     [[nodiscard]] uint64_t getPacketCount() const { return m_packet_count; }
 
+    /**
+     * @brief Получение суммарного размера пакетов
+     * @return Сумма размеров пакетов на уровне Ethernet
+     */
+    [[nodiscard]] uint64_t getTotalPacketSize() const { return m_total_packet_size; }
+
     /**
      * @brief Получение средней скорости передачи данных
      * @param current_time Текущее время в микросекундах
@@ -47,12 +73,37 @@ public:
      */
     [[nodiscard]] double getAverageSpeed(uint64_t current_time) const;
 
+    /**
+     * @brief Форматирование скорости для вывода
+     * @param speed Скорость в байтах в секунду
+     * @return Отформатированная строка ("1.5 MB/s")
+     */
+    static std::string formatSpeed(double speed);
+
+    /**
+     * @brief Получение времени первого пакета
+     * @return Временная метка первого пакета
+     */
+    [[nodiscard]] uint64_t getFirstPacketTime() const { return m_first_packet_time; }
+
     /**
      * @brief Получение времени последнего пакета
      * @return Временная метка последнего пакета
      */
     [[nodiscard]] uint64_t getLastPacketTime() const { return m_last_packet_time; }
 
+    /**
+     * @brief Получение флагов TCP, встречавшихся в потоке
+     * @return Объединение (OR) флагов всех пакетов
+     */
+    [[nodiscard]] uint8_t getTcpFlags() const { return m_tcp_flags; }
+
+    /**
+     * @brief Проверка завершения соединения
+     * @return true если в потоке был FIN или RST
+     */
+    [[nodiscard]] bool isClosed() const { return (m_tcp_flags & (TCP_FLAG_FIN | TCP_FLAG_RST)) != 0; }
+
     /**
      * @brief Сброс статистики
      */
@@ -64,6 +115,7 @@ private:
     uint64_t m_total_packet_size; // Общий размер пакетов на уровне Ethernet
     uint64_t m_first_packet_time; // Время первого пакета
     uint64_t m_last_packet_time; // Время последнего пакета
+    uint8_t m_tcp_flags; // Объединение флагов TCP всех пакетов
 };
 
 #endif // FLOW_STATS_H
@@ -0,0 +1,688 @@
+#include "FlowTable.h"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static_assert(sizeof(FlowTuple) == 12, "FlowTuple должен занимать 12 байт без выравнивания");
+static_assert(std::is_trivially_copyable_v<FlowStats>, "Слоты таблицы хранятся в файле побайтно");
+
+namespace
+{
+    constexpr char FILE_MAGIC[8] = {'S', 'N', 'F', 'L', 'O', 'W', 'S', '\0'};
+    constexpr uint32_t FILE_HASH_VERSION = 1; // CRC32C 4-tuple, умноженная на 0x9E3779B97F4A7C15
+
+    /**
+     * @brief Заголовок файла таблицы потоков
+     *
+     * Раскладка фиксирована: новые поля добавляются только в конец с увеличением
+     * FlowTable::FILE_VERSION. Числа записаны в порядке байт машины.
+     */
+    struct FileHeader
+    {
+        char magic[8]; // FILE_MAGIC, записывается последним
+        uint32_t version; // FlowTable::FILE_VERSION
+        uint32_t header_size; // FlowTable::FILE_HEADER_SIZE
+        uint32_t slot_size; // Размер слота (ключ и FlowStats)
+        uint32_t group_size; // FlowTable::GROUP_SIZE
+        uint32_t hash_version; // FILE_HASH_VERSION
+        uint32_t shard_count; // Количество шардов хранилища (0 - таблица вне хранилища)
+        uint64_t capacity; // Количество слотов
+        uint64_t ctrl_offset; // Смещение управляющих байт
+        uint64_t slots_offset; // Смещение слотов
+    };
+
+    static_assert(sizeof(FileHeader) <= FlowTable::FILE_HEADER_SIZE);
+
+    /**
+     * @brief Проверка, что файл начинается с сигнатуры таблицы потоков
+     *
+     * Файл роста без сигнатуры создавался в момент остановки процесса и ещё не содержит потоков.
+     */
+    bool hasFileMagic(const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[sizeof(FILE_MAGIC)] = {};
+        return file.read(magic, sizeof(magic)) && std::memcmp(magic, FILE_MAGIC, sizeof(magic)) == 0;
+    }
+
+    /**
+     * @brief Таблица программной CRC32C (отражённый полином 0x82F63B78)
+     */
+    constexpr std::array<uint32_t, 256> makeCrc32cTable()
+    {
+        std::array<uint32_t, 256> table{};
+        for(uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t crc = i;
+            for(int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0u);
+            }
+            table[i] = crc;
+        }
+        return table;
+    }
+
+    constexpr std::array<uint32_t, 256> CRC32C_TABLE = makeCrc32cTable();
+
+    uint32_t crc32cSoftware(const FlowTuple& flow_tuple)
+    {
+        uint8_t bytes[sizeof(FlowTuple)];
+        std::memcpy(bytes, &flow_tuple, sizeof(bytes));
+
+        uint32_t crc = 0;
+        for(uint8_t byte : bytes)
+        {
+            crc = CRC32C_TABLE[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2"))) uint32_t crc32cHardware(const FlowTuple& flow_tuple)
+    {
+        uint64_t addresses;
+        uint32_t ports;
+        std::memcpy(&addresses, &flow_tuple, sizeof(addresses));
+        std::memcpy(&ports, reinterpret_cast<const uint8_t*>(&flow_tuple) + sizeof(addresses), sizeof(ports));
+        return _mm_crc32_u32(static_cast<uint32_t>(_mm_crc32_u64(0, addresses)), ports);
+    }
+
+    using Crc32cFunction = uint32_t(*)(const FlowTuple&);
+
+    Crc32cFunction selectCrc32c()
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2") ? crc32cHardware : crc32cSoftware;
+    }
+
+    const Crc32cFunction CRC32C = selectCrc32c();
+#endif
+
+    uint32_t crc32c(const FlowTuple& flow_tuple)
+    {
+#if defined(__x86_64__)
+        return CRC32C(flow_tuple);
+#else
+        return crc32cSoftware(flow_tuple);
+#endif
+    }
+
+    /**
+     * @brief Маска слотов группы с управляющим байтом, равным value
+     */
+    uint32_t matchByte(const uint8_t* group, uint8_t value)
+    {
+#if defined(__SSE2__)
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(value)))));
+#else
+        uint32_t mask = 0;
+        for(size_t i = 0; i < FlowTable::GROUP_SIZE; ++i)
+        {
+            mask |= static_cast<uint32_t>(group[i] == value) << i;
+        }
+        return mask;
+#endif
+    }
+
+    /**
+     * @brief Маска свободных (пустых или удалённых) слотов группы: старший бит сброшен
+     */
+    uint32_t matchFree(const uint8_t* group)
+    {
+#if defined(__SSE2__)
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+        return ~static_cast<uint32_t>(_mm_movemask_epi8(ctrl)) & 0xFFFF;
+#else
+        uint32_t mask = 0;
+        for(size_t i = 0; i < FlowTable::GROUP_SIZE; ++i)
+        {
+            mask |= static_cast<uint32_t>((group[i] & 0x80) == 0) << i;
+        }
+        return mask;
+#endif
+    }
+
+    /**
+     * @brief Управляющий байт занятого слота: старшие 7 бит хеша
+     */
+    uint8_t tagOf(uint64_t hash)
+    {
+        return static_cast<uint8_t>(0x80 | (hash >> 57));
+    }
+}
+
+FlowTable::FlowTable(size_t expected_flows, HugePageMode huge_pages, int numa_node)
+    : m_huge_pages(huge_pages)
+      , m_numa_node(numa_node)
+      , m_table(allocate(capacityFor(expected_flows), huge_pages, numa_node))
+      , m_migrate_group(0)
+      , m_released_bytes(0)
+      , m_sample_state(0)
+      , m_layout_version(0)
+      , m_verify_migration(false)
+      , m_shard_count(0)
+      , m_restored_flows(0)
+      , m_repaired_slots(0)
+{
+}
+
+FlowTable::FlowTable(const std::string& path, FileAccess access, size_t expected_flows, uint32_t shard_count)
+    : m_huge_pages(HugePageMode::Off)
+      , m_numa_node(-1)
+      , m_path(path)
+      , m_migrate_group(0)
+      , m_released_bytes(0)
+      , m_sample_state(0)
+      , m_layout_version(0)
+      , m_verify_migration(false)
+      , m_shard_count(shard_count)
+      , m_restored_flows(0)
+      , m_repaired_slots(0)
+{
+    const bool writable = access == FileAccess::ReadWrite;
+    const std::string grow_path = path + GROW_SUFFIX;
+    std::error_code error;
+    bool has_table = std::filesystem::exists(path, error);
+    bool has_grow = std::filesystem::exists(grow_path, error) && hasFileMagic(grow_path);
+    if(!has_grow && writable)
+    {
+        std::filesystem::remove(grow_path, error);
+    }
+
+    if(!has_table && !has_grow)
+    {
+        if(!writable)
+        {
+            throw std::runtime_error("Файл таблицы потоков " + path + " не найден");
+        }
+        m_table = allocateFile(path, capacityFor(expected_flows), shard_count);
+        return;
+    }
+
+    if(has_table)
+    {
+        m_table = attachFile(path, writable);
+    }
+    if(has_grow)
+    {
+        // Рост не завершился: старая таблица в основном файле, новая - в файле роста.
+        // Перенос продолжается с начала, уже перенесённые группы состоят из надгробий
+        Storage grown = attachFile(grow_path, writable);
+        if(has_table)
+        {
+            m_old_table = std::exchange(m_table, std::move(grown));
+            m_verify_migration = true;
+        }
+        else
+        {
+            m_table = std::move(grown);
+        }
+    }
+    m_restored_flows = size();
+    if(writable && !has_table)
+    {
+        // Основной файл удалён вручную после переименования не дошедшего до конца роста
+        finishMigration();
+    }
+}
+
+uint64_t FlowTable::hash(const FlowTuple& flow_tuple)
+{
+    // CRC32C хорошо перемешивает младшие биты (индекс группы), умножение разносит их по старшим (h2)
+    return static_cast<uint64_t>(crc32c(flow_tuple)) * 0x9E3779B97F4A7C15ULL;
+}
+
+size_t FlowTable::capacityFor(size_t flows)
+{
+    size_t slots = flows + flows / 7 + 1;
+    size_t groups = std::bit_ceil((slots + GROUP_SIZE - 1) / GROUP_SIZE);
+    return groups * GROUP_SIZE;
+}
+
+FlowTable::Storage FlowTable::allocate(size_t capacity, HugePageMode huge_pages, int numa_node)
+{
+    // Анонимное отображение уже обнулено, страницы выделяются при первой записи,
+    // поэтому выделение новой таблицы не стоит времени, пропорционального её размеру
+    const size_t slots_offset = (capacity + alignof(Slot) - 1) & ~(alignof(Slot) - 1);
+    Storage storage;
+    storage.mapping = PageMapping(slots_offset + capacity * sizeof(Slot), huge_pages, numa_node);
+    storage.ctrl = static_cast<uint8_t*>(storage.mapping.data());
+    storage.slots = reinterpret_cast<Slot*>(storage.ctrl + slots_offset);
+    storage.capacity = capacity;
+    storage.group_mask = capacity / GROUP_SIZE - 1;
+    return storage;
+}
+
+FlowTable::Storage FlowTable::allocateFile(const std::string& path, size_t capacity, uint32_t shard_count)
+{
+    const size_t slots_offset = (FILE_HEADER_SIZE + capacity + alignof(Slot) - 1) & ~(alignof(Slot) - 1);
+    Storage storage;
+    storage.mapping = PageMapping::createFile(path, slots_offset + capacity * sizeof(Slot));
+
+    auto* header = static_cast<FileHeader*>(storage.mapping.data());
+    header->version = FILE_VERSION;
+    header->header_size = FILE_HEADER_SIZE;
+    header->slot_size = sizeof(Slot);
+    header->group_size = GROUP_SIZE;
+    header->hash_version = FILE_HASH_VERSION;
+    header->shard_count = shard_count;
+    header->capacity = capacity;
+    header->ctrl_offset = FILE_HEADER_SIZE;
+    header->slots_offset = slots_offset;
+    // Сигнатура последней: файл, созданный не до конца, не принимается за таблицу. Первый байт
+    // сигнатуры записывается с release, читатель проверяет его с acquire до остальных полей
+    std::memcpy(header->magic + 1, FILE_MAGIC + 1, sizeof(FILE_MAGIC) - 1);
+    std::atomic_ref<char>(header->magic[0]).store(FILE_MAGIC[0], std::memory_order_release);
+
+    storage.ctrl = static_cast<uint8_t*>(storage.mapping.data()) + FILE_HEADER_SIZE;
+    storage.slots = reinterpret_cast<Slot*>(static_cast<uint8_t*>(storage.mapping.data()) + slots_offset);
+    storage.capacity = capacity;
+    storage.group_mask = capacity / GROUP_SIZE - 1;
+    return storage;
+}
+
+FlowTable::Storage FlowTable::attachFile(const std::string& path, bool writable)
+{
+    Storage storage;
+    storage.mapping = PageMapping::openFile(path, writable);
+    auto fail = [&path](const std::string& reason)
+    {
+        return std::runtime_error("Файл таблицы потоков " + path + ": " + reason);
+    };
+
+    auto* header = static_cast<FileHeader*>(storage.mapping.data());
+    if(storage.mapping.size() < FILE_HEADER_SIZE ||
+        std::atomic_ref<char>(header->magic[0]).load(std::memory_order_acquire) != FILE_MAGIC[0] ||
+        std::memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+    {
+        throw fail("нет сигнатуры таблицы потоков");
+    }
+    if(header->version != FILE_VERSION)
+    {
+        throw fail("версия " + std::to_string(header->version) + ", поддерживается " + std::to_string(FILE_VERSION));
+    }
+    if(header->header_size != FILE_HEADER_SIZE || header->slot_size != sizeof(Slot) ||
+        header->group_size != GROUP_SIZE || header->hash_version != FILE_HASH_VERSION)
+    {
+        throw fail("раскладка слотов или хеш отличаются от этой сборки");
+    }
+    const uint64_t capacity = header->capacity;
+    const uint64_t expected_offset = (FILE_HEADER_SIZE + capacity + alignof(Slot) - 1) & ~(alignof(Slot) - 1);
+    if(capacity < GROUP_SIZE || !std::has_single_bit(capacity) || header->ctrl_offset != FILE_HEADER_SIZE ||
+        header->slots_offset != expected_offset || storage.mapping.size() < expected_offset + capacity * sizeof(Slot))
+    {
+        throw fail("повреждённый заголовок");
+    }
+    // Поток попадает в шард по хешу от количества шардов: при другом количестве его
+    // восстановленная статистика осталась бы в одном шарде, а новые пакеты пошли бы в другой
+    if(writable && header->shard_count != m_shard_count)
+    {
+        throw fail("записан для " + std::to_string(header->shard_count) + " шардов, ожидается " +
+            std::to_string(m_shard_count));
+    }
+    m_shard_count = header->shard_count;
+
+    auto* base = static_cast<uint8_t*>(storage.mapping.data());
+    storage.ctrl = base + FILE_HEADER_SIZE;
+    storage.slots = reinterpret_cast<Slot*>(base + expected_offset);
+    storage.capacity = capacity;
+    storage.group_mask = capacity / GROUP_SIZE - 1;
+
+    // Счётчики в файле не хранятся: они восстанавливаются по управляющим байтам. Писатель
+    // заодно отбрасывает слоты, тег которых не совпадает с хешем ключа (повреждённый файл)
+    for(size_t index = 0; index < capacity; ++index)
+    {
+        const uint8_t ctrl = storage.ctrl[index];
+        const bool full = (ctrl & CTRL_FULL) != 0;
+        if(writable && ((full && ctrl != tagOf(hash(storage.slots[index].key))) ||
+            (!full && ctrl != CTRL_EMPTY && ctrl != CTRL_DELETED)))
+        {
+            storage.ctrl[index] = CTRL_DELETED;
+            ++storage.deleted;
+            ++m_repaired_slots;
+        }
+        else if(full)
+        {
+            ++storage.size;
+        }
+        else if(ctrl == CTRL_DELETED)
+        {
+            ++storage.deleted;
+        }
+    }
+    return storage;
+}
+
+size_t FlowTable::findIndex(const Storage& storage, const FlowTuple& flow_tuple, uint64_t hash)
+{
+    uint8_t tag = tagOf(hash);
+    size_t group = hash & storage.group_mask;
+
+    for(size_t step = 1;; ++step)
+    {
+        const uint8_t* ctrl = storage.ctrl + group * GROUP_SIZE;
+        for(uint32_t match = matchByte(ctrl, tag); match != 0; match &= match - 1)
+        {
+            size_t index = group * GROUP_SIZE + std::countr_zero(match);
+            // Ключ читается после acquire-чтения своего управляющего байта
+            if(loadCtrl(storage.ctrl[index]) == tag && storage.slots[index].key == flow_tuple)
+            {
+                return index;
+            }
+        }
+        // Пустой слот в группе: вставка остановилась бы здесь, дальше ключа нет
+        if(matchByte(ctrl, CTRL_EMPTY) != 0)
+        {
+            return NPOS;
+        }
+        group = (group + step) & storage.group_mask;
+    }
+}
+
+size_t FlowTable::findFreeIndex(const Storage& storage, uint64_t hash)
+{
+    size_t group = hash & storage.group_mask;
+
+    for(size_t step = 1;; ++step)
+    {
+        uint32_t free = matchFree(storage.ctrl + group * GROUP_SIZE);
+        if(free != 0)
+        {
+            return group * GROUP_SIZE + std::countr_zero(free);
+        }
+        group = (group + step) & storage.group_mask;
+    }
+}
+
+size_t FlowTable::place(Storage& storage, const FlowTuple& flow_tuple, uint64_t hash, const FlowStats& flow_stats)
+{
+    size_t index = findFreeIndex(storage, hash);
+    if(storage.ctrl[index] == CTRL_DELETED)
+    {
+        --storage.deleted;
+    }
+    storage.slots[index].key = flow_tuple;
+    storage.slots[index].stats = flow_stats;
+    // Управляющий байт открывает слот последним (важно для таблицы в файле): запись с release
+    // упорядочивает ключ и статистику перед ним, читатель видит их после loadCtrl()
+    std::atomic_ref<uint8_t>(storage.ctrl[index]).store(tagOf(hash), std::memory_order_release);
+    ++storage.size;
+    return index;
+}
+
+FlowStats* FlowTable::find(const FlowTuple& flow_tuple)
+{
+    return const_cast<FlowStats*>(std::as_const(*this).find(flow_tuple, hash(flow_tuple)));
+}
+
+const FlowStats* FlowTable::find(const FlowTuple& flow_tuple) const
+{
+    return find(flow_tuple, hash(flow_tuple));
+}
+
+FlowStats* FlowTable::find(const FlowTuple& flow_tuple, uint64_t key_hash)
+{
+    return const_cast<FlowStats*>(std::as_const(*this).find(flow_tuple, key_hash));
+}
+
+const FlowStats* FlowTable::find(const FlowTuple& flow_tuple, uint64_t key_hash) const
+{
+    size_t index = findIndex(m_table, flow_tuple, key_hash);
+    if(index != NPOS)
+    {
+        return &m_table.slots[index].stats;
+    }
+    if(isMigrating())
+    {
+        index = findIndex(m_old_table, flow_tuple, key_hash);
+        if(index != NPOS)
+        {
+            return &m_old_table.slots[index].stats;
+        }
+    }
+    return nullptr;
+}
+
+std::pair<FlowStats*, bool> FlowTable::insert(const FlowTuple& flow_tuple)
+{
+    return insert(flow_tuple, hash(flow_tuple));
+}
+
+std::pair<FlowStats*, bool> FlowTable::insert(const FlowTuple& flow_tuple, uint64_t key_hash)
+{
+    if(isMigrating())
+    {
+        migrate(MIGRATE_GROUPS_PER_INSERT);
+    }
+    else if(m_retired_mapping.data() != nullptr)
+    {
+        releaseRetired();
+    }
+
+    size_t index = findIndex(m_table, flow_tuple, key_hash);
+    if(index != NPOS)
+    {
+        return {&m_table.slots[index].stats, false};
+    }
+    if(isMigrating())
+    {
+        // Ещё не перенесённый поток обновляется на месте, его группу перенесут позже
+        index = findIndex(m_old_table, flow_tuple, key_hash);
+        if(index != NPOS)
+        {
+            return {&m_old_table.slots[index].stats, false};
+        }
+    }
+
+    // Заполнение (с надгробиями) не выше 7/8: пробирование всегда находит пустой слот
+    if(m_table.size + m_table.deleted + 1 > m_table.capacity - m_table.capacity / 8)
+    {
+        // Если место заняли в основном надгробия, достаточно перенести потоки в таблицу того же размера
+        startMigration(size() + 1 > m_table.capacity / 2 ? m_table.capacity * 2 : m_table.capacity);
+    }
+
+    index = place(m_table, flow_tuple, key_hash, FlowStats());
+    return {&m_table.slots[index].stats, true};
+}
+
+void FlowTable::prefetchGroup(uint64_t key_hash) const
+{
+    __builtin_prefetch(m_table.ctrl + (key_hash & m_table.group_mask) * GROUP_SIZE);
+}
+
+void FlowTable::prefetchSlot(uint64_t key_hash) const
+{
+    const size_t base = (key_hash & m_table.group_mask) * GROUP_SIZE;
+    uint32_t candidates = matchByte(m_table.ctrl + base, tagOf(key_hash));
+    if(candidates == 0)
+    {
+        candidates = matchFree(m_table.ctrl + base);
+    }
+    if(candidates != 0)
+    {
+        // Слот будет изменён: запрос на запись
+        __builtin_prefetch(&m_table.slots[base + std::countr_zero(candidates)], 1);
+    }
+}
+
+bool FlowTable::erase(const FlowTuple& flow_tuple)
+{
+    uint64_t key_hash = hash(flow_tuple);
+    for(Storage* storage : {&m_table, &m_old_table})
+    {
+        if(storage->capacity == 0)
+        {
+            continue;
+        }
+        size_t index = findIndex(*storage, flow_tuple, key_hash);
+        if(index != NPOS)
+        {
+            eraseAt(*storage, index);
+            return true;
+        }
+    }
+    return false;
+}
+
+void FlowTable::eraseAt(Storage& storage, size_t index)
+{
+    // Если в группе уже есть пустой слот, ни одна цепочка пробирования через неё не проходит
+    const uint8_t* group = storage.ctrl + (index & ~(GROUP_SIZE - 1));
+    if(matchByte(group, CTRL_EMPTY) != 0)
+    {
+        storage.ctrl[index] = CTRL_EMPTY;
+    }
+    else
+    {
+        storage.ctrl[index] = CTRL_DELETED;
+        ++storage.deleted;
+    }
+    --storage.size;
+}
+
+void FlowTable::startMigration(size_t new_capacity)
+{
+    // Рост при незавершённом переносе невозможен при MIGRATE_GROUPS_PER_INSERT >= 1
+    // (перенос заканчивается раньше, чем новая таблица заполнится), но остаётся корректным
+    if(isMigrating())
+    {
+        migrate(m_old_table.capacity / GROUP_SIZE);
+    }
+    // Отображение прошлого роста возвращается примерно за ёмкость/8000 вставок, а следующий рост
+    // наступает не раньше чем через 3/8 ёмкости: здесь оно уже освобождено
+    m_retired_mapping = PageMapping();
+    m_old_table = std::exchange(m_table, isPersistent() ? allocateFile(m_path + GROW_SUFFIX, new_capacity, m_shard_count)
+                                                        : allocate(new_capacity, m_huge_pages, m_numa_node));
+    m_migrate_group = 0;
+    m_released_bytes = 0;
+    ++m_layout_version;
+}
+
+void FlowTable::advanceMigration(size_t groups)
+{
+    if(isMigrating())
+    {
+        migrate(groups);
+    }
+}
+
+void FlowTable::migrate(size_t groups)
+{
+    const size_t group_count = m_old_table.capacity / GROUP_SIZE;
+    const size_t end_group = std::min(group_count, m_migrate_group + groups);
+
+    for(; m_migrate_group < end_group; ++m_migrate_group)
+    {
+        const size_t base = m_migrate_group * GROUP_SIZE;
+        for(size_t index = base; index < base + GROUP_SIZE; ++index)
+        {
+            if(m_old_table.ctrl[index] & CTRL_FULL)
+            {
+                const Slot& slot = m_old_table.slots[index];
+                const uint64_t key_hash = hash(slot.key);
+                // После перезапуска поток мог быть уже записан в новую таблицу, но ещё не удалён из старой
+                if(!m_verify_migration || findIndex(m_table, slot.key, key_hash) == NPOS)
+                {
+                    place(m_table, slot.key, key_hash, slot.stats);
+                }
+                // Надгробие, а не пустой слот: цепочки ещё не перенесённых ключей могут проходить здесь
+                m_old_table.ctrl[index] = CTRL_DELETED;
+                --m_old_table.size;
+            }
+        }
+    }
+
+    if(m_migrate_group == group_count || m_old_table.size == 0)
+    {
+        finishMigration();
+        return;
+    }
+    releaseMigrated();
+}
+
+void FlowTable::finishMigration()
+{
+    if(isPersistent())
+    {
+        // Новая таблица становится основной одним переименованием: после остановки процесса
+        // на диске либо обе таблицы роста, либо только новая
+        const std::string grow_path = m_path + GROW_SUFFIX;
+        if(std::rename(grow_path.c_str(), m_path.c_str()) != 0 && std::filesystem::exists(grow_path))
+        {
+            throw std::runtime_error("Не удалось переименовать " + grow_path + " в " + m_path + ": " +
+                std::strerror(errno));
+        }
+    }
+    // Управляющие байты и оставшиеся слоты старой таблицы - до нескольких мегабайт страниц:
+    // один munmap здесь стоил бы сотни микросекунд, пропорционально размеру таблицы
+    m_retired_mapping = std::move(m_old_table.mapping);
+    m_old_table = Storage{};
+    m_verify_migration = false;
+}
+
+void FlowTable::releaseMigrated()
+{
+    // Большая страница возвращается только целиком, поэтому порция не меньше страницы отображения
+    const size_t page_size = m_old_table.mapping.getPageSize();
+    const size_t migrated_bytes = m_migrate_group * GROUP_SIZE * sizeof(Slot);
+    if(migrated_bytes - m_released_bytes < std::max(RELEASE_CHUNK, page_size))
+    {
+        return;
+    }
+
+    // Слоты перенесённых групп больше не читаются: их управляющие байты - надгробия.
+    // Граница возвращённой части остаётся на границе страницы, чтобы страница на стыке
+    // порций вернулась со следующей порцией
+    const auto slots_address = reinterpret_cast<uintptr_t>(m_old_table.slots);
+    const uintptr_t begin = (slots_address + m_released_bytes + page_size - 1) & ~(page_size - 1);
+    const uintptr_t end = (slots_address + migrated_bytes) & ~(page_size - 1);
+    if(end > begin)
+    {
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+        m_released_bytes = end - slots_address;
+    }
+}
+
+void FlowTable::releaseRetired()
+{
+    // munmap порции возвращает и её страницы, и таблицы страниц: последний вызов не обходит всю таблицу
+    m_retired_mapping.releaseFront(std::max(RELEASE_CHUNK, m_retired_mapping.getPageSize()));
+}
+
+void FlowTable::clear()
+{
+    std::memset(m_table.ctrl, CTRL_EMPTY, m_table.capacity);
+    m_table.size = 0;
+    m_table.deleted = 0;
+    if(isMigrating())
+    {
+        finishMigration();
+    }
+    ++m_layout_version;
+}
+
+size_t FlowTable::getMemoryUsage() const
+{
+    return getMemoryForCapacity(m_table.capacity) + getMemoryForCapacity(m_old_table.capacity) +
+        m_retired_mapping.size();
+}
+
+size_t FlowTable::getMemoryForCapacity(size_t capacity)
+{
+    return capacity * (sizeof(uint8_t) + sizeof(Slot));
+}
@@ -0,0 +1,485 @@
+#ifndef FLOW_TABLE_H
+#define FLOW_TABLE_H
+
+#include "../packet_processor/PacketParser.h"
+#include "../packet_processor/PageMapping.h"
+#include "FlowStats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+/**
+ * @brief Хеш-таблица потоков с открытой адресацией (в стиле Swiss table)
+ *
+ * Слоты разбиты на группы по 16. Для каждого слота хранится управляющий байт:
+ * 0x00 - пусто, 0x01 - удалён, 0x80 | h2 - занят (h2 - старшие 7 бит хеша).
+ * Поиск сравнивает 16 управляющих байт группы одной SSE2 инструкцией и читает
+ * ключ только у совпавших слотов. Группы перебираются треугольным пробированием.
+ * Ключ - 12-байтовый FlowTuple, хеш - CRC32C от ключа с умножением для перемешивания.
+ *
+ * Рост выполняется постепенно: новая таблица выделяется анонимным mmap (нулевые
+ * страницы выдаются ядром лениво, выделение не зависит от размера), а каждая вставка
+ * переносит в неё MIGRATE_GROUPS_PER_INSERT групп старой таблицы. Пока перенос не
+ * завершён, поиск проверяет обе таблицы. Страницы перенесённых слотов возвращаются
+ * ядру частями по RELEASE_CHUNK; управляющие байты старой таблицы нужны поиску до
+ * конца переноса и возвращаются после него, по порции на вставку. Ни одна операция
+ * не перестраивает и не освобождает таблицу целиком. Таблицы от 2 МБ могут
+ * отображаться большими страницами (HugePageMode): случайный поиск по миллионам
+ * потоков тогда реже промахивается мимо TLB.
+ *
+ * Таблица может храниться в файле (конструктор с путём): первая страница - заголовок
+ * фиксированной раскладки с версией, затем управляющие байты и слоты, отображённые
+ * MAP_SHARED. После перезапуска процесса таблица подключается к файлу без копирования,
+ * счётчики занятых слотов восстанавливаются по управляющим байтам. Рост пишет новую
+ * таблицу в файл path + GROW_SUFFIX и по окончании переноса переименовывает его в path;
+ * оба файла подключаются и после остановки посреди переноса. Управляющий байт слота
+ * записывается с release после ключа и статистики и читается с acquire, поэтому
+ * ни остановка процесса, ни читатель из другого процесса не видят занятого слота
+ * с недописанным ключом.
+ * Указатели на статистику действительны до следующей вставки или удаления.
+ */
+class FlowTable
+{
+public:
+    static constexpr size_t GROUP_SIZE = 16;
+    static constexpr size_t MIGRATE_GROUPS_PER_INSERT = 2;
+    static constexpr size_t RELEASE_CHUNK = 128 * 1024;
+    static constexpr uint32_t FILE_VERSION = 1; // Версия раскладки файла таблицы
+    static constexpr size_t FILE_HEADER_SIZE = 4096; // Заголовок файла занимает первую страницу
+    static constexpr const char* GROW_SUFFIX = ".grow"; // Файл новой таблицы на время роста
+
+    /**
+     * @brief Доступ к файлу таблицы
+     */
+    enum class FileAccess
+    {
+        ReadWrite, ///< Подключение или создание таблицы единственным писателем (блокировка flock)
+        ReadOnly ///< Чтение таблицы работающего или остановленного писателя (только find(), forEach(), size())
+    };
+
+    /**
+     * @brief Конструктор
+     * @param expected_flows Ожидаемое количество потоков (таблица создаётся без роста до этого размера)
+     * @param huge_pages Большие страницы для таблицы и всех следующих при росте
+     * @param numa_node Узел NUMA для таблицы и всех следующих при росте (-1 - по первой записи)
+     */
+    explicit FlowTable(size_t expected_flows = 0, HugePageMode huge_pages = HugePageMode::Off, int numa_node = -1);
+
+    /**
+     * @brief Конструктор таблицы в файле
+     *
+     * Существующий файл (и файл незавершённого роста) подключается с сохранёнными потоками,
+     * иначе при доступе на запись создаётся пустая таблица. Таблица в файле всегда
+     * на обычных страницах.
+     *
+     * @param path Путь к файлу таблицы
+     * @param access Доступ к файлу
+     * @param expected_flows Ожидаемое количество потоков для новой таблицы
+     * @param shard_count Количество шардов, между которыми распределены потоки (записывается в файл;
+     *                    писатель не подключается к файлу с другим количеством, читатель его не проверяет)
+     * @throw std::runtime_error если файл занят другим писателем, повреждён, другой версии
+     *        или записан для другого количества шардов
+     */
+    FlowTable(const std::string& path, FileAccess access, size_t expected_flows = 0, uint32_t shard_count = 0);
+
+    /**
+     * @brief Поиск статистики потока
+     * @param flow_tuple 4-tuple потока
+     * @return Указатель на статистику или nullptr если поток не найден
+     */
+    [[nodiscard]] FlowStats* find(const FlowTuple& flow_tuple);
+
+    /**
+     * @brief Поиск статистики потока (только чтение)
+     * @param flow_tuple 4-tuple потока
+     * @return Указатель на статистику или nullptr если поток не найден
+     */
+    [[nodiscard]] const FlowStats* find(const FlowTuple& flow_tuple) const;
+
+    /**
+     * @brief Поиск статистики потока по заранее вычисленному хешу
+     * @param flow_tuple 4-tuple потока
+     * @param key_hash hash(flow_tuple)
+     * @return Указатель на статистику или nullptr если поток не найден
+     */
+    [[nodiscard]] FlowStats* find(const FlowTuple& flow_tuple, uint64_t key_hash);
+
+    /**
+     * @brief Поиск статистики потока по заранее вычисленному хешу (только чтение)
+     * @param flow_tuple 4-tuple потока
+     * @param key_hash hash(flow_tuple)
+     * @return Указатель на статистику или nullptr если поток не найден
+     */
+    [[nodiscard]] const FlowStats* find(const FlowTuple& flow_tuple, uint64_t key_hash) const;
+
+    /**
+     * @brief Поиск потока со вставкой пустой статистики при отсутствии
+     * @param flow_tuple 4-tuple потока
+     * @return Указатель на статистику и признак вставки нового потока
+     */
+    std::pair<FlowStats*, bool> insert(const FlowTuple& flow_tuple);
+
+    /**
+     * @brief Поиск со вставкой по заранее вычисленному хешу
+     * @param flow_tuple 4-tuple потока
+     * @param key_hash hash(flow_tuple)
+     * @return Указатель на статистику и признак вставки нового потока
+     */
+    std::pair<FlowStats*, bool> insert(const FlowTuple& flow_tuple, uint64_t key_hash);
+
+    /**
+     * @brief Запрос в кэш управляющих байт первой группы пробирования
+     * @param key_hash Хеш ключа
+     */
+    void prefetchGroup(uint64_t key_hash) const;
+
+    /**
+     * @brief Запрос в кэш слота, в котором вероятнее всего окажется ключ
+     *
+     * Читает управляющие байты первой группы (их стоит запросить заранее prefetchGroup())
+     * и запрашивает первый слот с совпавшим тегом, а без совпадения - первый свободный
+     * слот, куда попадёт вставка. Только подсказка: результат поиска не меняется.
+     *
+     * @param key_hash Хеш ключа
+     */
+    void prefetchSlot(uint64_t key_hash) const;
+
+    /**
+     * @brief Удаление потока
+     * @param flow_tuple 4-tuple потока
+     * @return true если поток был удалён
+     */
+    bool erase(const FlowTuple& flow_tuple);
+
+    /**
+     * @brief Удаление всех потоков, удовлетворяющих условию
+     * @param predicate Условие вида bool(const FlowTuple&, const FlowStats&)
+     * @return Количество удалённых потоков
+     */
+    template<typename Predicate>
+    size_t eraseIf(Predicate predicate)
+    {
+        size_t erased = 0;
+        for(Storage* storage : {&m_table, &m_old_table})
+        {
+            for(size_t index = 0; index < storage->capacity; ++index)
+            {
+                if((storage->ctrl[index] & CTRL_FULL) &&
+                    predicate(storage->slots[index].key, storage->slots[index].stats))
+                {
+                    eraseAt(*storage, index);
+                    ++erased;
+                }
+            }
+        }
+        return erased;
+    }
+
+    /**
+     * @brief Обход всех потоков (порядок не определён)
+     * @param function Обработчик вида void(const FlowTuple&, const FlowStats&)
+     */
+    template<typename Function>
+    void forEach(Function function) const
+    {
+        for(const Storage* storage : {&m_table, &m_old_table})
+        {
+            for(size_t index = 0; index < storage->capacity; ++index)
+            {
+                if(loadCtrl(storage->ctrl[index]) & CTRL_FULL)
+                {
+                    function(storage->slots[index].key, storage->slots[index].stats);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Обход части слотов текущей таблицы (для сборки снимка порциями)
+     *
+     * Позиции действительны, пока не изменилась getLayoutVersion() и не идёт перенос:
+     * вставки и удаления между порциями не сдвигают остальные потоки.
+     *
+     * @param position Первый слот
+     * @param slots Количество просматриваемых слотов
+     * @param function Обработчик вида void(const FlowTuple&, const FlowStats&)
+     * @return Следующий слот (capacity() - обход завершён)
+     */
+    template<typename Function>
+    size_t forEachFrom(size_t position, size_t slots, Function function) const
+    {
+        const size_t end = std::min(m_table.capacity, position + slots);
+        for(; position < end; ++position)
+        {
+            if(m_table.ctrl[position] & CTRL_FULL)
+            {
+                function(m_table.slots[position].key, m_table.slots[position].stats);
+            }
+        }
+        return end;
+    }
+
+    /**
+     * @brief Выбор потока среди случайной выборки занятых слотов
+     *
+     * Просматривает подряд идущие группы, начиная со случайной, пока не наберёт samples
+     * потоков (во время роста - в старой таблице, пока в ней есть потоки), и возвращает
+     * лучший по prefer. Стоимость не зависит от размера таблицы.
+     *
+     * @param samples Размер выборки
+     * @param prefer Сравнение вида bool(const FlowStats& a, const FlowStats& b): true если a предпочтительнее b
+     * @return Ключ выбранного потока (действителен до следующей вставки или удаления) или nullptr если таблица пуста
+     */
+    template<typename Prefer>
+    [[nodiscard]] const FlowTuple* sample(size_t samples, Prefer prefer)
+    {
+        const Storage& storage = m_old_table.size != 0 ? m_old_table : m_table;
+        if(storage.size == 0)
+        {
+            return nullptr;
+        }
+
+        // Линейный конгруэнтный генератор, начальная группа берётся из старших бит состояния
+        m_sample_state = m_sample_state * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t group = (m_sample_state >> 32) & storage.group_mask;
+        const Slot* best = nullptr;
+        size_t seen = 0;
+        for(size_t visited = 0; visited <= storage.group_mask && seen < samples; ++visited)
+        {
+            const size_t base = group * GROUP_SIZE;
+            for(size_t index = base; index < base + GROUP_SIZE && seen < samples; ++index)
+            {
+                if(storage.ctrl[index] & CTRL_FULL)
+                {
+                    const Slot& slot = storage.slots[index];
+                    if(best == nullptr || prefer(slot.stats, best->stats))
+                    {
+                        best = &slot;
+                    }
+                    ++seen;
+                }
+            }
+            group = (group + 1) & storage.group_mask;
+        }
+        return &best->key;
+    }
+
+    /**
+     * @brief Удаление всех потоков без освобождения памяти текущей таблицы
+     */
+    void clear();
+
+    /**
+     * @brief Перенос нескольких групп старой таблицы без вставки
+     * @param groups Количество групп (ничего не делает, если переноса нет)
+     */
+    void advanceMigration(size_t groups);
+
+    /**
+     * @brief Версия расположения слотов
+     * @return Число, меняющееся при каждом росте, перестройке или очистке таблицы
+     */
+    [[nodiscard]] uint64_t getLayoutVersion() const { return m_layout_version; }
+
+    /**
+     * @brief Количество потоков
+     * @return Количество занятых слотов в обеих таблицах
+     */
+    [[nodiscard]] size_t size() const { return m_table.size + m_old_table.size; }
+
+    /**
+     * @brief Ёмкость таблицы
+     * @return Количество слотов текущей таблицы (степень двойки, кратная GROUP_SIZE)
+     */
+    [[nodiscard]] size_t capacity() const { return m_table.capacity; }
+
+    /**
+     * @brief Проверка незавершённого переноса из старой таблицы
+     * @return true если рост ещё выполняется
+     */
+    [[nodiscard]] bool isMigrating() const { return m_old_table.capacity != 0; }
+
+    /**
+     * @brief Тип страниц текущей таблицы
+     * @return Тип страниц (маленькие таблицы всегда на обычных страницах)
+     */
+    [[nodiscard]] PageType getPageType() const { return m_table.mapping.getPageType(); }
+
+    /**
+     * @brief Узел NUMA текущей таблицы
+     * @return Номер узла (-1 - узел не задан или ядро не приняло политику)
+     */
+    [[nodiscard]] int getNumaNode() const { return m_table.mapping.getNumaNode(); }
+
+    /**
+     * @brief Проверка хранения таблицы в файле
+     * @return true если таблица отображена из файла
+     */
+    [[nodiscard]] bool isPersistent() const { return !m_path.empty(); }
+
+    /**
+     * @brief Количество потоков, найденных в файле при подключении
+     * @return Количество потоков (0 - новая таблица)
+     */
+    [[nodiscard]] size_t getRestoredFlows() const { return m_restored_flows; }
+
+    /**
+     * @brief Количество шардов, записанное в файле таблицы
+     * @return Количество шардов (0 - таблица вне хранилища шардов или в памяти)
+     */
+    [[nodiscard]] uint32_t getShardCount() const { return m_shard_count; }
+
+    /**
+     * @brief Количество повреждённых слотов, отброшенных при подключении к файлу
+     * @return Количество слотов (тег не совпал с хешем ключа или недопустимый управляющий байт)
+     */
+    [[nodiscard]] size_t getRepairedSlots() const { return m_repaired_slots; }
+
+    /**
+     * @brief Объём памяти под управляющие байты и слоты
+     * @return Размер в байтах (на время роста - обеих таблиц)
+     */
+    [[nodiscard]] size_t getMemoryUsage() const;
+
+    /**
+     * @brief Объём памяти таблицы заданной ёмкости
+     * @param capacity Количество слотов
+     * @return Размер управляющих байт и слотов в байтах
+     */
+    [[nodiscard]] static size_t getMemoryForCapacity(size_t capacity);
+
+    /**
+     * @brief Хеш ключа: CRC32C от 12 байт 4-tuple, перемешанный умножением
+     * @param flow_tuple 4-tuple потока
+     * @return 64-битный хеш (одинаковый для аппаратной и программной CRC32C)
+     */
+    [[nodiscard]] static uint64_t hash(const FlowTuple& flow_tuple);
+
+private:
+    static constexpr uint8_t CTRL_EMPTY = 0x00;
+    static constexpr uint8_t CTRL_DELETED = 0x01;
+    static constexpr uint8_t CTRL_FULL = 0x80;
+    static constexpr size_t NPOS = static_cast<size_t>(-1);
+
+    static_assert(std::atomic_ref<uint8_t>::is_always_lock_free, "Управляющий байт в файле читается другим процессом");
+
+    /**
+     * @brief Чтение управляющего байта (acquire)
+     *
+     * Парное к записи в place(): если байт уже показывает занятый слот, ключ и статистика
+     * видны полностью на любой архитектуре, в том числе читателю таблицы в файле
+     * из другого процесса (flow_reader), пока писатель продолжает работу.
+     */
+    static uint8_t loadCtrl(const uint8_t& ctrl)
+    {
+        return std::atomic_ref<uint8_t>(const_cast<uint8_t&>(ctrl)).load(std::memory_order_acquire);
+    }
+
+    struct Slot
+    {
+        FlowTuple key;
+        FlowStats stats;
+    };
+
+    /**
+     * @brief Массивы одной таблицы (текущей или старой на время роста) в одном отображении
+     */
+    struct Storage
+    {
+        PageMapping mapping; // Управляющие байты, затем слоты
+        uint8_t* ctrl = nullptr; // Управляющие байты
+        Slot* slots = nullptr; // Ключи и статистика
+        size_t capacity = 0; // Количество слотов
+        size_t group_mask = 0; // Количество групп - 1
+        size_t size = 0; // Занятые слоты
+        size_t deleted = 0; // Удалённые слоты (надгробия)
+    };
+
+    /**
+     * @brief Выделение обнулённого отображения (все слоты пусты)
+     */
+    static Storage allocate(size_t capacity, HugePageMode huge_pages, int numa_node);
+
+    /**
+     * @brief Создание файла пустой таблицы
+     */
+    static Storage allocateFile(const std::string& path, size_t capacity, uint32_t shard_count);
+
+    /**
+     * @brief Подключение к файлу таблицы с проверкой заголовка и подсчётом занятых слотов
+     */
+    Storage attachFile(const std::string& path, bool writable);
+
+    /**
+     * @brief Завершение роста: освобождение старой таблицы, файл новой становится основным
+     */
+    void finishMigration();
+
+    /**
+     * @brief Индекс слота с ключом
+     * @return Индекс или NPOS
+     */
+    [[nodiscard]] static size_t findIndex(const Storage& storage, const FlowTuple& flow_tuple, uint64_t hash);
+
+    /**
+     * @brief Индекс первого свободного (пустого или удалённого) слота на пути пробирования
+     */
+    [[nodiscard]] static size_t findFreeIndex(const Storage& storage, uint64_t hash);
+
+    /**
+     * @brief Запись ключа и статистики в свободный слот
+     * @return Индекс занятого слота
+     */
+    static size_t place(Storage& storage, const FlowTuple& flow_tuple, uint64_t hash, const FlowStats& flow_stats);
+
+    /**
+     * @brief Освобождение занятого слота
+     */
+    static void eraseAt(Storage& storage, size_t index);
+
+    /**
+     * @brief Начало роста: текущая таблица становится старой
+     */
+    void startMigration(size_t new_capacity);
+
+    /**
+     * @brief Перенос нескольких групп старой таблицы в текущую
+     * @param groups Количество групп
+     */
+    void migrate(size_t groups);
+
+    /**
+     * @brief Возврат ядру страниц уже перенесённых слотов старой таблицы
+     */
+    void releaseMigrated();
+
+    /**
+     * @brief Возврат ядру очередной порции отображения старой таблицы после переноса
+     */
+    void releaseRetired();
+
+    /**
+     * @brief Ёмкость для ожидаемого количества потоков при заполнении не более 7/8
+     */
+    static size_t capacityFor(size_t flows);
+
+    HugePageMode m_huge_pages;
+    int m_numa_node;
+    std::string m_path; // Файл таблицы (пусто - анонимная память)
+    Storage m_table; // Текущая таблица
+    Storage m_old_table; // Таблица, из которой идёт перенос (capacity == 0 - переноса нет)
+    size_t m_migrate_group; // Следующая группа старой таблицы для переноса
+    size_t m_released_bytes; // Начало ещё не возвращённых ядру слотов старой таблицы (байт от slots)
+    PageMapping m_retired_mapping; // Отображение старой таблицы после переноса, возвращается порциями
+    uint64_t m_sample_state; // Состояние генератора начальной группы выборки
+    uint64_t m_layout_version; // Меняется, когда потоки переезжают в другие слоты
+    bool m_verify_migration; // Перенос продолжен после перезапуска: поток может уже быть в новой таблице
+    uint32_t m_shard_count; // Количество шардов хранилища из заголовка файла
+    size_t m_restored_flows;
+    size_t m_repaired_slots;
+};
+
+#endif // FLOW_TABLE_H
@@ -1,72 +1,450 @@
 #include "FlowTracker.h"
-#include <chrono>
+#include <algorithm>
+#include <thread>
 
-FlowTracker::FlowTracker() = default;
+FlowTracker::FlowTracker(size_t expected_flows, uint64_t idle_timeout_seconds,
+                         size_t max_flows, EvictionPolicy eviction_policy, HugePageMode huge_pages, int numa_node,
+                         const std::string& table_path, uint32_t shard_count)
+    : m_flows_waiters(0)
+      , m_flows(table_path.empty()
+                  ? FlowTable(max_flows != 0 ? std::min(expected_flows, max_flows) : expected_flows, huge_pages, numa_node)
+                  : FlowTable(table_path, FlowTable::FileAccess::ReadWrite,
+                              max_flows != 0 ? std::min(expected_flows, max_flows) : expected_flows, shard_count))
+      , m_idle_timeout(idle_timeout_seconds * 1000000)
+      , m_linger_timeout(LINGER_TIMEOUT * 1000000)
+      , m_max_flows(max_flows)
+      , m_eviction_policy(eviction_policy)
+      , m_snapshot_epoch(0)
+      , m_snapshot(std::make_shared<FlowSnapshot>(FlowColumns(), 0))
+{
+    // Таймеры восстановленных потоков ставятся по времени их последнего пакета: потоки,
+    // простоявшие дольше таймаута, пока процесс не работал, истекут с первыми пакетами
+    m_flows.forEach([this](const FlowTuple& flow_tuple, const FlowStats& flow_stats)
+    {
+        m_timer_wheel.schedule(flow_tuple, flow_stats.getFirstPacketTime(), flow_stats.getLastPacketTime() +
+                               (flow_stats.isClosed() ? m_linger_timeout : m_idle_timeout));
+    });
+}
 
 void FlowTracker::updateFlow(const FlowTuple& flow_tuple, uint32_t packet_size,
-                             uint32_t payload_size, uint64_t timestamp)
+                             uint32_t payload_size, uint64_t timestamp, uint8_t tcp_flags)
 {
-    std::lock_guard<std::mutex> lock(m_flows_mutex);
+    const std::unique_lock<std::mutex> lock = lockFlows();
 
-    auto it = m_flows.find(flow_tuple);
-    if(it == m_flows.end())
+    if(m_top_k)
     {
-        // Создаем новый поток
-        FlowStats new_stats;
-        new_stats.updateStats(packet_size, payload_size, timestamp);
-        m_flows[flow_tuple] = new_stats;
+        m_top_k->update(flow_tuple, packet_size, payload_size, timestamp);
+        return;
     }
-    else
+    applyPacket(flow_tuple, packet_size, payload_size, timestamp, tcp_flags, FlowTable::hash(flow_tuple));
+}
+
+void FlowTracker::updateFlows(std::span<const PacketInfo> packets, std::span<const FlowDelta> deltas)
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+
+    if(m_top_k)
+    {
+        for(const PacketInfo& packet : packets)
+        {
+            m_top_k->update(packet.flow_tuple, packet.packet_size, packet.payload_size, packet.timestamp);
+        }
+        return;
+    }
+
+    size_t next_delta = 0;
+    uint64_t hashes[PREFETCH_WINDOW];
+    for(size_t begin = 0; begin < packets.size(); begin += PREFETCH_WINDOW)
+    {
+        const std::span<const PacketInfo> window = packets.subspan(begin, std::min(PREFETCH_WINDOW,
+                                                                                   packets.size() - begin));
+        // Запросы всего окна уходят в память одновременно: слот запрашивается после управляющих байт
+        for(size_t i = 0; i < window.size(); ++i)
+        {
+            hashes[i] = FlowTable::hash(window[i].flow_tuple);
+            m_flows.prefetchGroup(hashes[i]);
+        }
+        for(size_t i = 0; i < window.size(); ++i)
+        {
+            m_flows.prefetchSlot(hashes[i]);
+        }
+        for(size_t i = 0; i < window.size(); ++i)
+        {
+            for(; next_delta < deltas.size() && deltas[next_delta].position <= begin + i; ++next_delta)
+            {
+                applyDelta(deltas[next_delta]);
+            }
+            const PacketInfo& packet = window[i];
+            applyPacket(packet.flow_tuple, packet.packet_size, packet.payload_size, packet.timestamp,
+                        packet.tcp_flags, hashes[i]);
+        }
+    }
+    for(; next_delta < deltas.size(); ++next_delta)
     {
-        // Обновляем существующий поток
-        it->second.updateStats(packet_size, payload_size, timestamp);
+        applyDelta(deltas[next_delta]);
     }
 }
 
-const FlowStats* FlowTracker::getFlowStats(const FlowTuple& flow_tuple) const
+void FlowTracker::applyPacket(const FlowTuple& flow_tuple, uint32_t packet_size, uint32_t payload_size,
+                              uint64_t timestamp, uint8_t tcp_flags, uint64_t key_hash)
 {
-    std::lock_guard<std::mutex> lock(m_flows_mutex);
+    makeRoom(flow_tuple, key_hash);
+
+    // Новый поток вставляется с обнулённой статистикой и получает таймер простоя
+    auto [flow_stats, inserted] = m_flows.insert(flow_tuple, key_hash);
+    bool was_closed = flow_stats->isClosed();
+    if(was_closed && (tcp_flags & (TCP_FLAG_SYN | TCP_FLAG_ACK)) == TCP_FLAG_SYN)
+    {
+        // Новое соединение с тем же 4-tuple: старое отдаётся целиком, слот используется заново
+        retire(flow_tuple, *flow_stats, FlowRetireReason::Closed);
+        flow_stats->reset();
+        inserted = true;
+        was_closed = false;
+    }
 
-    auto it = m_flows.find(flow_tuple);
-    if(it != m_flows.end())
+    flow_stats->updateStats(packet_size, payload_size, timestamp, tcp_flags);
+    if(inserted)
     {
-        return &it->second;
+        startIdleTimer(flow_tuple, timestamp, timestamp);
+    }
+    if(!was_closed && flow_stats->isClosed())
+    {
+        // Короткий таймер ожидания; таймер простоя останется и будет отброшен при срабатывании
+        m_timer_wheel.schedule(flow_tuple, flow_stats->getFirstPacketTime(), timestamp + m_linger_timeout);
     }
-    return nullptr;
 }
 
-std::map<FlowTuple, FlowStats> FlowTracker::getAllFlows() const
+void FlowTracker::applyDelta(const FlowDelta& delta)
 {
-    std::lock_guard<std::mutex> lock(m_flows_mutex);
-    return m_flows;
+    makeRoom(delta.flow_tuple, delta.key_hash);
+
+    // Дельта не содержит SYN, FIN и RST: состояние соединения она не меняет
+    auto [flow_stats, inserted] = m_flows.insert(delta.flow_tuple, delta.key_hash);
+    flow_stats->merge(delta.flow_stats);
+    if(inserted)
+    {
+        startIdleTimer(delta.flow_tuple, flow_stats->getFirstPacketTime(), flow_stats->getLastPacketTime());
+    }
 }
 
-void FlowTracker::cleanupOldFlows(uint64_t timeout_seconds)
+void FlowTracker::makeRoom(const FlowTuple& flow_tuple, uint64_t key_hash)
 {
-    uint64_t current_time = std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
+    // Предел проверяется только при заполненной таблице: обычный путь не делает лишнего поиска
+    if(m_max_flows != 0 && m_flows.size() >= m_max_flows && m_flows.find(flow_tuple, key_hash) == nullptr)
+    {
+        evictFlow();
+    }
+}
 
-    uint64_t timeout_us = timeout_seconds * 1000000;
+void FlowTracker::startIdleTimer(const FlowTuple& flow_tuple, uint64_t first_packet_time, uint64_t last_packet_time)
+{
+    m_timer_wheel.schedule(flow_tuple, first_packet_time, last_packet_time + m_idle_timeout);
+    // Не меньше половины таймеров устарели: обход колеса амортизируется вставками
+    if(m_timer_wheel.size() >= std::max(MIN_TIMER_PURGE, 4 * m_flows.size()))
+    {
+        purgeTimers();
+    }
+}
 
-    std::lock_guard<std::mutex> lock(m_flows_mutex);
+void FlowTracker::evictFlow()
+{
+    const FlowTuple* victim = nullptr;
+    if(m_eviction_policy == EvictionPolicy::SmallestBytes)
+    {
+        victim = m_flows.sample(EVICTION_SAMPLES, [](const FlowStats& a, const FlowStats& b)
+        {
+            if(a.isClosed() != b.isClosed())
+            {
+                return a.isClosed();
+            }
+            return a.getTotalBytes() != b.getTotalBytes() ? a.getTotalBytes() < b.getTotalBytes()
+                                                          : a.getLastPacketTime() < b.getLastPacketTime();
+        });
+    }
+    else
+    {
+        victim = m_flows.sample(EVICTION_SAMPLES, [](const FlowStats& a, const FlowStats& b)
+        {
+            if(a.isClosed() != b.isClosed())
+            {
+                return a.isClosed();
+            }
+            return a.getLastPacketTime() < b.getLastPacketTime();
+        });
+    }
+    if(victim == nullptr)
+    {
+        return;
+    }
 
-    auto it = m_flows.begin();
-    while(it != m_flows.end())
+    // Таймер вытесненного потока остаётся в колесе и отбрасывается при срабатывании или чистке
+    const FlowTuple flow_tuple = *victim;
+    retire(flow_tuple, *m_flows.find(flow_tuple), FlowRetireReason::Evicted);
+    m_flows.erase(flow_tuple);
+}
+
+void FlowTracker::purgeTimers()
+{
+    m_timer_wheel.removeIf([this](const FlowTimer& timer)
     {
-        uint64_t last_packet_time = it->second.getLastPacketTime();
-        if(current_time - last_packet_time > timeout_us)
+        const FlowStats* flow_stats = m_flows.find(timer.flow_tuple);
+        return flow_stats == nullptr || flow_stats->getFirstPacketTime() != timer.first_packet_time;
+    });
+}
+
+void FlowTracker::setRetiredFlowHandler(RetiredFlowHandler handler)
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+    m_retired_flow_handler = std::move(handler);
+}
+
+void FlowTracker::enableApproxTopK(size_t counters, size_t sketch_width)
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+    m_top_k = std::make_unique<SpaceSaving>(counters, sketch_width);
+}
+
+HeavyHitterSummary FlowTracker::getHeavyHitters(size_t count) const
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+
+    HeavyHitterSummary summary;
+    if(m_top_k)
+    {
+        summary.top = m_top_k->getTop(count);
+        summary.threshold = m_top_k->getMinBytes();
+        summary.total_bytes = m_top_k->getTotalBytes();
+        summary.tracked = m_top_k->size();
+        summary.capacity = m_top_k->capacity();
+    }
+    return summary;
+}
+
+void FlowTracker::retire(const FlowTuple& flow_tuple, const FlowStats& flow_stats, FlowRetireReason reason) const
+{
+    if(m_retired_flow_handler)
+    {
+        m_retired_flow_handler(flow_tuple, flow_stats, reason);
+    }
+}
+
+size_t FlowTracker::expireFlows(uint64_t now)
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+
+    m_timer_wheel.advance(now, m_due_timers);
+
+    size_t expired = 0;
+    for(const FlowTimer& timer : m_due_timers)
+    {
+        const FlowStats* flow_stats = m_flows.find(timer.flow_tuple);
+        if(flow_stats == nullptr || flow_stats->getFirstPacketTime() != timer.first_packet_time)
         {
-            it = m_flows.erase(it);
+            // Поток уже удалён (или пересоздан со своим таймером)
+            continue;
+        }
+
+        const bool closed = flow_stats->isClosed();
+        const uint64_t deadline = flow_stats->getLastPacketTime() + (closed ? m_linger_timeout : m_idle_timeout);
+        if(deadline <= m_timer_wheel.getCurrentTime())
+        {
+            retire(timer.flow_tuple, *flow_stats, closed ? FlowRetireReason::Closed : FlowRetireReason::Idle);
+            m_flows.erase(timer.flow_tuple);
+            ++expired;
         }
         else
         {
-            ++it;
+            // Поток получал пакеты: таймер продлевается только сейчас, а не на каждом пакете
+            m_timer_wheel.schedule(timer.flow_tuple, timer.first_packet_time, deadline);
         }
     }
+    m_due_timers.clear();
+    return expired;
+}
+
+std::optional<FlowStats> FlowTracker::getFlowStats(const FlowTuple& flow_tuple) const
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+
+    const FlowStats* flow_stats = m_flows.find(flow_tuple);
+    if(flow_stats == nullptr)
+    {
+        return std::nullopt;
+    }
+    return *flow_stats;
+}
+
+std::shared_ptr<const FlowSnapshot> FlowTracker::publishSnapshot()
+{
+    std::lock_guard<std::mutex> publish_lock(m_publish_mutex);
+
+    FlowColumns flows = std::move(m_snapshot_spare);
+    m_snapshot_chunk.reserve(SNAPSHOT_CHUNK);
+    uint64_t layout_version = 0;
+    size_t position = 0;
+    bool started = false;
+    for(bool done = false; !done;)
+    {
+        // std::mutex не передаёт блокировку ожидающему: без уступки сборщик захватывал бы её
+        // снова сразу после освобождения, и поток захвата ждал бы несколько порций подряд
+        while(m_flows_waiters.load(std::memory_order_acquire) != 0)
+        {
+            std::this_thread::yield();
+        }
+
+        size_t restart_flows = 0;
+        bool restart = false;
+        {
+            std::lock_guard<std::mutex> lock(m_flows_mutex);
+
+            if(m_flows.isMigrating())
+            {
+                // Обход идёт только по текущей таблице: перенос доводится порциями
+                m_flows.advanceMigration(SNAPSHOT_CHUNK / FlowTable::GROUP_SIZE);
+                continue;
+            }
+            if(!started || m_flows.getLayoutVersion() != layout_version)
+            {
+                // Потоки переехали в другие слоты: обход начинается заново
+                layout_version = m_flows.getLayoutVersion();
+                position = 0;
+                started = true;
+                restart = true;
+                restart_flows = m_flows.size();
+            }
+
+            // Под блокировкой слоты только копируются в буфер порции, выделенный заранее
+            m_snapshot_chunk.clear();
+            position = m_flows.forEachFrom(position, SNAPSHOT_CHUNK,
+                                           [this](const FlowTuple& flow_tuple, const FlowStats& flow_stats)
+                                           {
+                                               m_snapshot_chunk.emplace_back(flow_tuple, flow_stats);
+                                           });
+            done = position == m_flows.capacity();
+        }
+
+        // Столбцы заполняются без блокировки: выделение памяти снимка и первое обращение
+        // к её страницам не задерживают поток захвата
+        if(restart)
+        {
+            flows.clear();
+            flows.reserve(restart_flows);
+        }
+        for(const auto& [flow_tuple, flow_stats] : m_snapshot_chunk)
+        {
+            flows.append(flow_tuple, flow_stats);
+        }
+    }
+
+    auto snapshot = std::make_shared<FlowSnapshot>(std::move(flows), ++m_snapshot_epoch);
+    std::shared_ptr<FlowSnapshot> previous;
+    {
+        std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+        previous = std::exchange(m_snapshot, snapshot);
+    }
+    // Новые ссылки на прежний снимок больше не выдаются: если читателей нет, его буфер свободен
+    if(previous.use_count() == 1)
+    {
+        m_snapshot_spare = std::move(previous->m_columns);
+    }
+    return snapshot;
+}
+
+std::shared_ptr<const FlowSnapshot> FlowTracker::getSnapshot() const
+{
+    std::lock_guard<std::mutex> lock(m_snapshot_mutex);
+    return m_snapshot;
+}
+
+std::map<FlowTuple, FlowStats> FlowTracker::getAllFlows()
+{
+    const std::shared_ptr<const FlowSnapshot> snapshot = publishSnapshot();
+    std::map<FlowTuple, FlowStats> flows;
+    for(size_t i = 0; i < snapshot->size(); ++i)
+    {
+        flows.emplace(snapshot->getFlowTuple(i), snapshot->getFlowStats(i));
+    }
+    return flows;
+}
+
+std::vector<RankedFlow> FlowTracker::getTopFlows(size_t count, uint64_t current_time)
+{
+    return publishSnapshot()->getTopFlows(count, current_time);
+}
+
+void FlowTracker::cleanupOldFlows(uint64_t timeout_seconds, uint64_t current_time)
+{
+    uint64_t timeout_us = timeout_seconds * 1000000;
+
+    const std::unique_lock<std::mutex> lock = lockFlows();
+
+    m_flows.eraseIf([this, current_time, timeout_us](const FlowTuple& flow_tuple, const FlowStats& flow_stats)
+    {
+        if(current_time <= flow_stats.getLastPacketTime() || current_time - flow_stats.getLastPacketTime() <= timeout_us)
+        {
+            return false;
+        }
+        retire(flow_tuple, flow_stats, FlowRetireReason::Idle);
+        return true;
+    });
 }
 
 size_t FlowTracker::getActiveFlowCount() const
 {
-    std::lock_guard<std::mutex> lock(m_flows_mutex);
+    const std::unique_lock<std::mutex> lock = lockFlows();
     return m_flows.size();
 }
+
+size_t FlowTracker::getMemoryUsage() const
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+    return m_flows.getMemoryUsage() + m_timer_wheel.getMemoryUsage() + (m_top_k ? m_top_k->getMemoryUsage() : 0);
+}
+
+PageType FlowTracker::getPageType() const
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+    return m_flows.getPageType();
+}
+
+int FlowTracker::getNumaNode() const
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+    return m_flows.getNumaNode();
+}
+
+size_t FlowTracker::getRestoredFlowCount() const
+{
+    const std::unique_lock<std::mutex> lock = lockFlows();
+    return m_flows.getRestoredFlows();
+}
+
+size_t FlowTracker::getMaxFlowsForMemory(size_t memory_bytes)
+{
+    // Таблица с пределом F растёт до ёмкости C >= 2F (рост удваивает, если потоков больше половины),
+    // при переносе живут обе таблицы; на поток в колесе не больше 4 таймеров (2 живых, чистка при удвоении)
+    auto cost = [](size_t capacity)
+    {
+        return 2 * FlowTable::getMemoryForCapacity(capacity) + capacity / 2 * 4 * sizeof(FlowTimer);
+    };
+
+    size_t capacity = FlowTable::GROUP_SIZE;
+    while(cost(capacity * 2) <= memory_bytes)
+    {
+        capacity *= 2;
+    }
+    return capacity / 2 - 1;
+}
+
+std::unique_lock<std::mutex> FlowTracker::lockFlows() const
+{
+    std::unique_lock<std::mutex> lock(m_flows_mutex, std::try_to_lock);
+    if(!lock.owns_lock())
+    {
+        // Только ожидание отмечается: свободная блокировка стоит столько же, сколько lock()
+        m_flows_waiters.fetch_add(1, std::memory_order_acq_rel);
+        lock.lock();
+        m_flows_waiters.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    return lock;
+}
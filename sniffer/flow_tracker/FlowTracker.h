@@ -1,21 +1,126 @@
 #ifndef FLOW_TRACKER_H
 #define FLOW_TRACKER_H
 
+#include "../packet_processor/CaptureConfig.h"
 #include "../packet_processor/PacketParser.h"
+#include "FlowSnapshot.h"
 #include "FlowStats.h"
+#include "FlowTable.h"
+#include "SpaceSaving.h"
+#include "TimerWheel.h"
+#include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Причина удаления потока из трекера
+ */
+enum class FlowRetireReason
+{
+    Closed, ///< Соединение завершено FIN/RST (после короткой задержки) или заменено новым SYN
+    Idle, ///< Поток простаивал дольше таймаута
+    Evicted ///< Поток вытеснен при достижении предела таблицы
+};
+
+/**
+ * @brief Обработчик итоговой статистики удаляемого потока
+ *
+ * Вызывается в потоке, удаляющем поток, под блокировкой трекера, поэтому должен быть коротким.
+ */
+using RetiredFlowHandler = std::function<void(const FlowTuple&, const FlowStats&, FlowRetireReason)>;
+
+/**
+ * @brief Снимок сводки самых объёмных потоков шарда
+ */
+struct HeavyHitterSummary
+{
+    std::vector<HeavyHitter> top; // Потоки по убыванию верхней оценки объёма
+    uint64_t threshold = 0; // Поток объёмом больше порога гарантированно есть в сводке
+    uint64_t total_bytes = 0; // Объём всего учтённого трафика шарда
+    size_t tracked = 0; // Занятые счётчики
+    size_t capacity = 0; // Количество счётчиков
+};
+
+/**
+ * @brief Статистика пакетов потока, накопленная вне трекера (кэш потока захвата)
+ */
+struct FlowDelta
+{
+    FlowTuple flow_tuple;
+    uint64_t key_hash; // FlowTable::hash(flow_tuple)
+    FlowStats flow_stats; // Статистика пакетов без SYN, FIN и RST
+    size_t position; // Применяется перед пакетом пачки с этим индексом
+};
 
 /**
  * @brief Класс для отслеживания TCP потоков
+ *
+ * Неактивные потоки удаляются по времени пакетов: при создании потоку ставится
+ * таймер простоя в TimerWheel. Сработавший таймер потока, получавшего пакеты,
+ * переставляется на время последнего пакета + таймаут (ленивое продление),
+ * поэтому обновление потока не трогает колесо.
+ *
+ * Поток с FIN или RST переходит в короткое ожидание: ему ставится таймер на
+ * время последнего пакета + LINGER_TIMEOUT, чтобы учесть завершающие ACK, после
+ * чего поток удаляется. SYN без ACK в завершённом потоке (повторное использование
+ * порта) сразу заменяет старую статистику новой. Итоговая статистика удаляемых
+ * потоков передаётся обработчику RetiredFlowHandler.
+ *
+ * При заданном пределе новый поток в заполненной таблице вытесняет худший из
+ * EVICTION_SAMPLES случайных потоков (приближённый LRU или наименьший объём, как
+ * в Redis): закрытые потоки вытесняются первыми. Колесо вычищается от таймеров
+ * удалённых потоков, когда в нём становится вчетверо больше таймеров, чем потоков
+ * (у живого потока не больше двух таймеров), поэтому память колеса тоже ограничена.
+ *
+ * Таблица потоков может храниться в файле (table_path): после перезапуска процесса
+ * трекер подключается к ней и ставит восстановленным потокам таймеры простоя.
+ *
+ * В приближённом режиме (enableApproxTopK()) точные потоки не хранятся: пакеты
+ * учитываются только сводкой SpaceSaving фиксированного размера, память и стоимость
+ * пакета не зависят от количества потоков.
+ *
+ * Читатели (вывод отчёта, внешние потребители) получают неизменяемый FlowSnapshot.
+ * publishSnapshot() копирует таблицу порциями по SNAPSHOT_CHUNK слотов, отпуская
+ * блокировку между порциями и уступая её каждому, кто ждёт (lockFlows()), поэтому
+ * updateFlow() ждёт не дольше одной порции. Под блокировкой слоты только копируются
+ * в буфер порции: столбцы снимка заполняются и выделяются без неё.
+ * Готовый снимок публикуется через std::shared_ptr; буфер снимка, который больше
+ * никто не читает, используется для следующей сборки (двойная буферизация).
  */
 class FlowTracker
 {
 public:
+    static constexpr uint64_t DEFAULT_IDLE_TIMEOUT = 60; // секунды
+    static constexpr uint64_t LINGER_TIMEOUT = 2; // секунды после FIN/RST
+    static constexpr size_t EVICTION_SAMPLES = 8; // Потоков в выборке кандидатов на вытеснение
+    static constexpr size_t MIN_TIMER_PURGE = 65536; // Таймеров в колесе, ниже которого чистка не выполняется
+    static constexpr size_t SNAPSHOT_CHUNK = 4096; // Слотов таблицы, копируемых в снимок за одну блокировку
+    static constexpr size_t PREFETCH_WINDOW = 32; // Пакетов пачки, слоты которых запрашиваются в кэш заранее
+
     /**
      * @brief Конструктор
+     * @param expected_flows Ожидаемое количество потоков (начальная ёмкость таблицы)
+     * @param idle_timeout_seconds Таймаут простоя потока в секундах
+     * @param max_flows Предел количества потоков (0 - без предела)
+     * @param eviction_policy Политика вытеснения при достижении предела
+     * @param huge_pages Большие страницы для таблицы потоков
+     * @param numa_node Узел NUMA таблицы потоков: узел CPU потока, который пишет в шард (-1 - по первой записи)
+     * @param table_path Файл таблицы потоков (пусто - таблица в памяти процесса); потоки из существующего
+     *                   файла восстанавливаются вместе с таймерами простоя
+     * @param shard_count Количество шардов хранилища таблиц (записывается в файл таблицы)
+     * @throw std::runtime_error если файл таблицы занят, повреждён, другой версии
+     *        или записан для другого количества шардов
      */
-    FlowTracker();
+    explicit FlowTracker(size_t expected_flows = 0, uint64_t idle_timeout_seconds = DEFAULT_IDLE_TIMEOUT,
+                         size_t max_flows = 0, EvictionPolicy eviction_policy = EvictionPolicy::Lru,
+                         HugePageMode huge_pages = HugePageMode::Off, int numa_node = -1,
+                         const std::string& table_path = "", uint32_t shard_count = 0);
 
     /**
      * @brief Деструктор
@@ -28,28 +133,114 @@ public:
      * @param packet_size Размер пакета на уровне Ethernet
      * @param payload_size Размер полезной нагрузки TCP
      * @param timestamp Временная метка пакета
+     * @param tcp_flags Флаги TCP пакета (TCP_FLAG_*)
      */
     void updateFlow(const FlowTuple& flow_tuple, uint32_t packet_size,
-                    uint32_t payload_size, uint64_t timestamp);
+                    uint32_t payload_size, uint64_t timestamp, uint8_t tcp_flags = 0);
+
+    /**
+     * @brief Обновление статистики потоков пачкой пакетов
+     *
+     * Блокировка берётся один раз на пачку. Пакеты обрабатываются окнами по PREFETCH_WINDOW:
+     * сначала вычисляются хеши и запрашиваются управляющие байты групп, затем слоты,
+     * и только после этого применяются обновления, так что промахи кэша и TLB
+     * соседних пакетов перекрываются. Результат совпадает с вызовом updateFlow()
+     * для каждого пакета по порядку.
+     *
+     * Отложенная статистика (FlowCache) добавляется к потокам в том же проходе: дельта
+     * с position = i применяется перед packets[i], с position = packets.size() - после
+     * всех пакетов. Дельты упорядочены по position. Поток, удалённый за время накопления
+     * дельты, создаётся заново.
+     *
+     * @param packets Разобранные пакеты
+     * @param deltas Отложенная статистика потоков (только в точном режиме)
+     */
+    void updateFlows(std::span<const PacketInfo> packets, std::span<const FlowDelta> deltas = {});
+
+    /**
+     * @brief Установка обработчика итоговой статистики удаляемых потоков
+     * @param handler Обработчик (пустой - итоги не передаются)
+     */
+    void setRetiredFlowHandler(RetiredFlowHandler handler);
+
+    /**
+     * @brief Переключение в приближённый режим сводки самых объёмных потоков
+     *
+     * Вызывается до начала захвата. Точная таблица потоков после этого не заполняется.
+     *
+     * @param counters Количество счётчиков Space-Saving
+     * @param sketch_width Ширина Count-Min sketch для начальных оценок (0 - без sketch)
+     */
+    void enableApproxTopK(size_t counters, size_t sketch_width = 0);
+
+    /**
+     * @brief Проверка приближённого режима
+     * @return true если потоки учитываются сводкой Space-Saving
+     */
+    [[nodiscard]] bool isApproximate() const { return m_top_k != nullptr; }
+
+    /**
+     * @brief Снимок сводки самых объёмных потоков (только в приближённом режиме)
+     * @param count Количество потоков
+     * @return Самые объёмные потоки с границами погрешности
+     */
+    [[nodiscard]] HeavyHitterSummary getHeavyHitters(size_t count) const;
 
     /**
      * @brief Получение статистики потока
      * @param flow_tuple 4-tuple потока
-     * @return Указатель на статистику потока или nullptr если поток не найден
+     * @return Копия статистики потока или std::nullopt если поток не найден
+     */
+    [[nodiscard]] std::optional<FlowStats> getFlowStats(const FlowTuple& flow_tuple) const;
+
+    /**
+     * @brief Сборка и публикация нового снимка потоков
+     *
+     * Таблица копируется порциями по SNAPSHOT_CHUNK слотов с короткой блокировкой на
+     * каждую. Если таблица перестраивается во время сборки, обход начинается заново;
+     * незавершённый перенос доводится порциями того же размера.
+     *
+     * @return Опубликованный снимок
+     */
+    std::shared_ptr<const FlowSnapshot> publishSnapshot();
+
+    /**
+     * @brief Последний опубликованный снимок (блокировка таблицы не берётся)
+     * @return Снимок (пустой с эпохой 0 до первой публикации)
      */
-    const FlowStats* getFlowStats(const FlowTuple& flow_tuple) const;
+    [[nodiscard]] std::shared_ptr<const FlowSnapshot> getSnapshot() const;
 
     /**
      * @brief Получение всех активных потоков
-     * @return Карта всех потоков с их статистикой
+     * @return Карта всех потоков с их статистикой (из нового снимка)
+     */
+    std::map<FlowTuple, FlowStats> getAllFlows();
+
+    /**
+     * @brief Получение самых быстрых потоков шарда
+     * @param count Количество потоков
+     * @param current_time Момент расчёта скорости в микросекундах
+     * @return Потоки нового снимка по убыванию средней скорости
      */
-    std::map<FlowTuple, FlowStats> getAllFlows() const;
+    [[nodiscard]] std::vector<RankedFlow> getTopFlows(size_t count, uint64_t current_time);
 
     /**
-     * @brief Очистка устаревших потоков
+     * @brief Удаление потоков, простаивающих дольше таймаута, по колесу таймеров
+     *
+     * Обрабатываются только таймеры, срок которых наступил к моменту now.
+     * Более раннее время, чем уже достигнутое, ничего не делает.
+     *
+     * @param now Текущее время в микросекундах (время последнего пакета или время StreamClock при простое)
+     * @return Количество удалённых потоков
+     */
+    size_t expireFlows(uint64_t now);
+
+    /**
+     * @brief Полная очистка устаревших потоков (обход всей таблицы)
      * @param timeout_seconds Таймаут в секундах для удаления неактивных потоков
+     * @param current_time Текущее время в микросекундах (время пакетов, как у expireFlows())
      */
-    void cleanupOldFlows(uint64_t timeout_seconds);
+    void cleanupOldFlows(uint64_t timeout_seconds, uint64_t current_time);
 
     /**
      * @brief Получение количества активных потоков
@@ -57,9 +248,107 @@ public:
      */
     size_t getActiveFlowCount() const;
 
+    /**
+     * @brief Объём памяти таблицы потоков и колеса таймеров
+     * @return Размер в байтах
+     */
+    size_t getMemoryUsage() const;
+
+    /**
+     * @brief Тип страниц текущей таблицы потоков
+     * @return Тип страниц
+     */
+    PageType getPageType() const;
+
+    /**
+     * @brief Узел NUMA таблицы потоков
+     * @return Номер узла (-1 - узел не задан или ядро не приняло политику)
+     */
+    int getNumaNode() const;
+
+    /**
+     * @brief Количество потоков, восстановленных из файла таблицы при создании трекера
+     * @return Количество потоков (0 - новая таблица или таблица в памяти)
+     */
+    size_t getRestoredFlowCount() const;
+
+    /**
+     * @brief Предел количества потоков, при котором таблица и колесо укладываются в бюджет памяти
+     *
+     * Учитывает рост таблицы до удвоенной ёмкости при заполнении надгробиями, одновременное
+     * существование старой и новой таблиц во время переноса и таймеры удалённых потоков.
+     *
+     * @param memory_bytes Бюджет памяти в байтах
+     * @return Предел количества потоков
+     */
+    static size_t getMaxFlowsForMemory(size_t memory_bytes);
+
 private:
+    /**
+     * @brief Учёт пакета точной таблицей под блокировкой
+     * @param key_hash FlowTable::hash(flow_tuple)
+     */
+    void applyPacket(const FlowTuple& flow_tuple, uint32_t packet_size, uint32_t payload_size,
+                     uint64_t timestamp, uint8_t tcp_flags, uint64_t key_hash);
+
+    /**
+     * @brief Добавление отложенной статистики к потоку под блокировкой
+     */
+    void applyDelta(const FlowDelta& delta);
+
+    /**
+     * @brief Освобождение места под новый поток при заполненной таблице
+     */
+    void makeRoom(const FlowTuple& flow_tuple, uint64_t key_hash);
+
+    /**
+     * @brief Постановка таймера простоя новому потоку
+     */
+    void startIdleTimer(const FlowTuple& flow_tuple, uint64_t first_packet_time, uint64_t last_packet_time);
+
+    /**
+     * @brief Вытеснение одного потока по политике m_eviction_policy
+     */
+    void evictFlow();
+
+    /**
+     * @brief Удаление из колеса таймеров удалённых и пересозданных потоков
+     */
+    void purgeTimers();
+
+    /**
+     * @brief Захват блокировки таблицы с отметкой ожидания для сборщика снимка
+     *
+     * Занятая блокировка ожидается с увеличенным m_flows_waiters: publishSnapshot()
+     * не берёт следующую порцию, пока ожидающие не получили блокировку.
+     *
+     * @return Захваченная блокировка m_flows_mutex
+     */
+    [[nodiscard]] std::unique_lock<std::mutex> lockFlows() const;
+
+    /**
+     * @brief Передача итоговой статистики потока обработчику
+     */
+    void retire(const FlowTuple& flow_tuple, const FlowStats& flow_stats, FlowRetireReason reason) const;
+
     mutable std::mutex m_flows_mutex;
-    std::map<FlowTuple, FlowStats> m_flows;
+    mutable std::atomic<uint32_t> m_flows_waiters; // Потоки, ожидающие m_flows_mutex (кроме сборщика снимка)
+    FlowTable m_flows;
+    TimerWheel m_timer_wheel;
+    std::vector<FlowTimer> m_due_timers; // Сработавшие таймеры (ёмкость переиспользуется)
+    uint64_t m_idle_timeout; // Таймаут простоя в микросекундах
+    uint64_t m_linger_timeout; // Ожидание после FIN/RST в микросекундах
+    size_t m_max_flows; // Предел количества потоков (0 - без предела)
+    EvictionPolicy m_eviction_policy;
+    RetiredFlowHandler m_retired_flow_handler;
+    std::unique_ptr<SpaceSaving> m_top_k; // Сводка приближённого режима (nullptr - точный режим)
+
+    std::mutex m_publish_mutex; // Одна сборка снимка за раз
+    FlowColumns m_snapshot_spare; // Столбцы для следующей сборки
+    std::vector<std::pair<FlowTuple, FlowStats>> m_snapshot_chunk; // Слоты порции, скопированные под блокировкой
+    uint64_t m_snapshot_epoch; // Номер последней публикации
+    mutable std::mutex m_snapshot_mutex; // Защищает только указатель m_snapshot
+    std::shared_ptr<FlowSnapshot> m_snapshot;
 };
 
 #endif // FLOW_TRACKER_H
@@ -0,0 +1,173 @@
+#include "SpaceSaving.h"
+#include "FlowTable.h"
+#include <algorithm>
+#include <bit>
+
+SpaceSaving::SpaceSaving(size_t capacity, size_t sketch_width)
+    : m_capacity(std::max<size_t>(capacity, 1))
+      , m_index(std::bit_ceil(2 * m_capacity), EMPTY_SLOT)
+      , m_index_mask(m_index.size() - 1)
+      , m_sketch(sketch_width != 0 ? std::make_unique<CountMinSketch>(sketch_width) : nullptr)
+      , m_evicted_bytes(0)
+      , m_total_bytes(0)
+{
+    m_entries.reserve(m_capacity);
+}
+
+void SpaceSaving::update(const FlowTuple& flow_tuple, uint32_t packet_size, uint32_t payload_size,
+                         uint64_t timestamp)
+{
+    m_total_bytes += payload_size;
+    // Sketch учитывает весь трафик, включая потоки вне сводки
+    const uint64_t estimate = m_sketch ? m_sketch->add(flow_tuple, payload_size) : 0;
+
+    const uint32_t position = find(flow_tuple);
+    if(position != EMPTY_SLOT)
+    {
+        HeavyHitter& entry = m_entries[position];
+        entry.bytes += payload_size;
+        ++entry.packet_count;
+        entry.total_packet_size += packet_size;
+        entry.last_packet_time = timestamp;
+        siftDown(position);
+        return;
+    }
+    if(payload_size == 0)
+    {
+        return;
+    }
+
+    if(m_entries.size() < m_capacity)
+    {
+        // Пока сводка не заполнена, каждый поток с нагрузкой отслеживается с первого байта
+        m_entries.push_back(HeavyHitter{flow_tuple, payload_size, 0, 1, packet_size, timestamp, timestamp, 0});
+        indexInsert(flow_tuple, static_cast<uint32_t>(m_entries.size() - 1));
+        siftUp(m_entries.size() - 1);
+        return;
+    }
+
+    // Замена потока с наименьшим счётчиком: до этого пакета новый поток набрал не больше M
+    HeavyHitter& root = m_entries.front();
+    m_evicted_bytes = std::max(m_evicted_bytes, root.bytes);
+    uint64_t bytes = m_evicted_bytes + payload_size;
+    if(m_sketch)
+    {
+        bytes = std::min(bytes, estimate);
+    }
+    indexErase(root.index_slot);
+    root = HeavyHitter{flow_tuple, bytes, bytes - payload_size, 1, packet_size, timestamp, timestamp, 0};
+    indexInsert(flow_tuple, 0);
+    siftDown(0);
+}
+
+std::vector<HeavyHitter> SpaceSaving::getTop(size_t count) const
+{
+    std::vector<HeavyHitter> top(m_entries);
+    count = std::min(count, top.size());
+    std::partial_sort(top.begin(), top.begin() + static_cast<ptrdiff_t>(count), top.end(),
+                      [](const HeavyHitter& a, const HeavyHitter& b)
+                      {
+                          return a.bytes > b.bytes;
+                      });
+    top.resize(count);
+    return top;
+}
+
+size_t SpaceSaving::getMemoryUsage() const
+{
+    return m_capacity * sizeof(HeavyHitter) + m_index.size() * sizeof(uint32_t) +
+        (m_sketch ? m_sketch->getMemoryUsage() : 0);
+}
+
+size_t SpaceSaving::homeSlot(const FlowTuple& flow_tuple) const
+{
+    return FlowTable::hash(flow_tuple) & m_index_mask;
+}
+
+uint32_t SpaceSaving::find(const FlowTuple& flow_tuple) const
+{
+    for(size_t slot = homeSlot(flow_tuple); m_index[slot] != EMPTY_SLOT; slot = (slot + 1) & m_index_mask)
+    {
+        if(m_entries[m_index[slot]].flow_tuple == flow_tuple)
+        {
+            return m_index[slot];
+        }
+    }
+    return EMPTY_SLOT;
+}
+
+void SpaceSaving::indexInsert(const FlowTuple& flow_tuple, uint32_t position)
+{
+    size_t slot = homeSlot(flow_tuple);
+    while(m_index[slot] != EMPTY_SLOT)
+    {
+        slot = (slot + 1) & m_index_mask;
+    }
+    m_index[slot] = position;
+    m_entries[position].index_slot = static_cast<uint32_t>(slot);
+}
+
+void SpaceSaving::indexErase(size_t slot)
+{
+    // Индекс заполнен не более чем наполовину, поэтому цепочки короткие и надгробия не нужны
+    size_t hole = slot;
+    m_index[hole] = EMPTY_SLOT;
+    for(size_t next = (hole + 1) & m_index_mask; m_index[next] != EMPTY_SLOT; next = (next + 1) & m_index_mask)
+    {
+        // Запись переносится в дыру, если дыра лежит на её пути пробирования
+        const size_t home = homeSlot(m_entries[m_index[next]].flow_tuple);
+        if(((next - home) & m_index_mask) >= ((next - hole) & m_index_mask))
+        {
+            m_index[hole] = m_index[next];
+            m_entries[m_index[hole]].index_slot = static_cast<uint32_t>(hole);
+            m_index[next] = EMPTY_SLOT;
+            hole = next;
+        }
+    }
+}
+
+void SpaceSaving::swapEntries(size_t a, size_t b)
+{
+    std::swap(m_entries[a], m_entries[b]);
+    m_index[m_entries[a].index_slot] = static_cast<uint32_t>(a);
+    m_index[m_entries[b].index_slot] = static_cast<uint32_t>(b);
+}
+
+void SpaceSaving::siftDown(size_t position)
+{
+    const size_t size = m_entries.size();
+    for(;;)
+    {
+        size_t smallest = position;
+        const size_t left = 2 * position + 1;
+        const size_t right = left + 1;
+        if(left < size && m_entries[left].bytes < m_entries[smallest].bytes)
+        {
+            smallest = left;
+        }
+        if(right < size && m_entries[right].bytes < m_entries[smallest].bytes)
+        {
+            smallest = right;
+        }
+        if(smallest == position)
+        {
+            return;
+        }
+        swapEntries(position, smallest);
+        position = smallest;
+    }
+}
+
+void SpaceSaving::siftUp(size_t position)
+{
+    while(position > 0)
+    {
+        const size_t parent = (position - 1) / 2;
+        if(m_entries[parent].bytes <= m_entries[position].bytes)
+        {
+            return;
+        }
+        swapEntries(position, parent);
+        position = parent;
+    }
+}
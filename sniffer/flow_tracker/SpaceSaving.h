@@ -0,0 +1,153 @@
+#ifndef SPACE_SAVING_H
+#define SPACE_SAVING_H
+
+#include "../packet_processor/PacketParser.h"
+#include "CountMinSketch.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Поток сводки Space-Saving с границами погрешности
+ *
+ * Истинный объём потока лежит в [bytes - error, bytes].
+ */
+struct HeavyHitter
+{
+    FlowTuple flow_tuple;
+    uint64_t bytes; // Верхняя оценка объёма полезной нагрузки
+    uint64_t error; // Наибольшая возможная переоценка bytes
+    uint64_t packet_count; // Пакеты с момента попадания в сводку
+    uint64_t total_packet_size; // Их суммарный размер на уровне Ethernet
+    uint64_t first_packet_time; // Время попадания в сводку
+    uint64_t last_packet_time; // Время последнего пакета
+    uint32_t index_slot; // Слот индекса, указывающий на запись (служебное поле)
+};
+
+/**
+ * @brief Сводка Space-Saving: самые объёмные потоки в фиксированной памяти
+ *
+ * Хранит capacity счётчиков в min-куче по объёму и индекс 4-tuple -> позиция
+ * (открытая адресация, линейное пробирование). Отслеживаемый поток увеличивает свой
+ * счётчик; новый поток заменяет поток с наименьшим счётчиком и наследует наибольший
+ * из вытесненных счётчиков M как погрешность (Metwally et al., 2005). Истинный объём
+ * любого неотслеживаемого потока не больше M, поэтому поток с объёмом больше
+ * getMinBytes() = M гарантированно присутствует в сводке.
+ *
+ * С Count-Min sketch новый поток получает min(M + объём, оценка sketch): обе
+ * величины не меньше истинного объёма, поэтому гарантии сохраняются, а погрешность
+ * потоков, попавших в сводку поздно, уменьшается.
+ *
+ * Стоимость пакета - O(log capacity), память не зависит от количества потоков.
+ */
+class SpaceSaving
+{
+public:
+    /**
+     * @brief Конструктор
+     * @param capacity Количество счётчиков
+     * @param sketch_width Ширина Count-Min sketch (0 - без sketch)
+     */
+    explicit SpaceSaving(size_t capacity, size_t sketch_width = 0);
+
+    /**
+     * @brief Учёт пакета потока
+     *
+     * Пакет без полезной нагрузки не вытесняет другие потоки: на объёмы он не влияет.
+     *
+     * @param flow_tuple 4-tuple потока
+     * @param packet_size Размер пакета на уровне Ethernet
+     * @param payload_size Размер полезной нагрузки TCP
+     * @param timestamp Временная метка пакета
+     */
+    void update(const FlowTuple& flow_tuple, uint32_t packet_size, uint32_t payload_size, uint64_t timestamp);
+
+    /**
+     * @brief Самые объёмные потоки
+     * @param count Количество потоков
+     * @return Потоки по убыванию верхней оценки объёма
+     */
+    [[nodiscard]] std::vector<HeavyHitter> getTop(size_t count) const;
+
+    /**
+     * @brief Порог гарантированного присутствия
+     * @return Наибольший вытесненный счётчик (0 - вытеснений не было, все потоки отслеживаются точно)
+     */
+    [[nodiscard]] uint64_t getMinBytes() const { return m_evicted_bytes; }
+
+    /**
+     * @brief Суммарный объём всех учтённых пакетов
+     * @return Объём полезной нагрузки в байтах
+     */
+    [[nodiscard]] uint64_t getTotalBytes() const { return m_total_bytes; }
+
+    /**
+     * @brief Количество отслеживаемых потоков
+     * @return Занятые счётчики
+     */
+    [[nodiscard]] size_t size() const { return m_entries.size(); }
+
+    /**
+     * @brief Количество счётчиков
+     * @return Ёмкость сводки
+     */
+    [[nodiscard]] size_t capacity() const { return m_capacity; }
+
+    /**
+     * @brief Объём памяти сводки, индекса и sketch
+     * @return Размер в байтах
+     */
+    [[nodiscard]] size_t getMemoryUsage() const;
+
+private:
+    static constexpr uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+    /**
+     * @brief Позиция потока в куче
+     * @return Позиция или EMPTY_SLOT
+     */
+    [[nodiscard]] uint32_t find(const FlowTuple& flow_tuple) const;
+
+    /**
+     * @brief Первый слот индекса на пути пробирования потока
+     */
+    [[nodiscard]] size_t homeSlot(const FlowTuple& flow_tuple) const;
+
+    /**
+     * @brief Добавление позиции в индекс
+     */
+    void indexInsert(const FlowTuple& flow_tuple, uint32_t position);
+
+    /**
+     * @brief Удаление слота индекса со сдвигом следующих записей цепочки назад
+     */
+    void indexErase(size_t slot);
+
+    /**
+     * @brief Восстановление кучи после увеличения счётчика
+     * @param position Позиция увеличенной записи
+     */
+    void siftDown(size_t position);
+
+    /**
+     * @brief Восстановление кучи после добавления записи
+     * @param position Позиция новой записи
+     */
+    void siftUp(size_t position);
+
+    /**
+     * @brief Обмен записей кучи с обновлением индекса
+     */
+    void swapEntries(size_t a, size_t b);
+
+    size_t m_capacity;
+    std::vector<HeavyHitter> m_entries; // Min-куча по bytes
+    std::vector<uint32_t> m_index; // Позиции в куче, EMPTY_SLOT - пусто
+    size_t m_index_mask;
+    std::unique_ptr<CountMinSketch> m_sketch; // nullptr - без sketch
+    uint64_t m_evicted_bytes; // Наибольший вытесненный счётчик M
+    uint64_t m_total_bytes;
+};
+
+#endif // SPACE_SAVING_H
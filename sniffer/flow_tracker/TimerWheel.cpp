@@ -0,0 +1,140 @@
+#include "TimerWheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel()
+    : m_chunk_count(0)
+      , m_free_chunks(nullptr)
+      , m_current_tick(0)
+      , m_size(0)
+      , m_started(false)
+{
+}
+
+void TimerWheel::schedule(const FlowTuple& flow_tuple, uint64_t first_packet_time, uint64_t deadline)
+{
+    if(!m_started)
+    {
+        m_current_tick = first_packet_time / TICK_US;
+        m_started = true;
+    }
+    // Текущий такт уже обработан, поэтому ранний срок переносится на следующий
+    place(FlowTimer{flow_tuple, first_packet_time, deadline}, m_current_tick + 1);
+    ++m_size;
+}
+
+void TimerWheel::place(const FlowTimer& timer, uint64_t min_tick)
+{
+    // Округление вверх: таймер не срабатывает раньше срока
+    uint64_t tick = std::max((timer.deadline + TICK_US - 1) / TICK_US, min_tick);
+
+    const uint64_t delta = tick - m_current_tick;
+    if(delta < LEVEL0_SIZE)
+    {
+        push(m_level0[tick & (LEVEL0_SIZE - 1)], timer);
+        return;
+    }
+    for(unsigned level = 1; level < LEVELS; ++level)
+    {
+        const unsigned shift = shiftOf(level);
+        if(delta < (1ULL << (shift + LEVEL_BITS)) || level == LEVELS - 1)
+        {
+            // Срок за пределами колеса ограничивается последним уровнем и уточняется при разнесении
+            const uint64_t limit = m_current_tick + (1ULL << (shift + LEVEL_BITS)) - 1;
+            push(m_levels[level - 1][(std::min(tick, limit) >> shift) & (LEVEL_SIZE - 1)], timer);
+            return;
+        }
+    }
+}
+
+void TimerWheel::push(Slot& slot, const FlowTimer& timer)
+{
+    if(slot.head == nullptr || slot.head->count == CHUNK_SIZE)
+    {
+        Chunk* chunk = m_free_chunks;
+        if(chunk != nullptr)
+        {
+            m_free_chunks = chunk->next;
+        }
+        else
+        {
+            // Вектор выделений в CHUNKS_PER_ALLOCATION раз короче вектора блоков, и его рост не заметен
+            if(m_chunk_count % CHUNKS_PER_ALLOCATION == 0)
+            {
+                m_allocations.push_back(std::make_unique_for_overwrite<Chunk[]>(CHUNKS_PER_ALLOCATION));
+            }
+            chunk = &m_allocations.back()[m_chunk_count++ % CHUNKS_PER_ALLOCATION];
+        }
+        chunk->count = 0;
+        chunk->next = slot.head;
+        slot.head = chunk;
+    }
+    slot.head->timers[slot.head->count++] = timer;
+}
+
+TimerWheel::Chunk* TimerWheel::detach(Slot& slot)
+{
+    Chunk* head = slot.head;
+    slot.head = nullptr;
+    return head;
+}
+
+void TimerWheel::release(Chunk* chunk)
+{
+    chunk->next = m_free_chunks;
+    m_free_chunks = chunk;
+}
+
+size_t TimerWheel::cascade(unsigned level)
+{
+    const size_t index = (m_current_tick >> shiftOf(level)) & (LEVEL_SIZE - 1);
+    // Разнесение идёт до обработки ячейки текущего такта, срок в нём ещё успевает сработать
+    for(Chunk* chunk = detach(m_levels[level - 1][index]); chunk != nullptr;)
+    {
+        for(size_t i = 0; i < chunk->count; ++i)
+        {
+            place(chunk->timers[i], m_current_tick);
+        }
+        Chunk* next = chunk->next;
+        release(chunk);
+        chunk = next;
+    }
+    return index;
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<FlowTimer>& due)
+{
+    const uint64_t target_tick = now / TICK_US;
+    if(!m_started)
+    {
+        m_current_tick = target_tick;
+        m_started = true;
+        return;
+    }
+
+    while(m_current_tick < target_tick)
+    {
+        if(m_size == 0)
+        {
+            // Пустое колесо переносится сразу, без обхода тактов
+            m_current_tick = target_tick;
+            return;
+        }
+
+        ++m_current_tick;
+        if((m_current_tick & (LEVEL0_SIZE - 1)) == 0)
+        {
+            for(unsigned level = 1; level < LEVELS && cascade(level) == 0; ++level)
+            {
+            }
+        }
+
+        for(Chunk* chunk = detach(m_level0[m_current_tick & (LEVEL0_SIZE - 1)]); chunk != nullptr;)
+        {
+            m_size -= chunk->count;
+            due.insert(due.end(), chunk->timers.begin(), chunk->timers.begin() + static_cast<ptrdiff_t>(chunk->count));
+            Chunk* next = chunk->next;
+            release(chunk);
+            chunk = next;
+        }
+    }
+}
@@ -0,0 +1,204 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "../packet_processor/PacketParser.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Таймер простоя потока
+ */
+struct FlowTimer
+{
+    FlowTuple flow_tuple; // Поток
+    uint64_t first_packet_time; // Время первого пакета: отличает поток от пересозданного с тем же 4-tuple
+    uint64_t deadline; // Момент срабатывания в микросекундах
+};
+
+/**
+ * @brief Иерархическое колесо таймеров простоя потоков
+ *
+ * Время делится на такты по TICK_US. Уровень 0 содержит 256 ячеек по одному такту,
+ * уровни 1-3 - по 64 ячейки, каждая из которых покрывает весь предыдущий уровень
+ * (25.6 с, 27 мин, 29 ч, 77 суток). При переходе через границу уровня ячейка старшего
+ * уровня разносится по младшим, поэтому продвижение на такт касается только
+ * таймеров, срок которых наступил. Время задаётся вызывающим (время пакетов),
+ * системные часы не читаются.
+ *
+ * Ячейка - список блоков по CHUNK_SIZE таймеров из общего пула: постановка таймера
+ * никогда не копирует содержимое ячейки (в отличие от роста std::vector), поэтому
+ * всплеск новых потоков в одном такте не даёт пауз. Пул выделяется кусками по
+ * CHUNKS_PER_ALLOCATION блоков и тоже растёт без копирования.
+ */
+class TimerWheel
+{
+public:
+    static constexpr uint64_t TICK_US = 100000; // Длительность такта (100 мс)
+    static constexpr size_t CHUNK_SIZE = 64; // Таймеров в блоке ячейки
+    static constexpr size_t CHUNKS_PER_ALLOCATION = 64; // Блоков в одном выделении пула
+
+    /**
+     * @brief Конструктор
+     */
+    TimerWheel();
+
+    /**
+     * @brief Постановка таймера
+     *
+     * Первый таймер задаёт начальный момент колеса (first_packet_time).
+     * Срок в прошлом срабатывает на следующем такте.
+     *
+     * @param flow_tuple 4-tuple потока
+     * @param first_packet_time Время первого пакета потока в микросекундах
+     * @param deadline Момент срабатывания в микросекундах
+     */
+    void schedule(const FlowTuple& flow_tuple, uint64_t first_packet_time, uint64_t deadline);
+
+    /**
+     * @brief Продвижение колеса до момента now
+     * @param now Текущее время в микросекундах (более раннее время игнорируется)
+     * @param due Сюда добавляются сработавшие таймеры
+     */
+    void advance(uint64_t now, std::vector<FlowTimer>& due);
+
+    /**
+     * @brief Удаление таймеров, удовлетворяющих условию (обход всего колеса)
+     *
+     * Оставшиеся таймеры сохраняют свои ячейки, опустевшие блоки возвращаются в пул.
+     *
+     * @param predicate Условие вида bool(const FlowTimer&)
+     * @return Количество удалённых таймеров
+     */
+    template<typename Predicate>
+    size_t removeIf(Predicate predicate)
+    {
+        size_t removed = 0;
+        auto filter = [this, &predicate, &removed](Slot& slot)
+        {
+            for(Chunk* chunk = detach(slot); chunk != nullptr;)
+            {
+                for(size_t i = 0; i < chunk->count; ++i)
+                {
+                    if(predicate(chunk->timers[i]))
+                    {
+                        ++removed;
+                    }
+                    else
+                    {
+                        push(slot, chunk->timers[i]);
+                    }
+                }
+                Chunk* next = chunk->next;
+                release(chunk);
+                chunk = next;
+            }
+        };
+        for(Slot& slot : m_level0)
+        {
+            filter(slot);
+        }
+        for(auto& level : m_levels)
+        {
+            for(Slot& slot : level)
+            {
+                filter(slot);
+            }
+        }
+        m_size -= removed;
+        return removed;
+    }
+
+    /**
+     * @brief Текущее время колеса
+     * @return Начало текущего такта в микросекундах
+     */
+    [[nodiscard]] uint64_t getCurrentTime() const { return m_current_tick * TICK_US; }
+
+    /**
+     * @brief Количество поставленных таймеров
+     * @return Количество таймеров во всех уровнях
+     */
+    [[nodiscard]] size_t size() const { return m_size; }
+
+    /**
+     * @brief Объём памяти пула блоков
+     * @return Размер всех выделенных блоков в байтах (блоки не освобождаются, а переиспользуются)
+     */
+    [[nodiscard]] size_t getMemoryUsage() const { return m_chunk_count * sizeof(Chunk); }
+
+private:
+    static constexpr unsigned LEVEL0_BITS = 8;
+    static constexpr unsigned LEVEL_BITS = 6;
+    static constexpr unsigned LEVELS = 4;
+    static constexpr size_t LEVEL0_SIZE = 1u << LEVEL0_BITS;
+    static constexpr size_t LEVEL_SIZE = 1u << LEVEL_BITS;
+
+    /**
+     * @brief Блок таймеров ячейки
+     *
+     * Поля задаются при выдаче блока из пула: выделение пула не касается его страниц.
+     */
+    struct Chunk
+    {
+        std::array<FlowTimer, CHUNK_SIZE> timers;
+        size_t count;
+        Chunk* next;
+    };
+
+    /**
+     * @brief Ячейка колеса: односвязный список блоков (заполняется только головной)
+     */
+    struct Slot
+    {
+        Chunk* head = nullptr;
+    };
+
+    /**
+     * @brief Добавление таймера в ячейку
+     */
+    void push(Slot& slot, const FlowTimer& timer);
+
+    /**
+     * @brief Извлечение списка блоков ячейки
+     * @return Голова списка (ячейка становится пустой)
+     */
+    static Chunk* detach(Slot& slot);
+
+    /**
+     * @brief Возврат блока в пул
+     */
+    void release(Chunk* chunk);
+
+    /**
+     * @brief Размещение таймера в ячейке по его сроку относительно текущего такта
+     * @param timer Таймер
+     * @param min_tick Самый ранний допустимый такт срабатывания
+     */
+    void place(const FlowTimer& timer, uint64_t min_tick);
+
+    /**
+     * @brief Разнесение ячейки старшего уровня по младшим
+     * @param level Уровень (1-3)
+     * @return Индекс разнесённой ячейки (0 - уровень завершил оборот)
+     */
+    size_t cascade(unsigned level);
+
+    /**
+     * @brief Сдвиг старшего уровня в такте
+     */
+    static constexpr unsigned shiftOf(unsigned level) { return LEVEL0_BITS + (level - 1) * LEVEL_BITS; }
+
+    std::array<Slot, LEVEL0_SIZE> m_level0;
+    std::array<std::array<Slot, LEVEL_SIZE>, LEVELS - 1> m_levels;
+    std::vector<std::unique_ptr<Chunk[]>> m_allocations; // Выделения пула по CHUNKS_PER_ALLOCATION блоков
+    size_t m_chunk_count; // Выданные из выделений блоки
+    Chunk* m_free_chunks; // Список свободных блоков
+    uint64_t m_current_tick; // Текущий такт
+    size_t m_size; // Количество таймеров
+    bool m_started; // Начальный момент задан
+};
+
+#endif // TIMER_WHEEL_H
@@ -1,19 +1,27 @@
 // main.cpp — приложение для анализа сетевого трафика
 
 #include "packet_processor/PacketProcessor.h"
+#include "packet_processor/CpuAffinity.h"
 #include "flow_tracker/FlowTracker.h"
 #include "statistics/StatisticsManager.h"
 #include "logging/LogManager.h"
+#include <algorithm>
+#include <bit>
 #include <iostream>
+#include <iomanip>
 #include <string>
+#include <limits>
 #include <csignal>
 #include <chrono>
+#include <filesystem>
 #include <thread>
 #include <memory>
+#include <vector>
+#include <atomic>
+#include <unistd.h>
 
-// Глобальные переменные для корректного завершения
-static bool g_running = true;
-static std::unique_ptr<PacketProcessor> g_packet_processor = nullptr;
+// Глобальный флаг для корректного завершения; остановка потоков захвата выполняется в runSniffer()
+static std::atomic<bool> g_running = true;
 
 /**
  * @brief Обработчик сигнала для корректного завершения
@@ -22,12 +30,33 @@ void signalHandler(int signal)
 {
     if(signal == SIGINT || signal == SIGTERM)
     {
-        std::cout << "\n[info] Получен сигнал завершения. Завершение работы...\n";
         g_running = false;
-        if(g_packet_processor)
+    }
+}
+
+/**
+ * @brief Разбор беззнакового целого аргумента
+ * @param text Текст аргумента
+ * @param value Результат разбора
+ * @return true если аргумент является корректным числом
+ */
+template <typename T>
+bool parseUnsigned(const std::string& text, T& value)
+{
+    try
+    {
+        size_t pos = 0;
+        const unsigned long long parsed = std::stoull(text, &pos);
+        if(pos != text.size() || text.front() == '-' || parsed > std::numeric_limits<T>::max())
         {
-            g_packet_processor->stop();
+            return false;
         }
+        value = static_cast<T>(parsed);
+        return true;
+    }
+    catch(const std::exception&)
+    {
+        return false;
     }
 }
 
@@ -35,14 +64,14 @@ void signalHandler(int signal)
  * @brief Разбор аргументов командной строки
  * @param argc Количество аргументов
  * @param argv Массив аргументов
- * @param interface Интерфейс для прослушивания
+ * @param config Конфигурация захвата
  * @param enable_logging Флаг включения логирования
  * @return true при успешном разборе
  */
-bool parseCommandLine(int argc, char* argv[], std::string& interface, bool& enable_logging)
+bool parseCommandLine(int argc, char* argv[], CaptureConfig& config, bool& enable_logging)
 {
     enable_logging = false;
-    interface = "";
+    config = CaptureConfig{};
 
     for(int i = 1; i < argc; ++i)
     {
@@ -50,20 +79,252 @@ bool parseCommandLine(int argc, char* argv[], std::string& interface, bool& enab
 
         if(arg == "--help" || arg == "-h")
         {
-            std::cout << "Использование: " << argv[0] << " --interface <interface> [--log]\n";
+            std::cout << "Использование: " << argv[0] <<
+                " --interface <interface> [--capture-backend <pcap|tpacket_v3>] [--log]\n";
+            std::cout << "       " << argv[0] << " --read <file.pcap> [--replay <max|realtime>] [--log]\n";
             std::cout << "\nОпции:\n";
-            std::cout << "  --interface <interface>  Интерфейс для прослушивания (обязательно)\n";
+            std::cout << "  --interface <interface>  Интерфейс для прослушивания (обязательно; any - все интерфейсы)\n";
+            std::cout << "  --capture-backend <name> Механизм захвата: pcap (по умолчанию) или tpacket_v3\n";
+            std::cout << "  --snaplen <bytes>        Захватываемая часть кадра (по умолчанию 128, только заголовки)\n";
+            std::cout << "  --buffer-size <MB>       Размер буфера ядра (по умолчанию - значение libpcap)\n";
+            std::cout << "  --immediate              Доставлять пакеты сразу, без накопления в буфере\n";
+            std::cout << "  --timeout <ms>           Таймаут доставки накопленных пакетов (по умолчанию 100)\n";
+            std::cout << "  --workers <N>            Количество потоков захвата в группе PACKET_FANOUT (по умолчанию 1)\n";
+            std::cout << "  --expected-flows <N>     Ожидаемое количество потоков: таблицы создаются сразу под него\n";
+            std::cout << "  --flow-timeout <s>       Удалять потоки без пакетов дольше s секунд (по умолчанию 60)\n";
+            std::cout << "  --max-flows <N>          Предел количества потоков, новые потоки вытесняют старые\n";
+            std::cout << "  --max-flow-memory <MB>   Предел памяти таблиц потоков (переводится в предел количества)\n";
+            std::cout << "  --eviction <lru|bytes>   Кого вытеснять: давно неактивные (по умолчанию) или с наименьшим объёмом\n";
+            std::cout << "  --approx-topk <N>        Приближённый топ по объёму: сводка Space-Saving из N счётчиков\n";
+            std::cout << "                           вместо таблицы всех потоков (память не зависит от числа потоков)\n";
+            std::cout << "  --count-min <W>          Count-Min sketch ширины W уточняет оценки --approx-topk\n";
+            std::cout << "  --interval-ms <ms>       Интервал вывода топа потоков (по умолчанию 1000, не меньше 10)\n";
+            std::cout << "  --flow-cache <N>         Кэш горячих потоков из N ячеек на поток захвата (по умолчанию выключен)\n";
+            std::cout << "                           выгоден, когда несколько крупных потоков несут большую часть пакетов\n";
+            std::cout << "  --pipeline               Учёт потоков в отдельном потоке агрегации: поток захвата только\n";
+            std::cout << "                           разбирает пакеты и передаёт их через очередь без блокировок\n";
+            std::cout << "  --pipeline-ring <N>      Записей в очереди конвейера на поток захвата (по умолчанию 65536)\n";
+            std::cout << "  --huge-pages <mode>      Большие страницы таблиц потоков и очередей: off (по умолчанию),\n";
+            std::cout << "                           thp (прозрачные) или explicit (пул hugetlbfs, иначе thp)\n";
+            std::cout << "  --capture-cpus <list>    CPU потоков захвата (и агрегации при --pipeline) по порядку, например 0-3,8;\n";
+            std::cout << "                           таблица потоков выделяется на узле NUMA своего CPU\n";
+            std::cout << "  --report-cpu <N>         CPU потока вывода статистики\n";
+            std::cout << "  --flow-store <dir>       Хранить таблицы потоков в файлах каталога: после перезапуска\n";
+            std::cout << "                           потоки восстанавливаются (просмотр без захвата: flow_reader <dir>);\n";
+            std::cout << "                           запуск возможен только с прежним --workers\n";
+            std::cout << "  --read <file.pcap>       Воспроизвести записанный файл вместо захвата с интерфейса\n";
+            std::cout << "  --replay <max|realtime>  Скорость воспроизведения: максимальная (по умолчанию) или исходная\n";
             std::cout <<
                 "  --log                    Включить логирование в файлы logs/log_sniffer_YYYYMMDD_HHMMSS_mmm.txt\n";
             std::cout << "  --help, -h               Показать эту справку\n";
             std::cout << "\nПримеры:\n";
             std::cout << "  " << argv[0] << " --interface lo\n";
             std::cout << "  " << argv[0] << " --interface eth0 --log\n";
+            std::cout << "  " << argv[0] << " --interface any\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --capture-backend tpacket_v3\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --capture-backend tpacket_v3 --workers 4\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --expected-flows 2000000\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --max-flow-memory 512 --eviction bytes\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --approx-topk 1024 --count-min 65536\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --interval-ms 100\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --flow-cache 1024\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --capture-backend tpacket_v3 --pipeline\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --expected-flows 10000000 --huge-pages thp\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --capture-backend tpacket_v3 --workers 4 --capture-cpus 2-5"
+                " --report-cpu 1\n";
+            std::cout << "  " << argv[0] << " --interface eth0 --flow-store /var/lib/sniffer\n";
+            std::cout << "  " << argv[0] << " --read trace.pcap\n";
             return false; // Завершаем программу после вывода справки
         }
         else if(arg == "--interface" && i + 1 < argc)
         {
-            interface = argv[++i];
+            config.interface = argv[++i];
+        }
+        else if(arg == "--capture-backend" && i + 1 < argc)
+        {
+            if(!CaptureConfig::parseBackend(argv[++i], config.backend))
+            {
+                std::cerr << "[error] Неизвестный механизм захвата: " << argv[i] << "\n";
+                std::cerr << "Используйте --help для получения справки\n";
+                return false;
+            }
+        }
+        else if(arg == "--snaplen" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.snaplen) || config.snaplen < CaptureConfig::MIN_SNAPLEN)
+            {
+                std::cerr << "[error] Некорректный snaplen (минимум " << CaptureConfig::MIN_SNAPLEN << "): "
+                    << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--buffer-size" && i + 1 < argc)
+        {
+            uint32_t buffer_mb = 0;
+            if(!parseUnsigned(argv[++i], buffer_mb) || buffer_mb == 0 || buffer_mb > 2047)
+            {
+                std::cerr << "[error] Некорректный размер буфера: " << argv[i] << "\n";
+                return false;
+            }
+            config.buffer_size = buffer_mb * 1024 * 1024;
+        }
+        else if(arg == "--immediate")
+        {
+            config.immediate_mode = true;
+        }
+        else if(arg == "--timeout" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.timeout_ms))
+            {
+                std::cerr << "[error] Некорректный таймаут: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--workers" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.workers) || config.workers == 0)
+            {
+                std::cerr << "[error] Некорректное количество потоков захвата: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--expected-flows" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.expected_flows))
+            {
+                std::cerr << "[error] Некорректное ожидаемое количество потоков: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--flow-timeout" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.flow_timeout) || config.flow_timeout == 0)
+            {
+                std::cerr << "[error] Некорректный таймаут простоя потока: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--max-flows" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.max_flows) || config.max_flows == 0)
+            {
+                std::cerr << "[error] Некорректный предел количества потоков: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--max-flow-memory" && i + 1 < argc)
+        {
+            uint64_t memory_mb = 0;
+            if(!parseUnsigned(argv[++i], memory_mb) || memory_mb == 0)
+            {
+                std::cerr << "[error] Некорректный предел памяти таблиц потоков: " << argv[i] << "\n";
+                return false;
+            }
+            config.max_flow_memory = memory_mb * 1024 * 1024;
+        }
+        else if(arg == "--eviction" && i + 1 < argc)
+        {
+            if(!CaptureConfig::parseEvictionPolicy(argv[++i], config.eviction_policy))
+            {
+                std::cerr << "[error] Неизвестная политика вытеснения: " << argv[i] << "\n";
+                std::cerr << "Используйте --help для получения справки\n";
+                return false;
+            }
+        }
+        else if(arg == "--approx-topk" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.approx_topk) || config.approx_topk == 0 ||
+                config.approx_topk > 0x7FFFFFFF)
+            {
+                std::cerr << "[error] Некорректное количество счётчиков Space-Saving: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--count-min" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.count_min_width) || config.count_min_width == 0 ||
+                config.count_min_width > (1ULL << 30))
+            {
+                std::cerr << "[error] Некорректная ширина Count-Min sketch: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--interval-ms" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.report_interval_ms) ||
+                config.report_interval_ms < CaptureConfig::MIN_REPORT_INTERVAL_MS)
+            {
+                std::cerr << "[error] Некорректный интервал вывода: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--flow-cache" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.flow_cache) || config.flow_cache > CaptureConfig::MAX_FLOW_CACHE)
+            {
+                std::cerr << "[error] Некорректный размер кэша потоков: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--pipeline")
+        {
+            if(config.pipeline_ring == 0)
+            {
+                config.pipeline_ring = CaptureConfig::DEFAULT_PIPELINE_RING;
+            }
+        }
+        else if(arg == "--pipeline-ring" && i + 1 < argc)
+        {
+            if(!parseUnsigned(argv[++i], config.pipeline_ring) || config.pipeline_ring < 2 ||
+                config.pipeline_ring > CaptureConfig::MAX_PIPELINE_RING)
+            {
+                std::cerr << "[error] Некорректный размер очереди конвейера: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--huge-pages" && i + 1 < argc)
+        {
+            if(!CaptureConfig::parseHugePageMode(argv[++i], config.huge_pages))
+            {
+                std::cerr << "[error] Неизвестный режим больших страниц: " << argv[i] << "\n";
+                std::cerr << "Используйте --help для получения справки\n";
+                return false;
+            }
+        }
+        else if(arg == "--capture-cpus" && i + 1 < argc)
+        {
+            if(!CaptureConfig::parseCpuList(argv[++i], config.capture_cpus))
+            {
+                std::cerr << "[error] Некорректный список CPU: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if(arg == "--report-cpu" && i + 1 < argc)
+        {
+            uint32_t report_cpu = 0;
+            if(!CaptureConfig::parseCpu(argv[++i], report_cpu))
+            {
+                std::cerr << "[error] Некорректный номер CPU: " << argv[i] << "\n";
+                return false;
+            }
+            config.report_cpu = static_cast<int>(report_cpu);
+        }
+        else if(arg == "--flow-store" && i + 1 < argc)
+        {
+            config.flow_store = argv[++i];
+        }
+        else if(arg == "--read" && i + 1 < argc)
+        {
+            config.read_file = argv[++i];
+        }
+        else if(arg == "--replay" && i + 1 < argc)
+        {
+            if(!CaptureConfig::parseReplayMode(argv[++i], config.replay_mode))
+            {
+                std::cerr << "[error] Неизвестный режим воспроизведения: " << argv[i] << "\n";
+                std::cerr << "Используйте --help для получения справки\n";
+                return false;
+            }
         }
         else if(arg == "--log")
         {
@@ -77,7 +338,47 @@ bool parseCommandLine(int argc, char* argv[], std::string& interface, bool& enab
         }
     }
 
-    if(interface.empty())
+    if(config.count_min_width != 0 && config.approx_topk == 0)
+    {
+        std::cerr << "[error] Параметр --count-min используется только вместе с --approx-topk\n";
+        return false;
+    }
+    if(!config.flow_store.empty() && config.approx_topk != 0)
+    {
+        std::cerr << "[error] Параметр --flow-store хранит точную таблицу потоков и несовместим с --approx-topk\n";
+        return false;
+    }
+
+    // Номера CPU проверяются по числу процессоров машины; CPU вне cpuset процесса выявит привязка
+    const auto cpu_count = static_cast<uint32_t>(sysconf(_SC_NPROCESSORS_CONF));
+    for(uint32_t cpu : config.capture_cpus)
+    {
+        if(cpu >= cpu_count)
+        {
+            std::cerr << "[error] CPU " << cpu << " отсутствует (процессоров: " << cpu_count << ")\n";
+            return false;
+        }
+    }
+    if(config.report_cpu >= static_cast<int>(cpu_count))
+    {
+        std::cerr << "[error] CPU " << config.report_cpu << " отсутствует (процессоров: " << cpu_count << ")\n";
+        return false;
+    }
+
+    if(config.isOffline())
+    {
+        if(!config.interface.empty())
+        {
+            std::cerr << "[error] Параметры --interface и --read взаимоисключающие\n";
+            return false;
+        }
+        if(config.workers > 1)
+        {
+            std::cout << "[warning] При воспроизведении файла используется один поток обработки\n";
+            config.workers = 1;
+        }
+    }
+    else if(config.interface.empty())
     {
         std::cerr << "[error] Не указан интерфейс. Используйте --interface <interface>\n";
         std::cerr << "Используйте --help для получения справки\n";
@@ -87,50 +388,289 @@ bool parseCommandLine(int argc, char* argv[], std::string& interface, bool& enab
     return true;
 }
 
+/**
+ * @brief Подготовка каталога файлов таблиц потоков
+ *
+ * Поток попадает в шард по хешу PACKET_FANOUT от количества сокетов группы, поэтому
+ * при другом количестве потоков захвата соединение продолжилось бы в другом шарде, а его
+ * восстановленная статистика осталась бы в прежнем. Каждый файл хранит количество шардов,
+ * с которым создан (FlowTable::getShardCount()), и запуск с другим --workers отклоняется.
+ *
+ * Хеш PACKET_FANOUT ядро считает с ключом, выбранным при загрузке, поэтому после
+ * перезагрузки хоста соединения, начатые до неё, могут попасть в другие шарды даже при
+ * том же --workers: их статистика будет разделена, пока старые записи не истекут.
+ *
+ * @param config Конфигурация захвата
+ * @throw std::runtime_error если каталог не создан или записан для другого количества шардов
+ */
+void prepareFlowStore(const CaptureConfig& config)
+{
+    std::filesystem::create_directories(config.flow_store);
+    for(const auto& entry : std::filesystem::directory_iterator(config.flow_store))
+    {
+        const std::string name = entry.path().filename().string();
+        uint32_t shard = 0;
+        if(!name.starts_with("shard-") || !name.ends_with(".flows") ||
+            !parseUnsigned(name.substr(6, name.size() - 12), shard))
+        {
+            continue;
+        }
+        if(shard >= config.workers)
+        {
+            throw std::runtime_error("каталог " + config.flow_store + " содержит " + name +
+                " от запуска с большим --workers; укажите прежнее значение или удалите файлы шардов");
+        }
+        const uint32_t shard_count = FlowTable(entry.path().string(), FlowTable::FileAccess::ReadOnly).getShardCount();
+        if(shard_count != config.workers)
+        {
+            throw std::runtime_error("каталог " + config.flow_store + " содержит " + name + " от запуска с --workers " +
+                std::to_string(shard_count) + "; укажите прежнее значение или удалите файлы шардов");
+        }
+    }
+}
+
+/**
+ * @brief Ожидание окончания воспроизведения файла и вывод итогов
+ * @param config Конфигурация захвата
+ * @param stats_manager Менеджер статистики
+ * @param packet_processor Процессор, читающий файл
+ * @return Код возврата
+ */
+int runReplay(const CaptureConfig& config, const StatisticsManager& stats_manager, PacketProcessor& packet_processor)
+{
+    // Сроки промежуточного вывода отсчитываются по часам потока, то есть по времени файла
+    const StreamClock& stream_clock = stats_manager.getStreamClock();
+    const uint64_t interval_us = static_cast<uint64_t>(config.report_interval_ms) * 1000;
+    uint64_t next_report = 0;
+    while(g_running && !packet_processor.isFinished())
+    {
+        std::this_thread::sleep_for(std::min<std::chrono::milliseconds>(
+            std::chrono::milliseconds(config.report_interval_ms), std::chrono::milliseconds(100)));
+
+        // В режиме максимальной скорости промежуточный вывод только мешал бы измерению
+        const uint64_t now = config.replay_mode == ReplayMode::RealTime ? stream_clock.now() : 0;
+        if(now == 0)
+        {
+            continue;
+        }
+        if(next_report == 0)
+        {
+            next_report = now + interval_us;
+        }
+        else if(now >= next_report)
+        {
+            next_report = std::max(next_report + interval_us, now);
+            stats_manager.printTopFlows(10, now);
+        }
+    }
+    packet_processor.stop();
+
+    const ReplayResult& result = packet_processor.getReplayResult();
+    std::cout << "\n=== Итоги воспроизведения " << config.read_file << " ===\n";
+    std::cout << "Пакетов:          " << result.packets << "\n";
+    std::cout << "Время обработки:  " << std::fixed << std::setprecision(3)
+        << static_cast<double>(result.elapsed_ns) / 1e9 << " с\n";
+    std::cout << "Пропускная способность: " << std::setprecision(0) << result.getPacketsPerSecond() << " пакетов/с\n";
+    std::cout << "Время на пакет:   " << std::setprecision(1) << result.getNanosecondsPerPacket() << " нс\n";
+
+    // Итоговая таблица всех потоков; скорость считается на момент последнего пакета файла
+    stats_manager.printTopFlows(stats_manager.getActiveFlowCount(), result.last_packet_time, false);
+
+    std::cout << "\n[info] Sniffer завершен\n";
+    return 0;
+}
+
 /**
  * @brief Запуск sniffer приложения
- * @param interface Интерфейс для прослушивания
+ * @param config Конфигурация захвата
  * @param enable_logging Флаг включения логирования
  * @return Код возврата
  */
-int runSniffer(const std::string& interface, bool enable_logging)
+int runSniffer(const CaptureConfig& config, bool enable_logging)
 {
     try
     {
         // Инициализация логирования
         LogManager::initialize(enable_logging, "sniffer");
 
-        std::cout << "[info] Запуск sniffer на интерфейсе: " << interface << "\n";
+        if(config.isOffline())
+        {
+            std::cout << "[info] Запуск sniffer на файле: " << config.read_file << "\n";
+        }
+        else
+        {
+            std::cout << "[info] Запуск sniffer на интерфейсе: " << config.interface
+                << " (захват: " << CaptureConfig::backendToString(config.backend) << ")\n";
+        }
         std::cout << "[info] Для завершения работы используйте Ctrl-C\n\n";
 
-        // Создание компонентов
-        FlowTracker flow_tracker;
-        StatisticsManager stats_manager;
-        stats_manager.setFlowTracker(flow_tracker);
-        
-        // Создаем PacketProcessor и сохраняем в глобальную переменную
-        g_packet_processor = std::make_unique<PacketProcessor>(interface, flow_tracker, stats_manager);
+        // Создание компонентов: у каждого потока захвата собственный шард потоков
+        // При воспроизведении часы потока стоят на последнем пакете файла, при живом захвате
+        // без трафика идут по системному времени
+        StatisticsManager stats_manager(!config.isOffline());
+        std::vector<std::unique_ptr<FlowTracker>> flow_trackers;
+        std::vector<std::unique_ptr<PacketProcessor>> packet_processors;
+
+        CaptureConfig worker_config = config;
+        if(config.workers > 1)
+        {
+            // Все сокеты процесса объединяются в одну группу PACKET_FANOUT
+            worker_config.fanout_group = static_cast<int>(getpid() & 0xFFFF);
+        }
+
+        // Предел памяти переводится в предел количества потоков шарда
+        uint64_t max_flows = config.getMaxFlowsPerWorker();
+        if(config.max_flow_memory != 0)
+        {
+            const uint64_t memory_limit = FlowTracker::getMaxFlowsForMemory(config.max_flow_memory / config.workers);
+            max_flows = max_flows == 0 ? memory_limit : std::min(max_flows, memory_limit);
+        }
+        if(max_flows != 0)
+        {
+            std::cout << "[info] Предел потоков на поток захвата: " << max_flows
+                << " (вытеснение: " << CaptureConfig::evictionPolicyToString(config.eviction_policy) << ")\n";
+        }
+
+        if(config.approx_topk != 0)
+        {
+            std::cout << "[info] Приближённый топ: Space-Saving " << config.approx_topk << " счётчиков на поток захвата";
+            if(config.count_min_width != 0)
+            {
+                std::cout << ", Count-Min " << CountMinSketch::DEPTH << "x" << config.count_min_width;
+            }
+            std::cout << "\n";
+        }
+        else if(config.flow_cache != 0)
+        {
+            std::cout << "[info] Кэш горячих потоков: " << config.flow_cache << " ячеек на поток захвата\n";
+        }
+        if(config.pipeline_ring != 0)
+        {
+            std::cout << "[info] Конвейер: очередь " << std::bit_ceil(config.pipeline_ring) << " записей по "
+                << sizeof(PacketRecord) << " байта на поток захвата, учёт потоков в потоке агрегации\n";
+        }
+
+        // Тип страниц проверяется пробным отображением: пул hugetlbfs может быть пуст, THP - выключены
+        const PageType page_type = PageMapping::probe(config.huge_pages);
+        std::cout << "[info] Страницы таблиц потоков и очередей (от 2 МБ): " << PageMapping::pageTypeToString(page_type);
+        if(config.huge_pages == HugePageMode::Explicit && page_type != PageType::Explicit)
+        {
+            std::cout << " - пул hugetlbfs пуст (vm.nr_hugepages)";
+        }
+        else if(config.huge_pages != HugePageMode::Off && page_type == PageType::Normal)
+        {
+            std::cout << " - прозрачные большие страницы выключены";
+        }
+        std::cout << "\n";
+
+        if(!config.flow_store.empty())
+        {
+            prepareFlowStore(config);
+            std::cout << "[info] Таблицы потоков в файлах " << config.flow_store << "/shard-N.flows";
+            if(config.huge_pages != HugePageMode::Off)
+            {
+                std::cout << " (на обычных страницах, --huge-pages к ним не применяется)";
+            }
+            std::cout << "\n";
+        }
 
-        // Запуск обработки пакетов в отдельном потоке
-        std::thread packet_thread([&]()
+        for(uint32_t i = 0; i < config.workers; ++i)
         {
-            g_packet_processor->start();
-        });
+            // Таблица шарда выделяется на узле NUMA потока, который в неё пишет
+            const int shard_cpu = config.getShardCpu(i);
+            const int numa_node = shard_cpu >= 0 ? CpuAffinity::getNumaNode(static_cast<uint32_t>(shard_cpu)) : -1;
+            const auto attach_start = std::chrono::steady_clock::now();
+            flow_trackers.push_back(std::make_unique<FlowTracker>(config.getExpectedFlowsPerWorker(), config.flow_timeout,
+                                                                  max_flows, config.eviction_policy,
+                                                                  config.huge_pages, numa_node,
+                                                                  config.flow_store.empty()
+                                                                      ? std::string()
+                                                                      : config.getFlowStorePath(i),
+                                                                  config.workers));
+            if(flow_trackers.back()->getRestoredFlowCount() != 0)
+            {
+                std::cout << "[info] Шард " << i << ": восстановлено потоков " << flow_trackers.back()->getRestoredFlowCount()
+                    << " из " << config.getFlowStorePath(i) << " за " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now() - attach_start).count() << " мс\n";
+            }
+            if(config.approx_topk != 0)
+            {
+                flow_trackers.back()->enableApproxTopK(config.approx_topk, config.count_min_width);
+            }
+            stats_manager.addFlowTracker(*flow_trackers.back());
+            worker_config.worker_index = i;
+            packet_processors.push_back(
+                std::make_unique<PacketProcessor>(worker_config, *flow_trackers.back(), stats_manager));
+            stats_manager.addCaptureCounters(packet_processors.back()->getCaptureCounters());
 
-        // Основной цикл вывода статистики
+            if(shard_cpu >= 0)
+            {
+                std::cout << "[info] Шард " << i << ": захват на CPU " << config.getWorkerCpu(i, false);
+                if(config.pipeline_ring != 0)
+                {
+                    std::cout << ", агрегация на CPU " << shard_cpu;
+                }
+                if(numa_node >= 0 && CpuAffinity::getNumaNodeCount() > 1)
+                {
+                    std::cout << ", таблица потоков на узле NUMA " << numa_node;
+                    if(flow_trackers.back()->getNumaNode() != numa_node)
+                    {
+                        std::cout << " (mbind недоступен, по первой записи)";
+                    }
+                }
+                std::cout << "\n";
+            }
+        }
+
+        // Запуск обработки пакетов: каждый PacketProcessor создаёт собственный поток
+        for(auto& packet_processor : packet_processors)
+        {
+            packet_processor->start();
+        }
+        // Основной поток привязывается после запуска потоков захвата, чтобы они не унаследовали его CPU
+        if(config.report_cpu >= 0)
+        {
+            if(CpuAffinity::pinCurrentThread(static_cast<uint32_t>(config.report_cpu)))
+            {
+                std::cout << "[info] Поток вывода статистики на CPU " << config.report_cpu << "\n";
+            }
+            else
+            {
+                std::cerr << "[warning] Не удалось привязать поток вывода статистики к CPU " << config.report_cpu << "\n";
+            }
+        }
+        if(config.workers > 1)
+        {
+            std::cout << "[info] Запущено потоков захвата: " << config.workers
+                << " (группа PACKET_FANOUT " << worker_config.fanout_group << ")\n";
+        }
+
+        if(config.isOffline())
+        {
+            return runReplay(config, stats_manager, *packet_processors.front());
+        }
+
+        // Основной цикл вывода статистики: шарды объединяются только здесь. Сроки отсчитываются
+        // от предыдущего, чтобы время вывода не сдвигало интервал
+        const auto interval = std::chrono::milliseconds(config.report_interval_ms);
+        auto next_report = std::chrono::steady_clock::now() + interval;
         while(g_running)
         {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
+            std::this_thread::sleep_until(next_report);
+            next_report = std::max(next_report + interval, std::chrono::steady_clock::now());
 
-            stats_manager.cleanupOldFlows();
-            stats_manager.printTopFlows(10);
+            // Одно чтение часов потока на отчёт: истечение и скорости считаются на один момент
+            const uint64_t now = stats_manager.getStreamClock().now();
+            stats_manager.cleanupOldFlows(now);
+            stats_manager.printTopFlows(10, now);
         }
 
+        std::cout << "\n[info] Получен сигнал завершения. Завершение работы...\n";
+
         // Остановка и ожидание завершения
-        g_packet_processor->stop();
-        if(packet_thread.joinable())
+        for(auto& packet_processor : packet_processors)
         {
-            packet_thread.join();
+            packet_processor->stop();
         }
 
         std::cout << "\n[info] Sniffer завершен\n";
@@ -149,13 +689,13 @@ int main(int argc, char* argv[])
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
 
-    std::string interface;
+    CaptureConfig config;
     bool enable_logging;
 
-    if(!parseCommandLine(argc, argv, interface, enable_logging))
+    if(!parseCommandLine(argc, argv, config, enable_logging))
     {
         return 1;
     }
 
-    return runSniffer(interface, enable_logging);
+    return runSniffer(config, enable_logging);
 }
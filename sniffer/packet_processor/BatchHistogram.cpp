@@ -0,0 +1,87 @@
+#include "BatchHistogram.h"
+#include <bit>
+#include <sstream>
+
+BatchHistogram::BatchHistogram()
+    : m_buckets{}
+      , m_packets(0)
+{
+}
+
+void BatchHistogram::record(uint64_t batch_size)
+{
+    if(batch_size == 0)
+    {
+        return;
+    }
+
+    // Единственный писатель: достаточно relaxed load/store без атомарного RMW
+    auto& bucket = m_buckets[bucketFor(batch_size)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_packets.store(m_packets.load(std::memory_order_relaxed) + batch_size, std::memory_order_relaxed);
+}
+
+uint64_t BatchHistogram::getBucket(size_t bucket) const
+{
+    return bucket < BUCKET_COUNT ? m_buckets[bucket].load(std::memory_order_relaxed) : 0;
+}
+
+uint64_t BatchHistogram::getBatchCount() const
+{
+    uint64_t total = 0;
+    for(const auto& bucket : m_buckets)
+    {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+uint64_t BatchHistogram::getPacketCount() const
+{
+    return m_packets.load(std::memory_order_relaxed);
+}
+
+size_t BatchHistogram::bucketFor(uint64_t batch_size)
+{
+    const auto bucket = static_cast<size_t>(std::bit_width(batch_size)) - 1;
+    return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+}
+
+std::string BatchHistogram::toString() const
+{
+    std::ostringstream oss;
+    bool first = true;
+
+    for(size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+        const uint64_t count = getBucket(i);
+        if(count == 0)
+        {
+            continue;
+        }
+
+        if(!first)
+        {
+            oss << " ";
+        }
+        first = false;
+
+        const uint64_t low = 1ULL << i;
+        const uint64_t high = (1ULL << (i + 1)) - 1;
+        if(i == BUCKET_COUNT - 1)
+        {
+            oss << low << "+";
+        }
+        else if(low == high)
+        {
+            oss << low;
+        }
+        else
+        {
+            oss << low << "-" << high;
+        }
+        oss << ":" << count;
+    }
+
+    return first ? "-" : oss.str();
+}
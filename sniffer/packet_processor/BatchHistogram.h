@@ -0,0 +1,68 @@
+#ifndef BATCH_HISTOGRAM_H
+#define BATCH_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Гистограмма размеров пачек пакетов, полученных за одно пробуждение
+ *
+ * Корзины логарифмические: корзина k содержит пачки размером [2^k, 2^(k+1)).
+ * Запись выполняется одним потоком захвата, чтение допускается из любого потока.
+ */
+class BatchHistogram
+{
+public:
+    static constexpr size_t BUCKET_COUNT = 16;
+
+    /**
+     * @brief Конструктор
+     */
+    BatchHistogram();
+
+    /**
+     * @brief Учёт одной пачки
+     * @param batch_size Количество пакетов в пачке (пустые пачки не учитываются)
+     */
+    void record(uint64_t batch_size);
+
+    /**
+     * @brief Получение количества пачек в корзине
+     * @param bucket Номер корзины
+     * @return Количество пачек
+     */
+    [[nodiscard]] uint64_t getBucket(size_t bucket) const;
+
+    /**
+     * @brief Получение общего количества пачек
+     * @return Количество пачек
+     */
+    [[nodiscard]] uint64_t getBatchCount() const;
+
+    /**
+     * @brief Получение общего количества пакетов во всех пачках
+     * @return Количество пакетов
+     */
+    [[nodiscard]] uint64_t getPacketCount() const;
+
+    /**
+     * @brief Номер корзины для размера пачки
+     * @param batch_size Размер пачки (> 0)
+     * @return Номер корзины
+     */
+    static size_t bucketFor(uint64_t batch_size);
+
+    /**
+     * @brief Форматирование гистограммы для вывода
+     * @return Строка вида "1:10 2-3:4 4-7:1 ..." (только непустые корзины)
+     */
+    [[nodiscard]] std::string toString() const;
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets;
+    std::atomic<uint64_t> m_packets;
+};
+
+#endif // BATCH_HISTOGRAM_H
@@ -0,0 +1,410 @@
+#ifndef CAPTURE_CONFIG_H
+#define CAPTURE_CONFIG_H
+
+#include <string>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Механизм захвата пакетов
+ */
+enum class CaptureBackend
+{
+    Pcap, ///< libpcap (pcap_next/pcap_dispatch)
+    TpacketV3 ///< AF_PACKET TPACKET_V3 кольцо, разделяемое с ядром (без копирования кадров)
+};
+
+/**
+ * @brief Режим воспроизведения файла pcap
+ */
+enum class ReplayMode
+{
+    AsFastAsPossible, ///< Без пауз, для измерения пропускной способности
+    RealTime ///< С сохранением интервалов между пакетами из файла
+};
+
+/**
+ * @brief Политика вытеснения потоков при достижении предела таблицы
+ */
+enum class EvictionPolicy
+{
+    Lru, ///< Поток с самым давним последним пакетом
+    SmallestBytes ///< Поток с наименьшим количеством байт полезной нагрузки
+};
+
+/**
+ * @brief Большие страницы для таблиц потоков и очередей конвейера
+ */
+enum class HugePageMode
+{
+    Off, ///< Только обычные страницы
+    Transparent, ///< Прозрачные большие страницы (madvise(MADV_HUGEPAGE)), иначе обычные
+    Explicit ///< Явные большие страницы (MAP_HUGETLB), иначе прозрачные, иначе обычные
+};
+
+/**
+ * @brief Конфигурация захвата пакетов
+ *
+ * Содержит параметры для настройки PacketProcessor:
+ * - интерфейс и механизм захвата
+ * - параметры libpcap: snaplen, размер буфера ядра, immediate mode, таймаут
+ * - геометрию кольцевого буфера TPACKET_V3
+ * - распределение по рабочим потокам через PACKET_FANOUT
+ * - воспроизведение записанного файла pcap вместо живого захвата
+ * - начальный размер таблиц потоков и таймаут простоя потока
+ * - предел количества потоков или памяти таблиц и политику вытеснения
+ * - приближённый режим топ-N (сводка Space-Saving и Count-Min sketch)
+ * - размер кэша горячих потоков каждого потока захвата
+ * - конвейер: очередь разобранных пакетов между потоком захвата и потоком агрегации
+ * - большие страницы для таблиц потоков и очередей конвейера
+ * - привязку потоков захвата, агрегации и вывода статистики к CPU
+ * - каталог файлов таблиц потоков, переживающих перезапуск
+ */
+struct CaptureConfig
+{
+    static constexpr uint32_t MIN_SNAPLEN = 64; ///< Ethernet + минимальные IP и TCP заголовки
+    static constexpr uint32_t MIN_REPORT_INTERVAL_MS = 10; ///< Наименьший интервал вывода топа потоков
+    static constexpr uint32_t MAX_FLOW_CACHE = 1U << 20; ///< Наибольший размер кэша горячих потоков
+    static constexpr uint32_t DEFAULT_PIPELINE_RING = 1U << 16; ///< Очередь конвейера по умолчанию (1.5 МБ)
+    static constexpr uint32_t MAX_PIPELINE_RING = 1U << 24; ///< Наибольшая очередь конвейера (384 МБ)
+    static constexpr uint32_t MAX_CPUS = 4096; ///< Наибольший номер CPU + 1 и длина списка CPU
+
+    std::string interface; ///< Интерфейс для прослушивания
+    CaptureBackend backend = CaptureBackend::Pcap; ///< Механизм захвата
+    uint32_t snaplen = 128; ///< Захватываемая часть кадра (байт); парсеру нужны только заголовки
+    uint32_t buffer_size = 0; ///< Размер буфера ядра (байт, 0 - значение libpcap по умолчанию)
+    bool immediate_mode = false; ///< Доставлять пакеты сразу, без накопления в буфере
+    uint32_t timeout_ms = 100; ///< Таймаут доставки накопленных пакетов (мс, для кольца - закрытия блока)
+    uint32_t ring_block_size = 1U << 22; ///< Размер блока кольца TPACKET_V3 (байт, кратен странице)
+    uint32_t ring_block_count = 64; ///< Количество блоков кольца TPACKET_V3
+    uint32_t ring_frame_size = 2048; ///< Минимальный размер кадра кольца TPACKET_V3
+    uint32_t workers = 1; ///< Количество рабочих потоков захвата
+    int fanout_group = -1; ///< Идентификатор группы PACKET_FANOUT (-1 - без группы)
+    std::string read_file; ///< Файл pcap для воспроизведения (пусто - живой захват)
+    ReplayMode replay_mode = ReplayMode::AsFastAsPossible; ///< Режим воспроизведения файла
+    uint64_t expected_flows = 0; ///< Ожидаемое количество потоков (таблицы создаются под него, 0 - рост с нуля)
+    uint64_t flow_timeout = 60; ///< Таймаут простоя потока (секунды времени пакетов)
+    uint64_t max_flows = 0; ///< Предел количества потоков (0 - без предела)
+    uint64_t max_flow_memory = 0; ///< Предел памяти таблиц потоков (байт, 0 - без предела)
+    EvictionPolicy eviction_policy = EvictionPolicy::Lru; ///< Политика вытеснения при достижении предела
+    uint64_t approx_topk = 0; ///< Счётчиков Space-Saving на поток захвата (0 - точный учёт всех потоков)
+    uint64_t count_min_width = 0; ///< Ширина Count-Min sketch приближённого режима (0 - без sketch)
+    uint32_t report_interval_ms = 1000; ///< Интервал вывода топа потоков (мс)
+    uint32_t flow_cache = 0; ///< Ячеек кэша горячих потоков на поток захвата (0 - без кэша)
+    uint32_t pipeline_ring = 0; ///< Записей в очереди конвейера на поток захвата (0 - учёт в потоке захвата)
+    HugePageMode huge_pages = HugePageMode::Off; ///< Большие страницы таблиц потоков и очередей конвейера
+    std::vector<uint32_t> capture_cpus; ///< CPU потоков захвата и агрегации по порядку шардов (пусто - без привязки)
+    int report_cpu = -1; ///< CPU потока вывода статистики (-1 - без привязки)
+    uint32_t worker_index = 0; ///< Номер потока захвата (шарда), задаётся для каждого PacketProcessor
+    std::string flow_store; ///< Каталог файлов таблиц потоков (пусто - таблицы в памяти процесса)
+
+    /**
+     * @brief Проверка валидности конфигурации
+     * @return true если конфигурация корректна
+     */
+    [[nodiscard]] bool isValid() const noexcept
+    {
+        return (!interface.empty() || !read_file.empty()) && snaplen >= MIN_SNAPLEN && workers > 0 && flow_timeout > 0 &&
+            (count_min_width == 0 || approx_topk > 0) && report_interval_ms >= MIN_REPORT_INTERVAL_MS &&
+            flow_cache <= MAX_FLOW_CACHE && pipeline_ring <= MAX_PIPELINE_RING &&
+            ring_block_count > 0 && ring_frame_size > 0 && ring_block_size >= ring_frame_size &&
+            ring_block_size % ring_frame_size == 0;
+    }
+
+    /**
+     * @brief Ожидаемое количество потоков на один шард
+     * @return Доля expected_flows одного рабочего потока (с запасом на неравномерность хеша)
+     */
+    [[nodiscard]] uint64_t getExpectedFlowsPerWorker() const noexcept
+    {
+        const uint64_t share = (expected_flows + workers - 1) / workers;
+        return workers > 1 ? share + share / 8 : share;
+    }
+
+    /**
+     * @brief Предел количества потоков на один шард
+     * @return Доля max_flows одного рабочего потока (0 - без предела)
+     */
+    [[nodiscard]] uint64_t getMaxFlowsPerWorker() const noexcept
+    {
+        return (max_flows + workers - 1) / workers;
+    }
+
+    /**
+     * @brief CPU потока шарда по списку capture_cpus
+     *
+     * Шард занимает подряд один CPU списка (поток захвата) или два при конвейере
+     * (поток захвата, затем его поток агрегации), чтобы оба потока очереди стояли
+     * на соседних CPU одного узла. Короткий список повторяется по кругу.
+     *
+     * @param worker Номер потока захвата
+     * @param aggregator true для потока агрегации
+     * @return Номер CPU (-1 - без привязки)
+     */
+    [[nodiscard]] int getWorkerCpu(uint32_t worker, bool aggregator) const noexcept
+    {
+        if(capture_cpus.empty())
+        {
+            return -1;
+        }
+        const size_t cpus_per_worker = pipeline_ring != 0 ? 2 : 1;
+        const size_t position = worker * cpus_per_worker + (aggregator && pipeline_ring != 0 ? 1 : 0);
+        return static_cast<int>(capture_cpus[position % capture_cpus.size()]);
+    }
+
+    /**
+     * @brief CPU потока, который пишет в шард (поток агрегации при конвейере, иначе поток захвата)
+     * @param worker Номер потока захвата
+     * @return Номер CPU (-1 - без привязки)
+     */
+    [[nodiscard]] int getShardCpu(uint32_t worker) const noexcept
+    {
+        return getWorkerCpu(worker, true);
+    }
+
+    /**
+     * @brief Путь к файлу таблицы потоков шарда в каталоге flow_store
+     * @param worker Номер потока захвата
+     * @return Путь вида <flow_store>/shard-<worker>.flows
+     */
+    [[nodiscard]] std::string getFlowStorePath(uint32_t worker) const
+    {
+        return flow_store + "/shard-" + std::to_string(worker) + ".flows";
+    }
+
+    /**
+     * @brief Разбор номера CPU
+     * @param text Десятичный номер
+     * @param cpu Результат разбора
+     * @return true если номер корректен и меньше MAX_CPUS
+     */
+    static bool parseCpu(const std::string& text, uint32_t& cpu)
+    {
+        if(text.empty() || text.size() > 4 || text.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+        cpu = static_cast<uint32_t>(std::stoul(text));
+        return cpu < MAX_CPUS;
+    }
+
+    /**
+     * @brief Разбор списка CPU в формате cpuset ("0-3,8,10-11")
+     * @param text Список номеров и диапазонов через запятую
+     * @param cpus Номера CPU в порядке списка
+     * @return true если список непуст и корректен
+     */
+    static bool parseCpuList(const std::string& text, std::vector<uint32_t>& cpus)
+    {
+        cpus.clear();
+        size_t begin = 0;
+        while(begin <= text.size())
+        {
+            size_t end = text.find(',', begin);
+            end = end == std::string::npos ? text.size() : end;
+            const std::string item = text.substr(begin, end - begin);
+            const size_t dash = item.find('-');
+
+            uint32_t first = 0;
+            uint32_t last = 0;
+            if(dash == std::string::npos)
+            {
+                if(!parseCpu(item, first))
+                {
+                    return false;
+                }
+                last = first;
+            }
+            else if(!parseCpu(item.substr(0, dash), first) || !parseCpu(item.substr(dash + 1), last) || last < first)
+            {
+                return false;
+            }
+            if(cpus.size() + (last - first) >= MAX_CPUS)
+            {
+                return false;
+            }
+            for(uint32_t cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(cpu);
+            }
+            begin = end + 1;
+        }
+        return !cpus.empty();
+    }
+
+    /**
+     * @brief Получение строкового представления списка CPU
+     * @param cpus Номера CPU
+     * @return Номера через запятую ("-" для пустого списка)
+     */
+    static std::string cpuListToString(const std::vector<uint32_t>& cpus)
+    {
+        std::string text;
+        for(uint32_t cpu : cpus)
+        {
+            text += (text.empty() ? "" : ",") + std::to_string(cpu);
+        }
+        return text.empty() ? "-" : text;
+    }
+
+    /**
+     * @brief Разбор названия политики вытеснения
+     * @param name Название (lru, bytes)
+     * @param policy Результат разбора
+     * @return true если название распознано
+     */
+    static bool parseEvictionPolicy(const std::string& name, EvictionPolicy& policy)
+    {
+        if(name == "lru")
+        {
+            policy = EvictionPolicy::Lru;
+            return true;
+        }
+        if(name == "bytes" || name == "smallest")
+        {
+            policy = EvictionPolicy::SmallestBytes;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Получение названия политики вытеснения
+     * @param policy Политика вытеснения
+     * @return Строковое название
+     */
+    static std::string evictionPolicyToString(EvictionPolicy policy)
+    {
+        return policy == EvictionPolicy::SmallestBytes ? "bytes" : "lru";
+    }
+
+    /**
+     * @brief Разбор названия режима больших страниц
+     * @param name Название (off, thp, explicit)
+     * @param mode Результат разбора
+     * @return true если название распознано
+     */
+    static bool parseHugePageMode(const std::string& name, HugePageMode& mode)
+    {
+        if(name == "off")
+        {
+            mode = HugePageMode::Off;
+            return true;
+        }
+        if(name == "thp" || name == "transparent")
+        {
+            mode = HugePageMode::Transparent;
+            return true;
+        }
+        if(name == "explicit" || name == "hugetlb")
+        {
+            mode = HugePageMode::Explicit;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Получение названия режима больших страниц
+     * @param mode Режим больших страниц
+     * @return Строковое название
+     */
+    static std::string hugePageModeToString(HugePageMode mode)
+    {
+        switch(mode)
+        {
+            case HugePageMode::Transparent: return "thp";
+            case HugePageMode::Explicit: return "explicit";
+            case HugePageMode::Off: break;
+        }
+        return "off";
+    }
+
+    /**
+     * @brief Разбор названия механизма захвата
+     * @param name Название (pcap, tpacket_v3)
+     * @param backend Результат разбора
+     * @return true если название распознано
+     */
+    static bool parseBackend(const std::string& name, CaptureBackend& backend)
+    {
+        if(name == "pcap")
+        {
+            backend = CaptureBackend::Pcap;
+            return true;
+        }
+        if(name == "tpacket_v3" || name == "tpacket")
+        {
+            backend = CaptureBackend::TpacketV3;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Получение названия механизма захвата
+     * @param backend Механизм захвата
+     * @return Строковое название
+     */
+    static std::string backendToString(CaptureBackend backend)
+    {
+        return backend == CaptureBackend::TpacketV3 ? "tpacket_v3" : "pcap";
+    }
+
+    /**
+     * @brief Проверка режима воспроизведения файла
+     * @return true если пакеты читаются из файла pcap
+     */
+    [[nodiscard]] bool isOffline() const noexcept { return !read_file.empty(); }
+
+    /**
+     * @brief Разбор названия режима воспроизведения
+     * @param name Название (max, realtime)
+     * @param mode Результат разбора
+     * @return true если название распознано
+     */
+    static bool parseReplayMode(const std::string& name, ReplayMode& mode)
+    {
+        if(name == "max" || name == "afap")
+        {
+            mode = ReplayMode::AsFastAsPossible;
+            return true;
+        }
+        if(name == "realtime")
+        {
+            mode = ReplayMode::RealTime;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Получение строкового представления конфигурации
+     * @return Строка с параметрами конфигурации
+     */
+    [[nodiscard]] std::string toString() const
+    {
+        if(isOffline())
+        {
+            return "read=" + read_file + ", replay=" +
+                (replay_mode == ReplayMode::RealTime ? std::string("realtime") : std::string("max"));
+        }
+        return "interface=" + interface + ", backend=" + backendToString(backend) +
+            ", snaplen=" + std::to_string(snaplen) + ", buffer=" + std::to_string(buffer_size) +
+            ", immediate=" + (immediate_mode ? std::string("on") : std::string("off")) +
+            ", timeout=" + std::to_string(timeout_ms) + "ms" +
+            ", ring=" + std::to_string(ring_block_count) + "x" + std::to_string(ring_block_size) +
+            ", workers=" + std::to_string(workers) + ", expected_flows=" + std::to_string(expected_flows) +
+            ", flow_timeout=" + std::to_string(flow_timeout) + "s" +
+            ", max_flows=" + std::to_string(max_flows) + ", max_flow_memory=" + std::to_string(max_flow_memory) +
+            ", eviction=" + evictionPolicyToString(eviction_policy) +
+            ", approx_topk=" + std::to_string(approx_topk) + ", count_min=" + std::to_string(count_min_width) +
+            ", interval=" + std::to_string(report_interval_ms) + "ms" +
+            ", flow_cache=" + std::to_string(flow_cache) + ", pipeline=" + std::to_string(pipeline_ring) +
+            ", huge_pages=" + hugePageModeToString(huge_pages) +
+            ", capture_cpus=" + cpuListToString(capture_cpus) + ", report_cpu=" + std::to_string(report_cpu) +
+            ", flow_store=" + (flow_store.empty() ? std::string("-") : flow_store);
+    }
+};
+
+#endif // CAPTURE_CONFIG_H
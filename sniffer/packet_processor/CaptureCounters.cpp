@@ -0,0 +1,118 @@
+#include "CaptureCounters.h"
+#include <iomanip>
+#include <sstream>
+
+CaptureHealth& CaptureHealth::operator+=(const CaptureHealth& other)
+{
+    accepted += other.accepted;
+    short_frame += other.short_frame;
+    not_ipv4 += other.not_ipv4;
+    not_tcp += other.not_tcp;
+    bad_header += other.bad_header;
+    kernel_drops += other.kernel_drops;
+    interface_drops += other.interface_drops;
+    flow_cache_hits += other.flow_cache_hits;
+    flow_cache_lookups += other.flow_cache_lookups;
+    ring_capacity += other.ring_capacity;
+    ring_used += other.ring_used;
+    // Сравнение долей ring_peak / ring_peak_capacity без деления
+    if(other.ring_peak * ring_peak_capacity > ring_peak * other.ring_peak_capacity ||
+        (ring_peak_capacity == 0 && other.ring_peak_capacity != 0))
+    {
+        ring_peak = other.ring_peak;
+        ring_peak_capacity = other.ring_peak_capacity;
+    }
+    ring_drops += other.ring_drops;
+    return *this;
+}
+
+uint64_t CaptureHealth::getRejected() const
+{
+    return short_frame + not_ipv4 + not_tcp + bad_header;
+}
+
+double CaptureHealth::getFlowCacheHitRate() const
+{
+    if(flow_cache_lookups == 0)
+    {
+        return 0.0;
+    }
+    return 100.0 * static_cast<double>(flow_cache_hits) / static_cast<double>(flow_cache_lookups);
+}
+
+std::string CaptureHealth::toString() const
+{
+    std::ostringstream oss;
+    oss << "принято " << accepted
+        << ", отброшено " << getRejected()
+        << " (короткие " << short_frame
+        << ", не IPv4 " << not_ipv4
+        << ", не TCP " << not_tcp
+        << ", IHL/doff " << bad_header << ")"
+        << ", потери ядра " << kernel_drops
+        << ", потери интерфейса " << interface_drops;
+    if(flow_cache_lookups != 0)
+    {
+        oss << ", кэш потоков " << std::fixed << std::setprecision(1) << getFlowCacheHitRate() << "% попаданий";
+    }
+    if(ring_capacity != 0)
+    {
+        oss << ", очередь конвейера " << ring_used << "/" << ring_capacity << " (пик самой заполненной "
+            << ring_peak << "/" << ring_peak_capacity << "), потери очереди " << ring_drops;
+    }
+    return oss.str();
+}
+
+CaptureCounters::CaptureCounters()
+    : m_results{}
+      , m_kernel_drops(0)
+      , m_interface_drops(0)
+      , m_ring_capacity(0)
+      , m_ring_pushed(0)
+      , m_ring_peak(0)
+      , m_ring_drops(0)
+      , m_ring_popped(0)
+      , m_flow_cache_hits(0)
+      , m_flow_cache_lookups(0)
+{
+}
+
+void CaptureCounters::setDrops(uint64_t kernel_drops, uint64_t interface_drops)
+{
+    m_kernel_drops.store(kernel_drops, std::memory_order_relaxed);
+    m_interface_drops.store(interface_drops, std::memory_order_relaxed);
+}
+
+void CaptureCounters::setFlowCache(uint64_t hits, uint64_t lookups)
+{
+    m_flow_cache_hits.store(hits, std::memory_order_relaxed);
+    m_flow_cache_lookups.store(lookups, std::memory_order_relaxed);
+}
+
+void CaptureCounters::setRingCapacity(uint64_t capacity)
+{
+    m_ring_capacity.store(capacity, std::memory_order_relaxed);
+}
+
+CaptureHealth CaptureCounters::getHealth() const
+{
+    CaptureHealth health;
+    health.accepted = m_results[static_cast<size_t>(ParseResult::Ok)].load(std::memory_order_relaxed);
+    health.short_frame = m_results[static_cast<size_t>(ParseResult::ShortFrame)].load(std::memory_order_relaxed);
+    health.not_ipv4 = m_results[static_cast<size_t>(ParseResult::NotIpv4)].load(std::memory_order_relaxed);
+    health.not_tcp = m_results[static_cast<size_t>(ParseResult::NotTcp)].load(std::memory_order_relaxed);
+    health.bad_header = m_results[static_cast<size_t>(ParseResult::BadHeader)].load(std::memory_order_relaxed);
+    health.kernel_drops = m_kernel_drops.load(std::memory_order_relaxed);
+    health.interface_drops = m_interface_drops.load(std::memory_order_relaxed);
+    health.flow_cache_hits = m_flow_cache_hits.load(std::memory_order_relaxed);
+    health.flow_cache_lookups = m_flow_cache_lookups.load(std::memory_order_relaxed);
+    health.ring_capacity = m_ring_capacity.load(std::memory_order_relaxed);
+    // Счётчики пишут разные потоки и читаются не одновременно: разность ограничивается нулём
+    const uint64_t popped = m_ring_popped.load(std::memory_order_relaxed);
+    const uint64_t pushed = m_ring_pushed.load(std::memory_order_relaxed);
+    health.ring_used = pushed > popped ? pushed - popped : 0;
+    health.ring_peak = m_ring_peak.load(std::memory_order_relaxed);
+    health.ring_peak_capacity = health.ring_capacity;
+    health.ring_drops = m_ring_drops.load(std::memory_order_relaxed);
+    return health;
+}
@@ -0,0 +1,168 @@
+#ifndef CAPTURE_COUNTERS_H
+#define CAPTURE_COUNTERS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "PacketParser.h"
+
+/**
+ * @brief Снимок счётчиков захвата для вывода
+ */
+struct CaptureHealth
+{
+    uint64_t accepted = 0; // Разобранные TCP/IPv4 пакеты
+    uint64_t short_frame = 0; // Заголовки не поместились в caplen
+    uint64_t not_ipv4 = 0; // Не IPv4 кадры
+    uint64_t not_tcp = 0; // IPv4, но не TCP
+    uint64_t bad_header = 0; // Некорректные IHL или doff
+    uint64_t kernel_drops = 0; // Потери в буфере ядра (ps_drop / tp_drops)
+    uint64_t interface_drops = 0; // Потери на интерфейсе (ps_ifdrop)
+    uint64_t flow_cache_hits = 0; // Пакеты, учтённые кэшем потоков без обращения к таблице
+    uint64_t flow_cache_lookups = 0; // Пакеты, прошедшие через кэш потоков
+    uint64_t ring_capacity = 0; // Ёмкость очереди конвейера (0 - без конвейера)
+    uint64_t ring_used = 0; // Записи в очереди конвейера, ещё не применённые к шарду
+    uint64_t ring_peak = 0; // Наибольшая замеченная занятость самой заполненной очереди (пики не суммируются)
+    uint64_t ring_peak_capacity = 0; // Ёмкость очереди, на которую пришёлся ring_peak
+    uint64_t ring_drops = 0; // Записи, отброшенные потоком захвата при заполненной очереди
+
+    /**
+     * @brief Суммирование снимков нескольких потоков захвата
+     *
+     * Пики очередей не складываются: потоки достигают их в разные моменты, а сумма скрыла бы
+     * одну переполненную очередь среди пустых. Остаётся пик самой заполненной очереди.
+     * @param other Снимок другого потока
+     * @return Ссылка на этот снимок
+     */
+    CaptureHealth& operator+=(const CaptureHealth& other);
+
+    /**
+     * @brief Количество отброшенных парсером кадров
+     * @return Сумма по всем причинам отбраковки
+     */
+    [[nodiscard]] uint64_t getRejected() const;
+
+    /**
+     * @brief Доля попаданий в кэш потоков
+     * @return Процент попаданий (0 без обращений к кэшу)
+     */
+    [[nodiscard]] double getFlowCacheHitRate() const;
+
+    /**
+     * @brief Форматирование строки состояния захвата
+     * @return Строка вида "принято 10, отброшено 2 (...), потери ядра 0, потери интерфейса 0";
+     *         при работе кэша потоков добавляется доля попаданий, в режиме конвейера - занятость очереди
+     */
+    [[nodiscard]] std::string toString() const;
+};
+
+/**
+ * @brief Счётчики одного потока захвата
+ *
+ * У каждого счётчика один писатель (relaxed load/store без атомарного RMW): поток захвата,
+ * а в режиме конвейера счётчики кэша потоков и чтения очереди - поток агрегации.
+ * Чтение допускается из потока отчёта. Выравнивание по строке кэша исключает
+ * ложное разделение со счётчиками соседних потоков захвата, а счётчики потока агрегации
+ * лежат в своей строке, чтобы запись каждой пачки с двух сторон очереди не гоняла
+ * одну строку между ядрами.
+ */
+class alignas(64) CaptureCounters
+{
+public:
+    /**
+     * @brief Конструктор
+     */
+    CaptureCounters();
+
+    /**
+     * @brief Учёт результата разбора одного кадра
+     * @param result Результат разбора
+     */
+    void record(ParseResult result)
+    {
+        auto& counter = m_results[static_cast<size_t>(result)];
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Учёт нескольких успешно разобранных кадров
+     * @param count Количество кадров
+     */
+    void recordAccepted(uint64_t count)
+    {
+        auto& counter = m_results[static_cast<size_t>(ParseResult::Ok)];
+        counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Обновление счётчиков потерь из статистики ядра
+     * @param kernel_drops Накопленные потери в буфере ядра
+     * @param interface_drops Накопленные потери на интерфейсе
+     */
+    void setDrops(uint64_t kernel_drops, uint64_t interface_drops);
+
+    /**
+     * @brief Обновление счётчиков кэша потоков
+     * @param hits Накопленные попадания
+     * @param lookups Накопленные обращения
+     */
+    void setFlowCache(uint64_t hits, uint64_t lookups);
+
+    /**
+     * @brief Установка ёмкости очереди конвейера
+     * @param capacity Ёмкость в записях
+     */
+    void setRingCapacity(uint64_t capacity);
+
+    /**
+     * @brief Учёт записи пачки в очередь конвейера (только поток захвата)
+     * @param pushed Записано в очередь
+     * @param dropped Отброшено из-за заполненной очереди
+     * @param occupancy Занятость очереди после записи
+     */
+    void recordRingPush(uint64_t pushed, uint64_t dropped, uint64_t occupancy)
+    {
+        m_ring_pushed.store(m_ring_pushed.load(std::memory_order_relaxed) + pushed, std::memory_order_relaxed);
+        if(dropped != 0)
+        {
+            m_ring_drops.store(m_ring_drops.load(std::memory_order_relaxed) + dropped, std::memory_order_relaxed);
+        }
+        if(occupancy > m_ring_peak.load(std::memory_order_relaxed))
+        {
+            m_ring_peak.store(occupancy, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Учёт чтения пачки из очереди конвейера (только поток агрегации)
+     * @param popped Прочитано из очереди
+     */
+    void recordRingPop(uint64_t popped)
+    {
+        m_ring_popped.store(m_ring_popped.load(std::memory_order_relaxed) + popped, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Получение снимка счётчиков
+     * @return Снимок счётчиков
+     */
+    [[nodiscard]] CaptureHealth getHealth() const;
+
+private:
+    // Поток захвата
+    std::array<std::atomic<uint64_t>, PARSE_RESULT_COUNT> m_results;
+    std::atomic<uint64_t> m_kernel_drops;
+    std::atomic<uint64_t> m_interface_drops;
+    std::atomic<uint64_t> m_ring_capacity;
+    std::atomic<uint64_t> m_ring_pushed;
+    std::atomic<uint64_t> m_ring_peak;
+    std::atomic<uint64_t> m_ring_drops;
+
+    // Поток агрегации в режиме конвейера (без конвейера - тоже поток захвата)
+    alignas(64) std::atomic<uint64_t> m_ring_popped;
+    std::atomic<uint64_t> m_flow_cache_hits;
+    std::atomic<uint64_t> m_flow_cache_lookups;
+};
+
+#endif // CAPTURE_COUNTERS_H
@@ -0,0 +1,82 @@
+#include "CpuAffinity.h"
+#include "CaptureConfig.h"
+#include <array>
+#include <climits>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace
+{
+    constexpr int MPOL_PREFERRED_POLICY = 1; // MPOL_PREFERRED из <numaif.h>
+}
+
+bool CpuAffinity::pinCurrentThread(uint32_t cpu)
+{
+    if(cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+
+int CpuAffinity::getCurrentCpu()
+{
+    return sched_getcpu();
+}
+
+int CpuAffinity::getNumaNode(uint32_t cpu)
+{
+    // Каталог CPU содержит ссылку nodeN на свой узел, если ядро собрано с NUMA
+    std::error_code error;
+    const std::filesystem::path cpu_path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    for(const auto& entry : std::filesystem::directory_iterator(cpu_path, error))
+    {
+        const std::string name = entry.path().filename().string();
+        uint32_t node = 0;
+        if(name.size() > 4 && name.compare(0, 4, "node") == 0 && CaptureConfig::parseCpu(name.substr(4), node))
+        {
+            return static_cast<int>(node);
+        }
+    }
+    return -1;
+}
+
+uint32_t CpuAffinity::getNumaNodeCount()
+{
+    // Список узлов с памятью имеет тот же формат, что и список CPU ("0-1,3")
+    static const uint32_t count = []()
+    {
+        std::ifstream file("/sys/devices/system/node/has_memory");
+        std::string line;
+        std::vector<uint32_t> nodes;
+        if(!std::getline(file, line) || !CaptureConfig::parseCpuList(line, nodes))
+        {
+            return 1U;
+        }
+        return static_cast<uint32_t>(nodes.size());
+    }();
+    return count;
+}
+
+bool CpuAffinity::bindMemory(void* memory, size_t size, int numa_node)
+{
+    if(!memory || size == 0 || numa_node < 0 || numa_node >= MAX_NUMA_NODES)
+    {
+        return false;
+    }
+    constexpr size_t BITS_PER_WORD = sizeof(unsigned long) * CHAR_BIT;
+    std::array<unsigned long, MAX_NUMA_NODES / BITS_PER_WORD> node_mask{};
+    node_mask[numa_node / BITS_PER_WORD] = 1UL << (numa_node % BITS_PER_WORD);
+
+    // Ядро читает maxnode - 1 бит маски
+    return syscall(SYS_mbind, memory, size, MPOL_PREFERRED_POLICY, node_mask.data(), MAX_NUMA_NODES + 1, 0) == 0;
+}
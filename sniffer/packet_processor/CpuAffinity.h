@@ -0,0 +1,64 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Привязка потоков к CPU и памяти к узлам NUMA
+ *
+ * Без привязки планировщик переносит потоки захвата между сокетами, и шард потоков,
+ * выделенный на одном узле, обновляется с другого: каждый промах кэша идёт через
+ * межсокетную шину. Поток привязывается к одному CPU (sched_setaffinity), а память шарда
+ * получает предпочтительный узел этого CPU (mbind(MPOL_PREFERRED)) до первой записи.
+ *
+ * Узел CPU читается из sysfs, поэтому libnuma не требуется. Все функции возвращают
+ * признак успеха: отказ ядра (CPU вне cpuset, mbind запрещён seccomp) не мешает захвату.
+ */
+class CpuAffinity
+{
+public:
+    /**
+     * @brief Привязка вызывающего потока к одному CPU
+     * @param cpu Номер CPU
+     * @return true если ядро приняло привязку
+     */
+    static bool pinCurrentThread(uint32_t cpu);
+
+    /**
+     * @brief CPU, на котором выполняется вызывающий поток
+     * @return Номер CPU (-1 - неизвестен)
+     */
+    static int getCurrentCpu();
+
+    /**
+     * @brief Узел NUMA процессора
+     * @param cpu Номер CPU
+     * @return Номер узла (-1 - ядро без NUMA или CPU не существует)
+     */
+    static int getNumaNode(uint32_t cpu);
+
+    /**
+     * @brief Количество узлов NUMA с памятью
+     * @return Количество узлов (1 - машина без NUMA)
+     */
+    static uint32_t getNumaNodeCount();
+
+    /**
+     * @brief Выделение страниц диапазона на заданном узле (mbind(MPOL_PREFERRED))
+     *
+     * Действует на страницы, которые ещё не выделены: вызывается сразу после mmap.
+     * При нехватке памяти на узле ядро берёт страницы с соседнего узла.
+     *
+     * @param memory Начало диапазона (выровнено по странице)
+     * @param size Размер диапазона в байтах
+     * @param numa_node Номер узла
+     * @return true если ядро приняло политику
+     */
+    static bool bindMemory(void* memory, size_t size, int numa_node);
+
+private:
+    static constexpr int MAX_NUMA_NODES = 1024; // Размер маски узлов для mbind
+};
+
+#endif // CPU_AFFINITY_H
@@ -0,0 +1,327 @@
+#include "PacketClassifier.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <arpa/inet.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PACKET_CLASSIFIER_X86 1
+#endif
+
+namespace
+{
+    constexpr uint32_t ETHERNET_SIZE = 14;
+    constexpr uint32_t MIN_FRAME_SIZE = ETHERNET_SIZE + 20 + 20; // Ethernet + IP + TCP без опций
+
+    uint32_t load32(const u_char* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    /**
+     * @brief Извлечение 4-tuple и размеров для кадра, прошедшего классификацию
+     * @param frame Кадр
+     * @param ip_end Смещение начала TCP заголовка (14 + IHL*4)
+     * @param packet_info Запись для результата
+     * @return false если длина TCP заголовка (doff) некорректна
+     */
+    bool extract(const RawFrame& frame, uint32_t ip_end, PacketInfo& packet_info)
+    {
+        const u_char* tcp = frame.data + ip_end;
+        const uint32_t tcp_header_size = (tcp[12] >> 4) * 4;
+        if(tcp_header_size < 20)
+        {
+            return false;
+        }
+
+        uint16_t src_port;
+        uint16_t dst_port;
+        std::memcpy(&src_port, tcp, sizeof(src_port));
+        std::memcpy(&dst_port, tcp + 2, sizeof(dst_port));
+
+        const uint32_t headers_size = ip_end + tcp_header_size;
+
+        packet_info.flow_tuple.src_ip = load32(frame.data + ETHERNET_SIZE + 12);
+        packet_info.flow_tuple.dst_ip = load32(frame.data + ETHERNET_SIZE + 16);
+        packet_info.flow_tuple.src_port = ntohs(src_port);
+        packet_info.flow_tuple.dst_port = ntohs(dst_port);
+        packet_info.packet_size = frame.packet_size;
+        packet_info.payload_size = frame.packet_size > headers_size ? frame.packet_size - headers_size : 0;
+        packet_info.timestamp = frame.timestamp;
+        packet_info.tcp_flags = tcp[13];
+        return true;
+    }
+
+#ifdef PACKET_CLASSIFIER_X86
+    // Нулевой кадр подставляется вместо слишком коротких: нулевой EtherType заведомо
+    // не проходит проверку, а чтение за пределы захваченных байт исключено
+    alignas(64) constexpr u_char ZERO_FRAME[MIN_FRAME_SIZE] = {};
+
+    /**
+     * @brief Безопасный для чтения указатель на кадр
+     * @param frames Кадры
+     * @param count Количество кадров
+     * @param i Номер кадра (может быть за пределами count в неполной группе)
+     * @return Начало кадра или нулевой кадр
+     */
+    const u_char* laneData(const RawFrame* frames, size_t count, size_t i)
+    {
+        if(i >= count)
+        {
+            return ZERO_FRAME;
+        }
+        // Выбор без ветвления: иначе компилятор подставит нули вместо чтения и получит переход
+        const auto short_frame = static_cast<uintptr_t>(frames[i].captured_size < MIN_FRAME_SIZE);
+        const auto data = reinterpret_cast<uintptr_t>(frames[i].data);
+        const auto zero = reinterpret_cast<uintptr_t>(ZERO_FRAME);
+        return reinterpret_cast<const u_char*>(data ^ ((data ^ zero) & (0 - short_frame)));
+    }
+
+    /**
+     * @brief Количество захваченных байт кадра (0 за пределами группы)
+     */
+    uint32_t laneCaptured(const RawFrame* frames, size_t count, size_t i)
+    {
+        return i < count ? frames[i].captured_size : 0;
+    }
+
+    __attribute__((target("sse4.2")))
+    uint64_t classifySse42(const RawFrame* frames, size_t count, uint32_t* ip_end, uint64_t& vlan_mask)
+    {
+        constexpr size_t LANES = 4;
+
+        const __m128i byte_mask = _mm_set1_epi32(0xFF);
+        const __m128i ethertype_ipv4 = _mm_set1_epi32(0x0008); // 0x0800 в сетевом порядке
+        const __m128i version_4 = _mm_set1_epi32(4);
+        const __m128i min_ihl = _mm_set1_epi32(4);
+        const __m128i proto_tcp = _mm_set1_epi32(IPPROTO_TCP);
+        const __m128i ip_offset = _mm_set1_epi32(ETHERNET_SIZE);
+        const __m128i tcp_size = _mm_set1_epi32(20);
+        const __m128i vlan_8100 = _mm_set1_epi32(0x0081); // 802.1Q
+        const __m128i vlan_88a8 = _mm_set1_epi32(0xA888); // 802.1ad
+        const __m128i vlan_9100 = _mm_set1_epi32(0x0091); // QinQ (устаревший)
+
+        uint64_t valid_mask = 0;
+        vlan_mask = 0;
+        for(size_t base = 0; base < count; base += LANES)
+        {
+            const size_t lanes = std::min(LANES, count - base);
+            const RawFrame* group = frames + base;
+            const u_char* d0 = laneData(group, lanes, 0);
+            const u_char* d1 = laneData(group, lanes, 1);
+            const u_char* d2 = laneData(group, lanes, 2);
+            const u_char* d3 = laneData(group, lanes, 3);
+
+            // Слово 12..15: EtherType, версия/IHL, TOS; слово 20..23: фрагмент, TTL, протокол
+            const __m128i eth = _mm_setr_epi32(static_cast<int>(load32(d0 + 12)), static_cast<int>(load32(d1 + 12)),
+                                               static_cast<int>(load32(d2 + 12)), static_cast<int>(load32(d3 + 12)));
+            const __m128i proto = _mm_setr_epi32(static_cast<int>(load32(d0 + 20)), static_cast<int>(load32(d1 + 20)),
+                                                 static_cast<int>(load32(d2 + 20)), static_cast<int>(load32(d3 + 20)));
+            const __m128i caplen = _mm_setr_epi32(static_cast<int>(laneCaptured(group, lanes, 0)),
+                                                  static_cast<int>(laneCaptured(group, lanes, 1)),
+                                                  static_cast<int>(laneCaptured(group, lanes, 2)),
+                                                  static_cast<int>(laneCaptured(group, lanes, 3)));
+
+            const __m128i vihl = _mm_and_si128(_mm_srli_epi32(eth, 16), byte_mask);
+            const __m128i ihl = _mm_and_si128(vihl, _mm_set1_epi32(0x0F));
+            const __m128i end = _mm_add_epi32(ip_offset, _mm_slli_epi32(ihl, 2));
+            const __m128i need = _mm_add_epi32(end, tcp_size);
+
+            __m128i ok = _mm_cmpeq_epi32(_mm_and_si128(eth, _mm_set1_epi32(0xFFFF)), ethertype_ipv4);
+            ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_srli_epi32(vihl, 4), version_4));
+            ok = _mm_and_si128(ok, _mm_cmpgt_epi32(ihl, min_ihl));
+            ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_srli_epi32(proto, 24), proto_tcp));
+            // Беззнаковое caplen >= need: max(caplen, need) == caplen
+            ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_max_epu32(caplen, need), caplen));
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(ip_end + base), end);
+            const auto lane_mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(ok)));
+            valid_mask |= static_cast<uint64_t>(lane_mask) << base;
+
+            // Кадры с метками VLAN разбираются скалярно: смещение IP у них не фиксировано
+            const __m128i ether_type = _mm_and_si128(eth, _mm_set1_epi32(0xFFFF));
+            __m128i vlan = _mm_or_si128(_mm_cmpeq_epi32(ether_type, vlan_8100), _mm_cmpeq_epi32(ether_type, vlan_88a8));
+            vlan = _mm_or_si128(vlan, _mm_cmpeq_epi32(ether_type, vlan_9100));
+            vlan_mask |= static_cast<uint64_t>(_mm_movemask_ps(_mm_castsi128_ps(vlan))) << base;
+        }
+        return valid_mask;
+    }
+
+    __attribute__((target("avx2")))
+    uint64_t classifyAvx2(const RawFrame* frames, size_t count, uint32_t* ip_end, uint64_t& vlan_mask)
+    {
+        constexpr size_t LANES = 8;
+
+        const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+        const __m256i ethertype_ipv4 = _mm256_set1_epi32(0x0008); // 0x0800 в сетевом порядке
+        const __m256i version_4 = _mm256_set1_epi32(4);
+        const __m256i min_ihl = _mm256_set1_epi32(4);
+        const __m256i proto_tcp = _mm256_set1_epi32(IPPROTO_TCP);
+        const __m256i ip_offset = _mm256_set1_epi32(ETHERNET_SIZE);
+        const __m256i tcp_size = _mm256_set1_epi32(20);
+        const __m256i vlan_8100 = _mm256_set1_epi32(0x0081); // 802.1Q
+        const __m256i vlan_88a8 = _mm256_set1_epi32(0xA888); // 802.1ad
+        const __m256i vlan_9100 = _mm256_set1_epi32(0x0091); // QinQ (устаревший)
+
+        uint64_t valid_mask = 0;
+        vlan_mask = 0;
+        for(size_t base = 0; base < count; base += LANES)
+        {
+            const size_t lanes = std::min(LANES, count - base);
+            const RawFrame* group = frames + base;
+            const u_char* d0 = laneData(group, lanes, 0);
+            const u_char* d1 = laneData(group, lanes, 1);
+            const u_char* d2 = laneData(group, lanes, 2);
+            const u_char* d3 = laneData(group, lanes, 3);
+            const u_char* d4 = laneData(group, lanes, 4);
+            const u_char* d5 = laneData(group, lanes, 5);
+            const u_char* d6 = laneData(group, lanes, 6);
+            const u_char* d7 = laneData(group, lanes, 7);
+
+            // Слово 12..15: EtherType, версия/IHL, TOS; слово 20..23: фрагмент, TTL, протокол
+            const __m256i eth = _mm256_setr_epi32(
+                static_cast<int>(load32(d0 + 12)), static_cast<int>(load32(d1 + 12)),
+                static_cast<int>(load32(d2 + 12)), static_cast<int>(load32(d3 + 12)),
+                static_cast<int>(load32(d4 + 12)), static_cast<int>(load32(d5 + 12)),
+                static_cast<int>(load32(d6 + 12)), static_cast<int>(load32(d7 + 12)));
+            const __m256i proto = _mm256_setr_epi32(
+                static_cast<int>(load32(d0 + 20)), static_cast<int>(load32(d1 + 20)),
+                static_cast<int>(load32(d2 + 20)), static_cast<int>(load32(d3 + 20)),
+                static_cast<int>(load32(d4 + 20)), static_cast<int>(load32(d5 + 20)),
+                static_cast<int>(load32(d6 + 20)), static_cast<int>(load32(d7 + 20)));
+            const __m256i caplen = _mm256_setr_epi32(
+                static_cast<int>(laneCaptured(group, lanes, 0)), static_cast<int>(laneCaptured(group, lanes, 1)),
+                static_cast<int>(laneCaptured(group, lanes, 2)), static_cast<int>(laneCaptured(group, lanes, 3)),
+                static_cast<int>(laneCaptured(group, lanes, 4)), static_cast<int>(laneCaptured(group, lanes, 5)),
+                static_cast<int>(laneCaptured(group, lanes, 6)), static_cast<int>(laneCaptured(group, lanes, 7)));
+
+            const __m256i vihl = _mm256_and_si256(_mm256_srli_epi32(eth, 16), byte_mask);
+            const __m256i ihl = _mm256_and_si256(vihl, _mm256_set1_epi32(0x0F));
+            const __m256i end = _mm256_add_epi32(ip_offset, _mm256_slli_epi32(ihl, 2));
+            const __m256i need = _mm256_add_epi32(end, tcp_size);
+
+            __m256i ok = _mm256_cmpeq_epi32(_mm256_and_si256(eth, _mm256_set1_epi32(0xFFFF)), ethertype_ipv4);
+            ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_srli_epi32(vihl, 4), version_4));
+            ok = _mm256_and_si256(ok, _mm256_cmpgt_epi32(ihl, min_ihl));
+            ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_srli_epi32(proto, 24), proto_tcp));
+            // Беззнаковое caplen >= need: max(caplen, need) == caplen
+            ok = _mm256_and_si256(ok, _mm256_cmpeq_epi32(_mm256_max_epu32(caplen, need), caplen));
+
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(ip_end + base), end);
+            const auto lane_mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(ok)));
+            valid_mask |= static_cast<uint64_t>(lane_mask) << base;
+
+            // Кадры с метками VLAN разбираются скалярно: смещение IP у них не фиксировано
+            const __m256i ether_type = _mm256_and_si256(eth, _mm256_set1_epi32(0xFFFF));
+            __m256i vlan = _mm256_or_si256(_mm256_cmpeq_epi32(ether_type, vlan_8100), _mm256_cmpeq_epi32(ether_type, vlan_88a8));
+            vlan = _mm256_or_si256(vlan, _mm256_cmpeq_epi32(ether_type, vlan_9100));
+            vlan_mask |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(vlan))) << base;
+        }
+        return valid_mask;
+    }
+#endif
+
+    ClassifierImpl detectImpl()
+    {
+        if(PacketClassifier::isSupported(ClassifierImpl::Avx2))
+        {
+            return ClassifierImpl::Avx2;
+        }
+        if(PacketClassifier::isSupported(ClassifierImpl::Sse42))
+        {
+            return ClassifierImpl::Sse42;
+        }
+        return ClassifierImpl::Scalar;
+    }
+}
+
+uint64_t PacketClassifier::classifyBatch(std::span<const RawFrame> frames, std::span<PacketInfo> packet_infos) noexcept
+{
+    return classifyBatch(getActiveImpl(), frames, packet_infos);
+}
+
+uint64_t PacketClassifier::classifyBatch(ClassifierImpl impl, std::span<const RawFrame> frames,
+                                         std::span<PacketInfo> packet_infos) noexcept
+{
+    const size_t count = std::min({frames.size(), packet_infos.size(), PacketParser::MAX_BATCH});
+
+    // Первый проход только классифицирует кадры в векторных регистрах, второй извлекает
+    // 4-tuple из прошедших: так векторный код не перемежается скалярными вызовами
+    alignas(32) uint32_t ip_end[PacketParser::MAX_BATCH + 8];
+    uint64_t valid_mask;
+    uint64_t vlan_mask;
+
+    switch(impl)
+    {
+#ifdef PACKET_CLASSIFIER_X86
+        case ClassifierImpl::Avx2:
+            valid_mask = classifyAvx2(frames.data(), count, ip_end, vlan_mask);
+            break;
+        case ClassifierImpl::Sse42:
+            valid_mask = classifySse42(frames.data(), count, ip_end, vlan_mask);
+            break;
+#endif
+        default:
+            return PacketParser::parseBatch(frames.first(count), packet_infos.first(count));
+    }
+
+    for(uint64_t pending = valid_mask; pending; pending &= pending - 1)
+    {
+        const int i = std::countr_zero(pending);
+        if(!extract(frames[i], ip_end[i], packet_infos[i]))
+        {
+            valid_mask &= ~(1ULL << i);
+        }
+    }
+
+    for(uint64_t pending = vlan_mask; pending; pending &= pending - 1)
+    {
+        const int i = std::countr_zero(pending);
+        const RawFrame& frame = frames[i];
+        if(PacketParser::parseInto(frame.data, frame.captured_size, frame.packet_size, frame.timestamp,
+                                   packet_infos[i]))
+        {
+            valid_mask |= 1ULL << i;
+        }
+    }
+    return valid_mask;
+}
+
+ClassifierImpl PacketClassifier::getActiveImpl()
+{
+    static const ClassifierImpl impl = detectImpl();
+    return impl;
+}
+
+bool PacketClassifier::isSupported(ClassifierImpl impl)
+{
+    switch(impl)
+    {
+#ifdef PACKET_CLASSIFIER_X86
+        case ClassifierImpl::Avx2:
+            return __builtin_cpu_supports("avx2");
+        case ClassifierImpl::Sse42:
+            return __builtin_cpu_supports("sse4.2");
+#endif
+        case ClassifierImpl::Scalar:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::string PacketClassifier::implToString(ClassifierImpl impl)
+{
+    switch(impl)
+    {
+        case ClassifierImpl::Avx2:
+            return "avx2";
+        case ClassifierImpl::Sse42:
+            return "sse4.2";
+        default:
+            return "scalar";
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef PACKET_CLASSIFIER_H
+#define PACKET_CLASSIFIER_H
+
+#include <span>
+#include <string>
+#include <cstdint>
+#include "PacketParser.h"
+
+/**
+ * @brief Реализация классификатора пачек
+ */
+enum class ClassifierImpl
+{
+    Scalar, ///< Поэлементный разбор PacketParser::parseInto
+    Sse42, ///< 4 кадра за шаг в 128-битных регистрах
+    Avx2 ///< 8 кадров за шаг в 256-битных регистрах
+};
+
+/**
+ * @brief Векторная классификация пачки Ethernet кадров и извлечение 4-tuple
+ *
+ * Байты по фиксированным смещениям (EtherType, версия/IHL, протокол) собираются
+ * из 4-8 кадров в один вектор и сравниваются одной инструкцией; 4-tuple и размеры
+ * извлекаются только для кадров, прошедших классификацию. Кадры с метками VLAN
+ * отмечаются отдельной маской и разбираются скалярно. Результат полностью
+ * совпадает с PacketParser::parseBatch. Реализация выбирается один раз по
+ * возможностям процессора.
+ */
+class PacketClassifier
+{
+public:
+    /**
+     * @brief Классификация пачки реализацией, выбранной при запуске
+     * @param frames Кадры (не более PacketParser::MAX_BATCH)
+     * @param packet_infos Записи для результатов, по одной на кадр
+     * @return Битовая маска: бит i установлен, если packet_infos[i] заполнен
+     */
+    static uint64_t classifyBatch(std::span<const RawFrame> frames, std::span<PacketInfo> packet_infos) noexcept;
+
+    /**
+     * @brief Классификация пачки заданной реализацией
+     * @param impl Реализация (должна поддерживаться процессором)
+     * @param frames Кадры (не более PacketParser::MAX_BATCH)
+     * @param packet_infos Записи для результатов, по одной на кадр
+     * @return Битовая маска заполненных записей
+     */
+    static uint64_t classifyBatch(ClassifierImpl impl, std::span<const RawFrame> frames,
+                                  std::span<PacketInfo> packet_infos) noexcept;
+
+    /**
+     * @brief Реализация, выбранная по возможностям процессора
+     * @return Самая быстрая поддерживаемая реализация
+     */
+    static ClassifierImpl getActiveImpl();
+
+    /**
+     * @brief Проверка поддержки реализации процессором
+     * @param impl Реализация
+     * @return true если реализацию можно использовать
+     */
+    static bool isSupported(ClassifierImpl impl);
+
+    /**
+     * @brief Название реализации
+     * @param impl Реализация
+     * @return Строковое название (scalar, sse4.2, avx2)
+     */
+    static std::string implToString(ClassifierImpl impl);
+};
+
+#endif // PACKET_CLASSIFIER_H
@@ -1,117 +1,277 @@
 #include "PacketParser.h"
 #include <arpa/inet.h>
+#include <algorithm>
 #include <cstring>
-#include <iostream>
 #include <netinet/tcp.h>
 #include <net/ethernet.h>
 
+uint64_t FlowTupleHash::operator()(const FlowTuple& flow_tuple) const noexcept
+{
+    // Перемешивание в стиле splitmix64 по адресам и портам
+    uint64_t h = (static_cast<uint64_t>(flow_tuple.src_ip) << 32 | flow_tuple.dst_ip) * 0x9E3779B97F4A7C15ULL;
+    h ^= (static_cast<uint64_t>(flow_tuple.src_port) << 16 | flow_tuple.dst_port) + (h >> 29);
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return h;
+}
+
 std::unique_ptr<PacketInfo> PacketParser::parsePacket(const u_char* packet, uint32_t packet_size, uint64_t timestamp)
 {
-    try
+    return parsePacket(packet, packet_size, packet_size, timestamp);
+}
+
+std::unique_ptr<PacketInfo> PacketParser::parsePacket(const u_char* packet, uint32_t captured_size,
+                                                      uint32_t packet_size, uint64_t timestamp)
+{
+    auto packet_info = std::make_unique<PacketInfo>();
+    if(!parseInto(packet, captured_size, packet_size, timestamp, *packet_info))
     {
-        // Проверяем минимальный размер пакета (Ethernet + IP + TCP заголовки)
-        if(packet_size < sizeof(struct ether_header) + sizeof(struct iphdr) + sizeof(struct tcphdr))
+        return nullptr;
+    }
+    return packet_info;
+}
+
+namespace
+{
+    // Значения DLT из pcap/dlt.h; PacketParser не зависит от заголовков libpcap
+    constexpr int DLT_ETHERNET = 1; // DLT_EN10MB
+    constexpr int DLT_RAW_IP = 12; // DLT_RAW в Linux
+    constexpr int DLT_RAW_IP_FILE = 101; // LINKTYPE_RAW в заголовке файла
+    constexpr int DLT_COOKED = 113; // DLT_LINUX_SLL
+    constexpr int DLT_IPV4_ONLY = 228; // DLT_IPV4
+    constexpr int DLT_COOKED_V2 = 276; // DLT_LINUX_SLL2
+
+    constexpr uint32_t ETHERNET_SIZE = sizeof(struct ether_header);
+    constexpr uint32_t VLAN_TAG_SIZE = 4;
+    constexpr uint32_t SLL_SIZE = 16;
+    constexpr uint32_t SLL_PROTOCOL_OFFSET = 14;
+    constexpr uint32_t SLL2_SIZE = 20;
+    constexpr uint32_t SLL2_PROTOCOL_OFFSET = 0;
+
+    uint16_t loadProtocol(const u_char* data)
+    {
+        uint16_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    bool isVlanProtocol(uint16_t protocol)
+    {
+        return protocol == htons(ETHERTYPE_VLAN) || protocol == htons(0x88A8) || protocol == htons(0x9100);
+    }
+
+    /**
+     * @brief Разбор IPv4 и TCP заголовков, общий для всех типов канального уровня
+     * @param packet Указатель на данные пакета
+     * @param ip_offset Смещение IP заголовка от начала кадра
+     * @param captured_size Количество захваченных байт (caplen)
+     * @param packet_size Исходный размер пакета (len)
+     * @param timestamp Временная метка пакета
+     * @param packet_info Запись для результата
+     * @return ParseResult::Ok или причина отбраковки кадра
+     */
+    inline ParseResult parseIpv4(const u_char* packet, uint32_t ip_offset, uint32_t captured_size,
+                                 uint32_t packet_size, uint64_t timestamp, PacketInfo& packet_info)
+    {
+        if(captured_size < ip_offset + sizeof(struct iphdr) + sizeof(struct tcphdr))
+        {
+            return ParseResult::ShortFrame;
+        }
+
+        // Проверяем версию IP, протокол и длину заголовка
+        const auto* ip_header = reinterpret_cast<const struct iphdr*>(packet + ip_offset);
+        const uint32_t ip_header_size = ip_header->ihl * 4;
+        if(ip_header->version != 4)
         {
-            return nullptr;
+            return ParseResult::NotIpv4;
+        }
+        if(ip_header->protocol != IPPROTO_TCP)
+        {
+            return ParseResult::NotTcp;
+        }
+        if(ip_header_size < sizeof(struct iphdr))
+        {
+            return ParseResult::BadHeader;
         }
 
-        // Извлекаем 4-tuple
-        FlowTuple flow_tuple = extractFlowTuple(packet, packet_size);
+        // TCP заголовок должен целиком помещаться в захваченные байты
+        if(captured_size < ip_offset + ip_header_size + sizeof(struct tcphdr))
+        {
+            return ParseResult::ShortFrame;
+        }
 
-        // Вычисляем размеры
-        uint32_t ethernet_size = sizeof(struct ether_header);
-        const auto* ip_header = reinterpret_cast<const struct iphdr*>(packet + ethernet_size);
-        uint32_t ip_header_size = (ip_header->ihl & 0x0F) * 4;
+        const auto* tcp_header = reinterpret_cast<const struct tcphdr*>(packet + ip_offset + ip_header_size);
+        const uint32_t tcp_header_size = tcp_header->doff * 4;
+        if(tcp_header_size < sizeof(struct tcphdr))
+        {
+            return ParseResult::BadHeader;
+        }
 
-        const auto* tcp_header = reinterpret_cast<const struct tcphdr*>(
-            packet + ethernet_size + ip_header_size);
-        uint32_t tcp_header_size = ((tcp_header->doff & 0xF0) >> 4) * 4;
+        // Размер полезной нагрузки считается по исходной длине пакета, а не по захваченной части
+        const uint32_t headers_size = ip_offset + ip_header_size + tcp_header_size;
 
-        uint32_t payload_size = packet_size - ethernet_size - ip_header_size - tcp_header_size;
+        packet_info.flow_tuple.src_ip = ip_header->saddr;
+        packet_info.flow_tuple.dst_ip = ip_header->daddr;
+        packet_info.flow_tuple.src_port = ntohs(tcp_header->source);
+        packet_info.flow_tuple.dst_port = ntohs(tcp_header->dest);
+        packet_info.packet_size = packet_size;
+        packet_info.payload_size = packet_size > headers_size ? packet_size - headers_size : 0;
+        packet_info.tcp_flags = reinterpret_cast<const uint8_t*>(tcp_header)[13];
+        packet_info.timestamp = timestamp;
+        return ParseResult::Ok;
+    }
+}
 
-        auto packet_info = std::make_unique<PacketInfo>();
-        packet_info->flow_tuple = flow_tuple;
-        packet_info->packet_size = packet_size;
-        packet_info->payload_size = payload_size;
-        packet_info->timestamp = timestamp;
+bool PacketParser::parseInto(const u_char* packet, uint32_t captured_size, uint32_t packet_size,
+                             uint64_t timestamp, PacketInfo& packet_info) noexcept
+{
+    return parseLink<LinkType::Ethernet>(packet, captured_size, packet_size, timestamp, packet_info) ==
+        ParseResult::Ok;
+}
 
-        return packet_info;
+template<LinkType LINK>
+ParseResult PacketParser::parseLink(const u_char* packet, uint32_t captured_size, uint32_t packet_size,
+                                    uint64_t timestamp, PacketInfo& packet_info) noexcept
+{
+    if constexpr(LINK == LinkType::Ethernet)
+    {
+        if(captured_size < ETHERNET_SIZE)
+        {
+            return ParseResult::ShortFrame;
+        }
+
+        uint32_t ip_offset = ETHERNET_SIZE;
+        uint16_t ether_type = loadProtocol(packet + ETHERNET_SIZE - 2);
+        for(size_t tag = 0; tag < MAX_VLAN_TAGS && isVlanProtocol(ether_type); ++tag)
+        {
+            if(captured_size < ip_offset + VLAN_TAG_SIZE)
+            {
+                return ParseResult::ShortFrame;
+            }
+            ip_offset += VLAN_TAG_SIZE;
+            ether_type = loadProtocol(packet + ip_offset - 2);
+        }
+
+        // Проверяем тип Ethernet кадра (IPv4 = 0x0800)
+        if(ether_type != htons(ETHERTYPE_IP))
+        {
+            return ParseResult::NotIpv4;
+        }
+        return parseIpv4(packet, ip_offset, captured_size, packet_size, timestamp, packet_info);
     }
-    catch(const std::exception& e)
+    else if constexpr(LINK == LinkType::LinuxSll || LINK == LinkType::LinuxSll2)
     {
-        std::cerr << "[error] Ошибка при парсинге пакета: " << e.what() << "\n";
-        return nullptr;
+        constexpr uint32_t header_size = LINK == LinkType::LinuxSll ? SLL_SIZE : SLL2_SIZE;
+        constexpr uint32_t protocol_offset = LINK == LinkType::LinuxSll ? SLL_PROTOCOL_OFFSET : SLL2_PROTOCOL_OFFSET;
+        if(captured_size < header_size)
+        {
+            return ParseResult::ShortFrame;
+        }
+        if(loadProtocol(packet + protocol_offset) != htons(ETHERTYPE_IP))
+        {
+            return ParseResult::NotIpv4;
+        }
+        return parseIpv4(packet, header_size, captured_size, packet_size, timestamp, packet_info);
+    }
+    else
+    {
+        // Версия IP проверяется в parseIpv4, IPv6 отбрасывается там же
+        return parseIpv4(packet, 0, captured_size, packet_size, timestamp, packet_info);
     }
 }
 
-bool PacketParser::isTcpIpv4Packet(const u_char* packet, uint32_t packet_size)
+template ParseResult PacketParser::parseLink<LinkType::Ethernet>(const u_char*, uint32_t, uint32_t, uint64_t,
+                                                                 PacketInfo&) noexcept;
+template ParseResult PacketParser::parseLink<LinkType::LinuxSll>(const u_char*, uint32_t, uint32_t, uint64_t,
+                                                                 PacketInfo&) noexcept;
+template ParseResult PacketParser::parseLink<LinkType::LinuxSll2>(const u_char*, uint32_t, uint32_t, uint64_t,
+                                                                  PacketInfo&) noexcept;
+template ParseResult PacketParser::parseLink<LinkType::RawIp>(const u_char*, uint32_t, uint32_t, uint64_t,
+                                                              PacketInfo&) noexcept;
+
+PacketParser::ParseFunction PacketParser::getParseFunction(LinkType link_type)
 {
-    static int total_checked = 0;
-    static int size_failed = 0;
-    static int ether_type_failed = 0;
-    static int protocol_failed = 0;
+    switch(link_type)
+    {
+        case LinkType::LinuxSll:
+            return &parseLink<LinkType::LinuxSll>;
+        case LinkType::LinuxSll2:
+            return &parseLink<LinkType::LinuxSll2>;
+        case LinkType::RawIp:
+            return &parseLink<LinkType::RawIp>;
+        default:
+            return &parseLink<LinkType::Ethernet>;
+    }
+}
 
-    total_checked++;
+std::optional<LinkType> PacketParser::linkTypeFromDlt(int dlt)
+{
+    switch(dlt)
+    {
+        case DLT_ETHERNET:
+            return LinkType::Ethernet;
+        case DLT_COOKED:
+            return LinkType::LinuxSll;
+        case DLT_COOKED_V2:
+            return LinkType::LinuxSll2;
+        case DLT_RAW_IP:
+        case DLT_RAW_IP_FILE:
+        case DLT_IPV4_ONLY:
+            return LinkType::RawIp;
+        default:
+            return std::nullopt;
+    }
+}
 
-    // Проверяем минимальный размер
-    if(packet_size < sizeof(struct ether_header) + sizeof(struct iphdr))
+std::string PacketParser::linkTypeToString(LinkType link_type)
+{
+    switch(link_type)
     {
-        size_failed++;
-        if(size_failed % 100 == 0)
-        {
-            std::cout << "[debug] Проверок размера пакета: " << size_failed << "/" << total_checked << "\n";
-        }
-        return false;
+        case LinkType::LinuxSll:
+            return "sll";
+        case LinkType::LinuxSll2:
+            return "sll2";
+        case LinkType::RawIp:
+            return "raw";
+        default:
+            return "ethernet";
     }
+}
 
-    // Проверяем тип Ethernet кадра (IPv4 = 0x0800)
-    const auto* eth_header = reinterpret_cast<const struct ether_header*>(packet);
-    uint16_t ether_type = ntohs(eth_header->ether_type);
-    if(ether_type != ETHERTYPE_IP)
+uint64_t PacketParser::parseBatch(std::span<const RawFrame> frames, std::span<PacketInfo> packet_infos) noexcept
+{
+    const size_t count = std::min({frames.size(), packet_infos.size(), MAX_BATCH});
+
+    uint64_t valid_mask = 0;
+    for(size_t i = 0; i < count; ++i)
     {
-        ether_type_failed++;
-        if(ether_type_failed % 50 == 0)
+        const RawFrame& frame = frames[i];
+        if(parseInto(frame.data, frame.captured_size, frame.packet_size, frame.timestamp, packet_infos[i]))
         {
-            // std::cout << "[debug] Неверный тип Ethernet: " << std::hex << ether_type
-            //     << " (ожидалось: " << ETHERTYPE_IP << "), всего: " << ether_type_failed << "/" << total_checked << "\n";
-
-            // Дополнительная отладочная информация для первых нескольких пакетов
-            if(ether_type_failed <= 3)
-            {
-                // std::cout << "[debug] Первые 16 байт пакета: ";
-                // for(uint32_t i = 0; i < 16 && i < packet_size; i++)
-                // {
-                //     std::cout << std::hex << (int)packet[i] << " ";
-                // }
-                // std::cout << std::dec << "\n";
-
-                // std::cout << "[debug] Ethernet тип: " << std::hex << ether_type << std::dec << "\n";
-                // std::cout << "[debug] Размер пакета: " << packet_size << "\n";
-            }
+            valid_mask |= 1ULL << i;
         }
-        return false;
     }
+    return valid_mask;
+}
 
-    // Проверяем версию IP (IPv4 = 4)
-    const auto* ip_header = reinterpret_cast<const struct iphdr*>(packet + sizeof(struct ether_header));
-    if(ip_header->version != 4)
+bool PacketParser::isTcpIpv4Packet(const u_char* packet, uint32_t packet_size)
+{
+    // Проверяем минимальный размер
+    if(packet_size < sizeof(struct ether_header) + sizeof(struct iphdr))
     {
         return false;
     }
 
-    // Проверяем протокол (TCP = 6)
-    if(ip_header->protocol != IPPROTO_TCP)
+    // Проверяем тип Ethernet кадра (IPv4 = 0x0800)
+    const auto* eth_header = reinterpret_cast<const struct ether_header*>(packet);
+    if(eth_header->ether_type != htons(ETHERTYPE_IP))
     {
-        protocol_failed++;
-        if(protocol_failed % 50 == 0)
-        {
-            // std::cout << "[debug] Неверный протокол: " << (int)ip_header->protocol
-            //     << " (ожидалось: " << IPPROTO_TCP << "), всего: " << protocol_failed << "/" << total_checked << "\n";
-        }
         return false;
     }
 
-    return true;
+    // Проверяем версию IP (IPv4 = 4) и протокол (TCP = 6)
+    const auto* ip_header = reinterpret_cast<const struct iphdr*>(packet + sizeof(struct ether_header));
+    return ip_header->version == 4 && ip_header->protocol == IPPROTO_TCP;
 }
 
 std::string PacketParser::ipToString(uint32_t ip)
@@ -120,32 +280,3 @@ std::string PacketParser::ipToString(uint32_t ip)
     addr.s_addr = ip;
     return inet_ntoa(addr);
 }
-
-FlowTuple PacketParser::extractFlowTuple(const u_char* packet, uint32_t packet_size)
-{
-    (void)packet_size; // Подавляем предупреждение о неиспользуемом параметре
-    // Пропускаем Ethernet заголовок
-    const auto* ip_header = reinterpret_cast<const struct iphdr*>(
-        packet + sizeof(struct ether_header));
-
-    // Получаем IP адреса
-    uint32_t src_ip = ip_header->saddr;
-    uint32_t dst_ip = ip_header->daddr;
-
-    // Вычисляем смещение к TCP заголовку
-    uint32_t ip_header_size = (ip_header->ihl & 0x0F) * 4;
-    const auto* tcp_header = reinterpret_cast<const struct tcphdr*>(
-        packet + sizeof(struct ether_header) + ip_header_size);
-
-    // Получаем порты
-    uint16_t src_port = ntohs(tcp_header->source);
-    uint16_t dst_port = ntohs(tcp_header->dest);
-
-    FlowTuple flow_tuple{};
-    flow_tuple.src_ip = src_ip;
-    flow_tuple.dst_ip = dst_ip;
-    flow_tuple.src_port = src_port;
-    flow_tuple.dst_port = dst_port;
-
-    return flow_tuple;
-}
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <memory>
+#include <optional>
+#include <span>
 #include <netinet/ip.h>
 
 
@@ -37,6 +39,27 @@ struct FlowTuple
     }
 };
 
+/**
+ * @brief Хеш-функция для FlowTuple
+ */
+struct FlowTupleHash
+{
+    /**
+     * @brief Вычисление хеша 4-tuple
+     * @param flow_tuple 4-tuple потока
+     * @return 64-битный хеш
+     */
+    uint64_t operator()(const FlowTuple& flow_tuple) const noexcept;
+};
+
+/**
+ * @brief Флаги TCP заголовка (байт 13), используемые трекером потоков
+ */
+static constexpr uint8_t TCP_FLAG_FIN = 0x01;
+static constexpr uint8_t TCP_FLAG_SYN = 0x02;
+static constexpr uint8_t TCP_FLAG_RST = 0x04;
+static constexpr uint8_t TCP_FLAG_ACK = 0x10;
+
 /**
  * @brief Структура для хранения информации о пакете
  */
@@ -45,15 +68,58 @@ struct PacketInfo
     FlowTuple flow_tuple;
     uint32_t packet_size; // Размер пакета на уровне Ethernet
     uint32_t payload_size; // Размер полезной нагрузки TCP
+    uint8_t tcp_flags; // Флаги TCP (TCP_FLAG_*), занимают выравнивание перед timestamp
+    uint64_t timestamp; // Временная метка в микросекундах
+};
+
+/**
+ * @brief Кадр, ожидающий разбора (данные не копируются)
+ */
+struct RawFrame
+{
+    const u_char* data; // Указатель на начало кадра
+    uint32_t captured_size; // Количество захваченных байт (caplen)
+    uint32_t packet_size; // Исходный размер кадра (len)
     uint64_t timestamp; // Временная метка в микросекундах
 };
 
+/**
+ * @brief Результат разбора кадра (причина отбраковки)
+ */
+enum class ParseResult : uint8_t
+{
+    Ok, ///< TCP/IPv4 пакет разобран
+    ShortFrame, ///< Заголовки не помещаются в захваченные байты
+    NotIpv4, ///< Протокол канального уровня или версия IP не IPv4
+    NotTcp, ///< Протокол IP не TCP
+    BadHeader ///< Некорректная длина заголовка IP (IHL) или TCP (doff)
+};
+
+static constexpr size_t PARSE_RESULT_COUNT = 5;
+
+/**
+ * @brief Тип канального уровня захвата
+ */
+enum class LinkType
+{
+    Ethernet, ///< Ethernet II, в том числе с одной или двумя метками 802.1Q/802.1ad
+    LinuxSll, ///< Linux cooked capture v1 (интерфейс any), заголовок 16 байт
+    LinuxSll2, ///< Linux cooked capture v2, заголовок 20 байт
+    RawIp ///< IP пакет без заголовка канального уровня
+};
+
 /**
  * @brief Класс для парсинга сетевых пакетов
  */
 class PacketParser
 {
 public:
+    /**
+     * @brief Функция однопроходного разбора кадра для конкретного типа канального уровня
+     */
+    using ParseFunction = ParseResult (*)(const u_char* packet, uint32_t captured_size, uint32_t packet_size,
+                                          uint64_t timestamp, PacketInfo& packet_info) noexcept;
+
     /**
      * @brief Конструктор
      */
@@ -73,6 +139,84 @@ public:
      */
     static std::unique_ptr<PacketInfo> parsePacket(const u_char* packet, uint32_t packet_size, uint64_t timestamp);
 
+    /**
+     * @brief Парсинг пакета, захваченного не целиком (snaplen)
+     *
+     * Заголовки читаются только в пределах захваченных байт, размеры пакета
+     * и полезной нагрузки вычисляются по исходной длине пакета.
+     *
+     * @param packet Указатель на данные пакета
+     * @param captured_size Количество захваченных байт (caplen)
+     * @param packet_size Исходный размер пакета (len)
+     * @param timestamp Временная метка пакета
+     * @return Информация о пакете или nullptr если парсинг не удался
+     */
+    static std::unique_ptr<PacketInfo> parsePacket(const u_char* packet, uint32_t captured_size,
+                                                   uint32_t packet_size, uint64_t timestamp);
+
+    /**
+     * @brief Однопроходный разбор кадра в запись, принадлежащую вызывающему
+     *
+     * Проверка TCP/IPv4, извлечение 4-tuple и вычисление размеров выполняются
+     * за один обход заголовков, без выделения памяти и исключений.
+     *
+     * @param packet Указатель на данные пакета
+     * @param captured_size Количество захваченных байт (caplen)
+     * @param packet_size Исходный размер пакета (len)
+     * @param timestamp Временная метка пакета
+     * @param packet_info Запись для результата (заполняется только при успехе)
+     * @return true если пакет TCP/IPv4 и его заголовки захвачены целиком
+     */
+    static bool parseInto(const u_char* packet, uint32_t captured_size, uint32_t packet_size,
+                          uint64_t timestamp, PacketInfo& packet_info) noexcept;
+
+    /**
+     * @brief Однопроходный разбор кадра, специализированный по типу канального уровня
+     *
+     * Смещение IP заголовка известно на этапе компиляции (кроме меток VLAN),
+     * поэтому в цикле захвата нет ветвлений по типу канала.
+     *
+     * @tparam LINK Тип канального уровня
+     * @param packet Указатель на данные пакета
+     * @param captured_size Количество захваченных байт (caplen)
+     * @param packet_size Исходный размер пакета (len)
+     * @param timestamp Временная метка пакета
+     * @param packet_info Запись для результата (заполняется только при успехе)
+     * @return ParseResult::Ok или причина отбраковки кадра
+     */
+    template<LinkType LINK>
+    static ParseResult parseLink(const u_char* packet, uint32_t captured_size, uint32_t packet_size,
+                                 uint64_t timestamp, PacketInfo& packet_info) noexcept;
+
+    /**
+     * @brief Получение функции разбора для типа канального уровня
+     * @param link_type Тип канального уровня
+     * @return Специализированная функция разбора
+     */
+    static ParseFunction getParseFunction(LinkType link_type);
+
+    /**
+     * @brief Определение типа канального уровня по значению DLT libpcap
+     * @param dlt Значение pcap_datalink()
+     * @return Тип канального уровня или std::nullopt, если тип не поддерживается
+     */
+    static std::optional<LinkType> linkTypeFromDlt(int dlt);
+
+    /**
+     * @brief Название типа канального уровня
+     * @param link_type Тип канального уровня
+     * @return Строковое название (ethernet, sll, sll2, raw)
+     */
+    static std::string linkTypeToString(LinkType link_type);
+
+    /**
+     * @brief Разбор пачки кадров
+     * @param frames Кадры (не более MAX_BATCH)
+     * @param packet_infos Записи для результатов, по одной на кадр
+     * @return Битовая маска: бит i установлен, если packet_infos[i] заполнен
+     */
+    static uint64_t parseBatch(std::span<const RawFrame> frames, std::span<PacketInfo> packet_infos) noexcept;
+
     /**
      * @brief Проверка является ли пакет TCP/IPv4
      * @param packet Указатель на данные пакета
@@ -88,14 +232,8 @@ public:
      */
     static std::string ipToString(uint32_t ip);
 
-private:
-    /**
-     * @brief Извлечение 4-tuple из TCP/IP пакета
-     * @param packet Указатель на данные пакета
-     * @param packet_size Размер пакета
-     * @return 4-tuple потока
-     */
-    static FlowTuple extractFlowTuple(const u_char* packet, uint32_t packet_size);
+    static constexpr size_t MAX_BATCH = 64; // Максимальный размер пачки (по числу бит маски)
+    static constexpr size_t MAX_VLAN_TAGS = 2; // Метки 802.1Q/802.1ad (QinQ) перед EtherType
 };
 
 #endif // PACKET_PARSER_H
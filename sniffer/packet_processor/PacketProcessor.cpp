@@ -1,19 +1,51 @@
 #include "PacketProcessor.h"
+#include "PacketClassifier.h"
+#include "CpuAffinity.h"
 #include "../flow_tracker/FlowTracker.h"
+#include "../flow_tracker/FlowCache.h"
 #include "../statistics/StatisticsManager.h"
 #include "../logging/LogManager.h"
 #include <iostream>
+#include <algorithm>
+#include <bit>
 #include <cstring>
-#include <chrono>
+#include <span>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
-PacketProcessor::PacketProcessor(std::string interface, FlowTracker& flow_tracker,
+PacketProcessor::PacketProcessor(CaptureConfig config, FlowTracker& flow_tracker,
                                  StatisticsManager& stats_manager)
-    : m_interface(std::move(interface))
+    : m_config(std::move(config))
       , m_flow_tracker(flow_tracker)
       , m_stats_manager(stats_manager)
+      , m_stream_clock(stats_manager.getStreamClock())
       , m_pcap_handle(nullptr)
+      , m_epoll_fd(-1)
+      , m_wakeup_fd(-1)
       , m_running(false)
+      , m_finished(false)
+      , m_replay_first_time(0)
+      , m_link_type(LinkType::Ethernet)
+      , m_parse_function(PacketParser::getParseFunction(LinkType::Ethernet))
+      , m_nanosecond_timestamps(false)
+      , m_flow_cache(m_config.flow_cache != 0 && !flow_tracker.isApproximate()
+                         ? std::make_unique<FlowCache>(m_config.flow_cache)
+                         : nullptr)
+      , m_batch{}
+      , m_batch_size(0)
+      , m_record_ring(m_config.pipeline_ring != 0 ? std::make_unique<SpscRing<PacketRecord>>(m_config.pipeline_ring,
+                                                                                            m_config.huge_pages,
+                                                                                            flow_tracker.getNumaNode())
+                                                  : nullptr)
+      , m_records{}
+      , m_producer_done(false)
 {
+    if(m_record_ring)
+    {
+        m_capture_counters.setRingCapacity(m_record_ring->capacity());
+    }
 }
 
 PacketProcessor::~PacketProcessor()
@@ -23,6 +55,14 @@ PacketProcessor::~PacketProcessor()
     {
         pcap_close(m_pcap_handle);
     }
+    if(m_epoll_fd >= 0)
+    {
+        close(m_epoll_fd);
+    }
+    if(m_wakeup_fd >= 0)
+    {
+        close(m_wakeup_fd);
+    }
 }
 
 void PacketProcessor::start()
@@ -32,12 +72,32 @@ void PacketProcessor::start()
         return;
     }
 
-    if(!initializePcap())
+    if(m_config.isOffline())
+    {
+        if(!initializeOffline())
+        {
+            throw std::runtime_error("Не удалось открыть файл pcap");
+        }
+    }
+    else if(m_config.backend == CaptureBackend::TpacketV3)
+    {
+        if(!initializeRing())
+        {
+            throw std::runtime_error("Не удалось инициализировать кольцо TPACKET_V3");
+        }
+    }
+    else if(!initializePcap())
     {
         throw std::runtime_error("Не удалось инициализировать libpcap");
     }
 
     m_running = true;
+    if(m_record_ring)
+    {
+        // Поток агрегации запускается первым: к приходу пакетов очередь уже читается
+        m_producer_done = false;
+        m_aggregator_thread = std::thread(&PacketProcessor::aggregateLoop, this);
+    }
     m_packet_thread = std::thread(&PacketProcessor::packetLoop, this);
 }
 
@@ -54,114 +114,640 @@ void PacketProcessor::stop()
     {
         pcap_breakloop(m_pcap_handle);
     }
+    if(m_wakeup_fd >= 0)
+    {
+        // Будим поток захвата, заблокированный в epoll_wait
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t written = write(m_wakeup_fd, &one, sizeof(one));
+    }
+    {
+        // Под блокировкой поток воспроизведения либо ещё не проверил m_running, либо уже ждёт
+        const std::lock_guard<std::mutex> lock(m_replay_mutex);
+        m_replay_wakeup.notify_all();
+    }
 
     if(m_packet_thread.joinable())
     {
         m_packet_thread.join();
     }
+    stopAggregator();
 }
 
 bool PacketProcessor::initializePcap()
 {
     char errbuf[PCAP_ERRBUF_SIZE];
 
-    // Открытие интерфейса для захвата пакетов
-    m_pcap_handle = pcap_open_live(m_interface.c_str(), 65535, 1, 1000, errbuf);
+    // Создание дескриптора захвата; параметры задаются до активации
+    m_pcap_handle = pcap_create(m_config.interface.c_str(), errbuf);
     if(!m_pcap_handle)
     {
-        std::cerr << "[error] Не удалось открыть интерфейс " << m_interface << ": " << errbuf << "\n";
+        std::cerr << "[error] Не удалось открыть интерфейс " << m_config.interface << ": " << errbuf << "\n";
+        return false;
+    }
+
+    pcap_set_snaplen(m_pcap_handle, static_cast<int>(m_config.snaplen));
+    pcap_set_promisc(m_pcap_handle, 1);
+    pcap_set_timeout(m_pcap_handle, static_cast<int>(m_config.timeout_ms));
+    pcap_set_immediate_mode(m_pcap_handle, m_config.immediate_mode ? 1 : 0);
+    // Наносекундные метки, если их поддерживает ядро; иначе остаются микросекундные
+    pcap_set_tstamp_precision(m_pcap_handle, PCAP_TSTAMP_PRECISION_NANO);
+    if(m_config.buffer_size > 0)
+    {
+        pcap_set_buffer_size(m_pcap_handle, static_cast<int>(m_config.buffer_size));
+    }
+
+    const int status = pcap_activate(m_pcap_handle);
+    if(status < 0)
+    {
+        std::cerr << "[error] Не удалось активировать захват на интерфейсе " << m_config.interface << ": "
+            << pcap_statustostr(status) << " (" << pcap_geterr(m_pcap_handle) << ")\n";
+        pcap_close(m_pcap_handle);
+        m_pcap_handle = nullptr;
         return false;
     }
+    if(status > 0)
+    {
+        std::cerr << "[warning] Захват активирован с предупреждением: " << pcap_statustostr(status) << "\n";
+    }
+    m_nanosecond_timestamps = pcap_get_tstamp_precision(m_pcap_handle) == PCAP_TSTAMP_PRECISION_NANO;
 
     // Установка фильтра для TCP/IP пакетов
-    struct bpf_program fp{};
-    const char* filter_exp = "tcp and ip";
+    if(!bindLinkType() || !installFilter())
+    {
+        pcap_close(m_pcap_handle);
+        m_pcap_handle = nullptr;
+        return false;
+    }
 
-    if(pcap_compile(m_pcap_handle, &fp, filter_exp, 0, PCAP_NETMASK_UNKNOWN) == -1)
+    if(m_config.fanout_group >= 0 && !PacketRing::joinFanoutGroup(pcap_fileno(m_pcap_handle), m_config.fanout_group))
     {
-        std::cerr << "[error] Не удалось скомпилировать фильтр: " << pcap_geterr(m_pcap_handle) << "\n";
         pcap_close(m_pcap_handle);
         m_pcap_handle = nullptr;
         return false;
     }
 
-    if(pcap_setfilter(m_pcap_handle, &fp) == -1)
+    if(!initializeEpoll())
     {
-        std::cerr << "[error] Не удалось установить фильтр: " << pcap_geterr(m_pcap_handle) << "\n";
         pcap_close(m_pcap_handle);
         m_pcap_handle = nullptr;
         return false;
     }
 
-    std::cout << "[info] Инициализирован захват пакетов на интерфейсе " << m_interface << "\n";
+    std::cout << "[info] Инициализирован захват пакетов на интерфейсе " << m_config.interface
+        << " (канал " << PacketParser::linkTypeToString(m_link_type)
+        << ", snaplen " << pcap_snapshot(m_pcap_handle) << ", таймаут " << m_config.timeout_ms << " мс"
+        << ", метки времени " << (m_nanosecond_timestamps ? "нс" : "мкс")
+        << (m_config.immediate_mode ? ", immediate mode" : "") << ")\n";
     return true;
 }
 
-void PacketProcessor::processPacket(const pcap_pkthdr* header, const u_char* packet) const
+bool PacketProcessor::initializeOffline()
 {
-    try
+    char errbuf[PCAP_ERRBUF_SIZE];
+
+    // Метки файла читаются с наносекундной точностью (микросекундные файлы libpcap переводит сам)
+    m_pcap_handle = pcap_open_offline_with_tstamp_precision(m_config.read_file.c_str(), PCAP_TSTAMP_PRECISION_NANO,
+                                                            errbuf);
+    if(!m_pcap_handle)
+    {
+        std::cerr << "[error] Не удалось открыть файл " << m_config.read_file << ": " << errbuf << "\n";
+        return false;
+    }
+    m_nanosecond_timestamps = pcap_get_tstamp_precision(m_pcap_handle) == PCAP_TSTAMP_PRECISION_NANO;
+
+    if(!bindLinkType() || !installFilter())
+    {
+        pcap_close(m_pcap_handle);
+        m_pcap_handle = nullptr;
+        return false;
+    }
+
+    std::cout << "[info] Открыт файл " << m_config.read_file << " для воспроизведения (канал "
+        << PacketParser::linkTypeToString(m_link_type) << ", "
+        << (m_config.replay_mode == ReplayMode::RealTime ? "в реальном времени" : "с максимальной скоростью")
+        << ")\n";
+    return true;
+}
+
+bool PacketProcessor::bindLinkType()
+{
+    const int dlt = pcap_datalink(m_pcap_handle);
+    const auto link_type = PacketParser::linkTypeFromDlt(dlt);
+    if(!link_type)
+    {
+        const char* name = pcap_datalink_val_to_name(dlt);
+        std::cerr << "[error] Неподдерживаемый тип канального уровня " << (name ? name : "UNKNOWN")
+            << " (DLT " << dlt << ")\n";
+        return false;
+    }
+
+    m_link_type = *link_type;
+    m_parse_function = PacketParser::getParseFunction(m_link_type);
+    return true;
+}
+
+const char* PacketProcessor::filterFor(LinkType link_type)
+{
+    if(link_type == LinkType::Ethernet)
+    {
+        // Каждое ключевое слово vlan сдвигает смещения оставшейся части выражения на одну метку
+        return "tcp and ip or (vlan and (tcp and ip or (vlan and tcp and ip)))";
+    }
+    return "tcp and ip";
+}
+
+bool PacketProcessor::installFilter()
+{
+    bpf_program fp{};
+    const char* filter_exp = filterFor(m_link_type);
+
+    if(pcap_compile(m_pcap_handle, &fp, filter_exp, 1, PCAP_NETMASK_UNKNOWN) == -1)
+    {
+        std::cerr << "[error] Не удалось скомпилировать фильтр: " << pcap_geterr(m_pcap_handle) << "\n";
+        return false;
+    }
+
+    const bool installed = pcap_setfilter(m_pcap_handle, &fp) != -1;
+    if(!installed)
+    {
+        std::cerr << "[error] Не удалось установить фильтр: " << pcap_geterr(m_pcap_handle) << "\n";
+    }
+
+    pcap_freecode(&fp);
+    return installed;
+}
+
+bool PacketProcessor::initializeEpoll()
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+
+    // В неблокирующем режиме pcap_dispatch возвращает 0 вместо ожидания, а ожидание выполняет epoll
+    if(pcap_setnonblock(m_pcap_handle, 1, errbuf) == -1)
+    {
+        std::cerr << "[error] Не удалось перевести захват в неблокирующий режим: " << errbuf << "\n";
+        return false;
+    }
+
+    const int pcap_fd = pcap_get_selectable_fd(m_pcap_handle);
+    if(pcap_fd < 0)
+    {
+        std::cerr << "[error] Дескриптор захвата не поддерживает ожидание через epoll\n";
+        return false;
+    }
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(m_epoll_fd < 0 || m_wakeup_fd < 0)
+    {
+        std::cerr << "[error] Не удалось создать epoll/eventfd: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = pcap_fd;
+    if(epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pcap_fd, &event) < 0)
+    {
+        std::cerr << "[error] Не удалось добавить дескриптор захвата в epoll: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    event.data.fd = m_wakeup_fd;
+    if(epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &event) < 0)
     {
-        // Проверяем что это TCP/IP пакет
-        if(!PacketParser::isTcpIpv4Packet(packet, header->len))
+        std::cerr << "[error] Не удалось добавить eventfd в epoll: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool PacketProcessor::initializeRing()
+{
+    m_packet_ring = std::make_unique<PacketRing>(m_config);
+    if(!m_packet_ring->open(filterFor(LinkType::Ethernet)))
+    {
+        m_packet_ring.reset();
+        return false;
+    }
+
+    std::cout << "[info] Инициализирован захват TPACKET_V3 на интерфейсе " << m_config.interface
+        << " (" << m_config.ring_block_count << " блоков по " << m_config.ring_block_size / 1024 << " КБ)\n";
+    return true;
+}
+
+void PacketProcessor::handlePacket(u_char* user, const pcap_pkthdr* header, const u_char* packet)
+{
+    reinterpret_cast<PacketProcessor*>(user)->processPacket(header, packet);
+}
+
+void PacketProcessor::handleFrameBatch(u_char* user, std::span<const RawFrame> frames)
+{
+    auto* processor = reinterpret_cast<PacketProcessor*>(user);
+
+    // Кадры остаются в кольце до возврата блока ядру, поэтому пачка классифицируется целиком за один вызов
+    const uint64_t valid_mask = PacketClassifier::classifyBatch(frames, processor->m_batch);
+    processor->m_capture_counters.recordAccepted(static_cast<uint64_t>(std::popcount(valid_mask)));
+
+    // Отброшенные кадры редки (их отсекает BPF фильтр), причину для них выясняет скалярный разбор
+    const uint64_t batch_mask = frames.size() >= 64 ? ~0ULL : (1ULL << frames.size()) - 1;
+    for(uint64_t rejected = ~valid_mask & batch_mask; rejected; rejected &= rejected - 1)
+    {
+        const RawFrame& frame = frames[std::countr_zero(rejected)];
+        PacketInfo scratch{};
+        processor->m_capture_counters.record(PacketParser::parseLink<LinkType::Ethernet>(
+            frame.data, frame.captured_size, frame.packet_size, frame.timestamp, scratch));
+    }
+
+    processor->applyBatch(valid_mask);
+}
+
+void PacketProcessor::handleReplayPacket(u_char* user, const pcap_pkthdr* header, const u_char* packet)
+{
+    auto* processor = reinterpret_cast<PacketProcessor*>(user);
+    const uint64_t timestamp = processor->timestampOf(header);
+
+    if(processor->m_replay_first_time == 0)
+    {
+        processor->m_replay_first_time = timestamp;
+    }
+    else if(processor->m_config.replay_mode == ReplayMode::RealTime && timestamp > processor->m_replay_first_time)
+    {
+        // Пакет обрабатывается не раньше, чем он был записан относительно первого пакета файла.
+        // Промежуток между пакетами может длиться часами: stop() прерывает ожидание
+        const auto deadline = processor->m_replay_start +
+            std::chrono::microseconds(timestamp - processor->m_replay_first_time);
+        std::unique_lock<std::mutex> lock(processor->m_replay_mutex);
+        if(processor->m_replay_wakeup.wait_until(lock, deadline, [processor]() { return !processor->m_running.load(); }))
         {
             return;
         }
+    }
 
-        // Парсим пакет
-        uint64_t timestamp = static_cast<uint64_t>(header->ts.tv_sec) * 1000000 +
-            static_cast<uint64_t>(header->ts.tv_usec);
+    processor->processPacket(header, packet);
+    if(processor->m_config.replay_mode == ReplayMode::RealTime)
+    {
+        // При воспроизведении в реальном времени пакет не должен ждать заполнения пачки
+        processor->flushBatch();
+    }
+}
 
-        auto packet_info = PacketParser::parsePacket(packet, header->len, timestamp);
-        if(!packet_info)
+void PacketProcessor::processPacket(const pcap_pkthdr* header, const u_char* packet)
+{
+    const uint64_t timestamp = timestampOf(header);
+
+    // Однопроходный разбор функцией, выбранной по типу канала: заголовки читаются
+    // в пределах caplen, размеры берутся из header->len
+    const ParseResult result = m_parse_function(packet, header->caplen, header->len, timestamp,
+                                                m_batch[m_batch_size]);
+    m_capture_counters.record(result);
+    if(result != ParseResult::Ok)
+    {
+        return;
+    }
+
+    if(++m_batch_size == m_batch.size())
+    {
+        flushBatch();
+    }
+}
+
+void PacketProcessor::flushBatch()
+{
+    if(m_batch_size == 0)
+    {
+        return;
+    }
+
+    applyBatch(m_batch_size == PacketParser::MAX_BATCH ? ~0ULL : (1ULL << m_batch_size) - 1);
+    m_batch_size = 0;
+}
+
+void PacketProcessor::applyBatch(uint64_t valid_mask)
+{
+    try
+    {
+        // Прошедшие классификацию пакеты сдвигаются в начало пачки (порядок сохраняется)
+        size_t valid_count = 0;
+        for(uint64_t mask = valid_mask; mask != 0; mask &= mask - 1)
         {
-            return;
+            const size_t index = std::countr_zero(mask);
+            if(index != valid_count)
+            {
+                m_batch[valid_count] = m_batch[index];
+            }
+            ++valid_count;
+        }
+
+        const std::span<const PacketInfo> packets(m_batch.data(), valid_count);
+        if(m_record_ring)
+        {
+            publishPackets(packets);
+        }
+        else
+        {
+            applyPackets(packets);
         }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << "[error] Ошибка при обработке пакетов: " << e.what() << "\n";
+    }
+}
+
+void PacketProcessor::applyPackets(std::span<const PacketInfo> packets)
+{
+    uint64_t latest_timestamp = 0;
+    for(const PacketInfo& packet : packets)
+    {
+        latest_timestamp = std::max(latest_timestamp, packet.timestamp);
+    }
 
-        // Обновляем статистику потока
-        m_flow_tracker.updateFlow(packet_info->flow_tuple, packet_info->packet_size,
-                                  packet_info->payload_size, packet_info->timestamp);
+    // Обновляем статистику потоков в шарде: одна блокировка на пачку,
+    // пакеты горячих потоков копятся в кэше и до таблицы не доходят
+    if(m_flow_cache)
+    {
+        m_flow_cache->apply(packets, m_flow_tracker);
+        m_capture_counters.setFlowCache(m_flow_cache->getHits(), m_flow_cache->getLookups());
+    }
+    else
+    {
+        m_flow_tracker.updateFlows(packets);
+    }
 
-        // Обновляем общую статистику
-        m_stats_manager.updateFlowStats(packet_info->flow_tuple, packet_info->packet_size,
-                                        packet_info->payload_size, packet_info->timestamp);
+    // Время пакетов продвигает колесо таймеров шарда (удаляются только потоки с наступившим сроком)
+    // и общие часы потока, по которым считаются скорости и истечение при простое
+    if(latest_timestamp != 0)
+    {
+        m_flow_tracker.expireFlows(latest_timestamp);
+        m_stream_clock.advance(latest_timestamp);
+    }
+}
+
+void PacketProcessor::publishPackets(std::span<const PacketInfo> packets)
+{
+    for(size_t i = 0; i < packets.size(); ++i)
+    {
+        m_records[i] = PacketRecord::pack(packets[i]);
+    }
+    std::span<const PacketRecord> records(m_records.data(), packets.size());
+
+    size_t pushed = m_record_ring->push(records);
+    if(m_config.isOffline())
+    {
+        // Файл можно читать медленнее: вместо потерь поток чтения ждёт освобождения очереди
+        while(pushed < records.size())
+        {
+            std::this_thread::yield();
+            pushed += m_record_ring->push(records.subspan(pushed));
+        }
+    }
+    m_capture_counters.recordRingPush(pushed, records.size() - pushed, m_record_ring->size());
+}
+
+void PacketProcessor::pinCurrentThread(bool aggregator) const
+{
+    const int cpu = m_config.getWorkerCpu(m_config.worker_index, aggregator);
+    if(cpu >= 0 && !CpuAffinity::pinCurrentThread(static_cast<uint32_t>(cpu)))
+    {
+        std::cerr << "[warning] Не удалось привязать поток " << (aggregator ? "агрегации " : "захвата ")
+            << m_config.worker_index << " к CPU " << cpu << "\n";
+    }
+}
+
+void PacketProcessor::aggregateLoop()
+{
+    pinCurrentThread(true);
+    std::array<PacketRecord, DRAIN_BATCH> records;
+    std::array<PacketInfo, DRAIN_BATCH> packets;
+    bool idle = false;
+    for(;;)
+    {
+        const size_t count = m_record_ring->pop(records);
+        if(count == 0)
+        {
+            if(m_producer_done.load(std::memory_order_acquire))
+            {
+                // Записи, сделанные до остановки писателя, видны после acquire
+                if(m_record_ring->empty())
+                {
+                    break;
+                }
+                continue;
+            }
+            if(!idle)
+            {
+                // Отчёт не должен ждать следующих пакетов, чтобы увидеть накопленное кэшем
+                writeBackFlowCache();
+                idle = true;
+            }
+            std::this_thread::sleep_for(AGGREGATOR_IDLE_SLEEP);
+            continue;
+        }
+
+        idle = false;
+        for(size_t i = 0; i < count; ++i)
+        {
+            packets[i] = records[i].unpack();
+        }
+        try
+        {
+            applyPackets(std::span<const PacketInfo>(packets.data(), count));
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << "[error] Ошибка при обработке пакетов: " << e.what() << "\n";
+        }
+        m_capture_counters.recordRingPop(count);
+    }
+    writeBackFlowCache();
+}
+
+void PacketProcessor::stopAggregator()
+{
+    if(!m_aggregator_thread.joinable())
+    {
+        return;
+    }
+    m_producer_done.store(true, std::memory_order_release);
+    m_aggregator_thread.join();
+}
+
+void PacketProcessor::flushFlowCache()
+{
+    if(m_record_ring)
+    {
+        // В режиме конвейера кэшем владеет поток агрегации и сбрасывает его сам
+        return;
+    }
+    writeBackFlowCache();
+}
+
+void PacketProcessor::writeBackFlowCache()
+{
+    if(!m_flow_cache)
+    {
+        return;
+    }
+    try
+    {
+        m_flow_cache->flush(m_flow_tracker);
     }
     catch(const std::exception& e)
     {
-        std::cerr << "[error] Ошибка при обработке пакета: " << e.what() << "\n";
+        std::cerr << "[error] Ошибка при обработке пакетов: " << e.what() << "\n";
     }
 }
 
-void PacketProcessor::packetLoop() const
+void PacketProcessor::pollKernelStats()
 {
+    const auto now = std::chrono::steady_clock::now();
+    if(now < m_next_stats_poll)
+    {
+        return;
+    }
+    m_next_stats_poll = now + STATS_POLL_INTERVAL;
+
+    if(m_packet_ring)
+    {
+        m_capture_counters.setDrops(m_packet_ring->getDrops(), 0);
+        return;
+    }
+
+    // В Linux ps_drop и ps_ifdrop накапливаются с момента активации дескриптора
+    pcap_stat stats{};
+    if(pcap_stats(m_pcap_handle, &stats) == 0)
+    {
+        m_capture_counters.setDrops(stats.ps_drop, stats.ps_ifdrop);
+    }
+}
+
+void PacketProcessor::packetLoop()
+{
+    pinCurrentThread(false);
+    if(m_config.isOffline())
+    {
+        replayLoop();
+        return;
+    }
+    if(m_packet_ring)
+    {
+        ringLoop();
+        return;
+    }
+
     std::cout << "[info] Начало захвата пакетов...\n";
 
-    int packet_count = 0;
-    int processed_count = 0;
+    uint64_t packet_count = 0;
+    auto* user = reinterpret_cast<u_char*>(this);
+    epoll_event events[2];
 
     while(m_running.load())
     {
-        pcap_pkthdr header{};
-
-        if(const u_char* packet = pcap_next(m_pcap_handle, &header))
+        // Забираем из буфера ядра всё, что накопилось, пачками до MAX_DISPATCH_BATCH
+        const int processed = pcap_dispatch(m_pcap_handle, MAX_DISPATCH_BATCH, &PacketProcessor::handlePacket, user);
+        flushBatch();
+        pollKernelStats();
+        if(processed > 0)
         {
-            packet_count++;
-            // std::cout << "[debug] Получено пакетов: " << packet_count << "\n";
-
-            processPacket(&header, packet);
-            processed_count++;
+            packet_count += static_cast<uint64_t>(processed);
+            m_batch_histogram.record(static_cast<uint64_t>(processed));
+            continue;
+        }
+        if(processed == PCAP_ERROR_BREAK)
+        {
+            break;
         }
-        else if(pcap_geterr(m_pcap_handle))
+        if(processed < 0)
         {
             std::cerr << "[error] Ошибка при захвате пакета: " << pcap_geterr(m_pcap_handle) << "\n";
             break;
         }
-        else
+
+        flushFlowCache();
+
+        // Пакетов нет: поток блокируется в ядре до появления данных или вызова stop();
+        // раз в STATS_POLL_INTERVAL он просыпается, чтобы обновить счётчики потерь
+        const int ready = epoll_wait(m_epoll_fd, events, 2, static_cast<int>(STATS_POLL_INTERVAL.count()));
+        if(ready < 0 && errno != EINTR)
         {
-            // Нет пакетов, небольшая задержка
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            std::cerr << "[error] Ошибка epoll_wait: " << std::strerror(errno) << "\n";
+            break;
         }
     }
 
-    std::cout << "[info] Захват пакетов остановлен. Всего получено: " << packet_count
-        << ", обработано: " << processed_count << "\n";
+    flushFlowCache();
+    std::cout << "[info] Захват пакетов остановлен. Всего получено: " << packet_count << "\n";
+    std::cout << "[info] Размеры пачек (пакетов:пробуждений): " << m_batch_histogram.toString() << "\n";
+    std::cout << "[info] Состояние захвата: " << m_capture_counters.getHealth().toString() << "\n";
+}
+
+void PacketProcessor::ringLoop()
+{
+    std::cout << "[info] Начало захвата пакетов из кольца TPACKET_V3 (классификатор: "
+        << PacketClassifier::implToString(PacketClassifier::getActiveImpl()) << ")...\n";
+
+    uint64_t packet_count = 0;
+    auto* user = reinterpret_cast<u_char*>(this);
+
+    while(m_running.load())
+    {
+        // Таймаут ожидания ограничивает задержку реакции на stop()
+        const int processed = m_packet_ring->dispatch(100, &PacketProcessor::handleFrameBatch, user);
+        if(processed < 0)
+        {
+            break;
+        }
+        if(processed == 0)
+        {
+            flushFlowCache();
+        }
+        packet_count += static_cast<uint64_t>(processed);
+        m_batch_histogram.record(static_cast<uint64_t>(processed));
+        pollKernelStats();
+    }
+
+    flushFlowCache();
+    std::cout << "[info] Захват пакетов остановлен. Всего получено: " << packet_count << "\n";
+    std::cout << "[info] Размеры пачек (пакетов:пробуждений): " << m_batch_histogram.toString() << "\n";
+    std::cout << "[info] Состояние захвата: " << m_capture_counters.getHealth().toString() << "\n";
+}
+
+void PacketProcessor::replayLoop()
+{
+    std::cout << "[info] Начало воспроизведения файла " << m_config.read_file << "...\n";
+
+    auto* user = reinterpret_cast<u_char*>(this);
+
+    m_replay_first_time = 0;
+    m_replay_start = std::chrono::steady_clock::now();
+
+    uint64_t packet_count = 0;
+    while(m_running.load())
+    {
+        const int processed = pcap_dispatch(m_pcap_handle, MAX_DISPATCH_BATCH, &PacketProcessor::handleReplayPacket, user);
+        flushBatch();
+        if(processed > 0)
+        {
+            packet_count += static_cast<uint64_t>(processed);
+            m_batch_histogram.record(static_cast<uint64_t>(processed));
+            continue;
+        }
+        if(processed < 0 && processed != PCAP_ERROR_BREAK)
+        {
+            std::cerr << "[error] Ошибка чтения файла: " << pcap_geterr(m_pcap_handle) << "\n";
+        }
+        break; // 0 - конец файла
+    }
+
+    flushFlowCache();
+    stopAggregator();
+    const auto elapsed = std::chrono::steady_clock::now() - m_replay_start;
+    m_replay_result.packets = packet_count;
+    m_replay_result.last_packet_time = m_stream_clock.getPacketTime();
+    m_replay_result.elapsed_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+    std::cout << "[info] Воспроизведение завершено. Пакетов: " << packet_count << "\n";
+    m_finished = true;
 }
@@ -4,26 +4,75 @@
 #include <string>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <chrono>
+#include <array>
+#include <span>
 #include <pcap.h>
 #include "PacketParser.h"
+#include "PacketRing.h"
+#include "CaptureConfig.h"
+#include "BatchHistogram.h"
+#include "CaptureCounters.h"
+#include "PacketRecord.h"
+#include "SpscRing.h"
+#include "StreamClock.h"
 
 // Forward declarations
 class FlowTracker;
+class FlowCache;
 class StatisticsManager;
 
+/**
+ * @brief Итоги воспроизведения файла pcap
+ */
+struct ReplayResult
+{
+    uint64_t packets = 0; // Количество прочитанных из файла пакетов
+    uint64_t elapsed_ns = 0; // Время обработки (нс)
+    uint64_t last_packet_time = 0; // Временная метка последнего пакета (мкс)
+
+    /**
+     * @brief Пропускная способность
+     * @return Пакетов в секунду
+     */
+    [[nodiscard]] double getPacketsPerSecond() const
+    {
+        return elapsed_ns ? static_cast<double>(packets) * 1e9 / static_cast<double>(elapsed_ns) : 0.0;
+    }
+
+    /**
+     * @brief Время обработки одного пакета
+     * @return Наносекунд на пакет
+     */
+    [[nodiscard]] double getNanosecondsPerPacket() const
+    {
+        return packets ? static_cast<double>(elapsed_ns) / static_cast<double>(packets) : 0.0;
+    }
+};
+
 /**
  * @brief Класс для обработки сетевых пакетов с использованием libpcap
+ *
+ * По умолчанию поток захвата сам разбирает пакеты и применяет их к шарду потоков.
+ * В режиме конвейера (CaptureConfig::pipeline_ring) поток захвата только разбирает
+ * пакеты и кладёт 24-байтовые PacketRecord в очередь SpscRing, а шард обновляет
+ * отдельный поток агрегации, забирающий записи пачками. Медленная агрегация тогда
+ * заполняет очередь, а не буфер ядра: при заполненной очереди живой захват
+ * отбрасывает записи и учитывает их в CaptureCounters, воспроизведение файла ждёт.
  */
 class PacketProcessor
 {
 public:
     /**
      * @brief Конструктор
-     * @param interface Интерфейс для прослушивания
+     * @param config Конфигурация захвата
      * @param flow_tracker Ссылка на трекер потоков
      * @param stats_manager Ссылка на менеджер статистики
      */
-    PacketProcessor(std::string interface, FlowTracker& flow_tracker, StatisticsManager& stats_manager);
+    PacketProcessor(CaptureConfig config, FlowTracker& flow_tracker, StatisticsManager& stats_manager);
 
     /**
      * @brief Деструктор
@@ -46,6 +95,30 @@ public:
      */
     [[nodiscard]] bool isRunning() const { return m_running.load(); }
 
+    /**
+     * @brief Проверка завершения воспроизведения файла
+     * @return true если файл pcap прочитан до конца
+     */
+    [[nodiscard]] bool isFinished() const { return m_finished.load(); }
+
+    /**
+     * @brief Получение итогов воспроизведения файла
+     * @return Итоги (действительны после isFinished())
+     */
+    [[nodiscard]] const ReplayResult& getReplayResult() const { return m_replay_result; }
+
+    /**
+     * @brief Получение гистограммы размеров пачек
+     * @return Ссылка на гистограмму (обновляется потоком захвата)
+     */
+    [[nodiscard]] const BatchHistogram& getBatchHistogram() const { return m_batch_histogram; }
+
+    /**
+     * @brief Получение счётчиков захвата (причины отбраковки и потери ядра)
+     * @return Ссылка на счётчики (обновляются потоком захвата)
+     */
+    [[nodiscard]] const CaptureCounters& getCaptureCounters() const { return m_capture_counters; }
+
 private:
     /**
      * @brief Инициализация libpcap
@@ -54,26 +127,216 @@ private:
     bool initializePcap();
 
     /**
-     * @brief Обработка одного пакета
+     * @brief Открытие файла pcap для воспроизведения
+     * @return true при успешном открытии
+     */
+    bool initializeOffline();
+
+    /**
+     * @brief Выбор функции разбора по типу канального уровня дескриптора (pcap_datalink)
+     * @return true если тип канального уровня поддерживается
+     */
+    bool bindLinkType();
+
+    /**
+     * @brief Установка BPF фильтра TCP/IP на дескриптор libpcap
+     * @return true при успешной установке
+     */
+    bool installFilter();
+
+    /**
+     * @brief Выражение BPF фильтра TCP/IPv4 для типа канального уровня
+     *
+     * Для Ethernet фильтр пропускает также кадры с одной и двумя метками VLAN;
+     * ключевое слово vlan допустимо только для Ethernet.
+     *
+     * @param link_type Тип канального уровня
+     * @return Выражение фильтра
+     */
+    static const char* filterFor(LinkType link_type);
+
+    /**
+     * @brief Инициализация кольца TPACKET_V3
+     * @return true при успешной инициализации
+     */
+    bool initializeRing();
+
+    /**
+     * @brief Регистрация дескриптора захвата и eventfd пробуждения в epoll
+     * @return true при успешной регистрации
+     */
+    bool initializeEpoll();
+
+    /**
+     * @brief Обработчик кадра в формате pcap_handler
+     *
+     * Разбирает кадр сразу (данные libpcap действительны только до возврата)
+     * в очередную запись пачки.
+     *
+     * @param user Указатель на PacketProcessor
+     * @param header Заголовок пакета
+     * @param packet Данные пакета
+     */
+    static void handlePacket(u_char* user, const pcap_pkthdr* header, const u_char* packet);
+
+    /**
+     * @brief Обработчик пачки кадров кольца TPACKET_V3
+     * @param user Указатель на PacketProcessor
+     * @param frames Кадры внутри кольца
+     */
+    static void handleFrameBatch(u_char* user, std::span<const RawFrame> frames);
+
+    /**
+     * @brief Обработчик кадра при воспроизведении файла
+     *
+     * Запоминает временную метку первого пакета файла; в режиме реального времени
+     * выдерживает интервал между пакетами из файла перед обработкой.
+     *
+     * @param user Указатель на PacketProcessor
      * @param header Заголовок пакета
      * @param packet Данные пакета
      */
-    void processPacket(const pcap_pkthdr* header, const u_char* packet) const;
+    static void handleReplayPacket(u_char* user, const pcap_pkthdr* header, const u_char* packet);
+
+    /**
+     * @brief Временная метка пакета libpcap в микросекундах
+     * @param header Заголовок пакета (доля секунды в микро- или наносекундах, см. m_nanosecond_timestamps)
+     * @return Временная метка
+     */
+    [[nodiscard]] uint64_t timestampOf(const pcap_pkthdr* header) const
+    {
+        return StreamClock::toMicroseconds(static_cast<uint64_t>(header->ts.tv_sec),
+                                           static_cast<uint64_t>(header->ts.tv_usec), m_nanosecond_timestamps);
+    }
+
+    /**
+     * @brief Разбор одного пакета в очередную запись пачки
+     * @param header Заголовок пакета
+     * @param packet Данные пакета
+     */
+    void processPacket(const pcap_pkthdr* header, const u_char* packet);
+
+    /**
+     * @brief Применение накопленной пачки записей к шарду потоков
+     */
+    void flushBatch();
+
+    /**
+     * @brief Применение записей пачки, отмеченных в маске, к шарду потоков
+     * @param valid_mask Битовая маска заполненных записей m_batch
+     */
+    void applyBatch(uint64_t valid_mask);
+
+    /**
+     * @brief Применение разобранных пакетов к шарду (кэш потоков, таблица, колесо таймеров)
+     * @param packets Разобранные пакеты
+     */
+    void applyPackets(std::span<const PacketInfo> packets);
+
+    /**
+     * @brief Передача разобранных пакетов в очередь конвейера
+     * @param packets Разобранные пакеты
+     */
+    void publishPackets(std::span<const PacketInfo> packets);
+
+    /**
+     * @brief Привязка вызывающего потока к его CPU из CaptureConfig::capture_cpus
+     *
+     * Выполняется первой в потоке, до первого обращения к памяти шарда и очереди.
+     *
+     * @param aggregator true для потока агрегации
+     */
+    void pinCurrentThread(bool aggregator) const;
+
+    /**
+     * @brief Цикл потока агрегации: чтение очереди конвейера пачками по DRAIN_BATCH
+     */
+    void aggregateLoop();
+
+    /**
+     * @brief Завершение потока агрегации после применения всех записей очереди
+     */
+    void stopAggregator();
+
+    /**
+     * @brief Запись отложенной статистики кэша потоков в шард из потока захвата
+     *
+     * Вызывается при простое захвата и по его завершении, чтобы отчёт не ждал следующих пакетов.
+     * В режиме конвейера ничего не делает: кэш сбрасывает поток агрегации.
+     */
+    void flushFlowCache();
+
+    /**
+     * @brief Запись отложенной статистики кэша потоков в шард из потока-владельца кэша
+     */
+    void writeBackFlowCache();
+
+    /**
+     * @brief Опрос счётчиков потерь ядра (pcap_stats или PACKET_STATISTICS)
+     *
+     * Выполняется в потоке захвата не чаще раза в STATS_POLL_INTERVAL,
+     * чтобы не обращаться к дескриптору захвата из другого потока.
+     */
+    void pollKernelStats();
 
     /**
      * @brief Основной цикл обработки пакетов
+     *
+     * Пакеты забираются пачками через pcap_dispatch; при отсутствии пакетов поток
+     * блокируется в epoll_wait на дескрипторе захвата и eventfd остановки.
+     */
+    void packetLoop();
+
+    /**
+     * @brief Цикл обработки пакетов из кольца TPACKET_V3
+     */
+    void ringLoop();
+
+    /**
+     * @brief Цикл воспроизведения файла pcap до конца файла
      */
-    void packetLoop() const;
+    void replayLoop();
+
+    static constexpr int MAX_DISPATCH_BATCH = 512; // Максимум пакетов за один pcap_dispatch
+    static constexpr std::chrono::milliseconds STATS_POLL_INTERVAL{1000}; // Период опроса потерь ядра
+    static constexpr size_t DRAIN_BATCH = 256; // Наибольшая пачка записей, забираемая потоком агрегации
+    static constexpr std::chrono::microseconds AGGREGATOR_IDLE_SLEEP{200}; // Пауза агрегации при пустой очереди
 
-    std::string m_interface;
+    CaptureConfig m_config;
     FlowTracker& m_flow_tracker;
     StatisticsManager& m_stats_manager;
+    StreamClock& m_stream_clock; // Часы потока менеджера статистики, продвигаются каждой пачкой
 
     pcap_t* m_pcap_handle;
+    std::unique_ptr<PacketRing> m_packet_ring;
+    int m_epoll_fd;
+    int m_wakeup_fd;
     std::thread m_packet_thread;
     std::atomic<bool> m_running;
+    std::atomic<bool> m_finished;
+
+    ReplayResult m_replay_result;
+    uint64_t m_replay_first_time; // Временная метка первого пакета файла (мкс)
+    std::chrono::steady_clock::time_point m_replay_start;
+    std::mutex m_replay_mutex; // Проверка m_running и ожидание паузы воспроизведения без пропуска пробуждения
+    std::condition_variable m_replay_wakeup; // stop() прерывает паузу воспроизведения в реальном времени
 
     PacketParser m_packet_parser;
+    LinkType m_link_type;
+    PacketParser::ParseFunction m_parse_function; // Выбирается один раз по типу канального уровня
+    bool m_nanosecond_timestamps; // libpcap отдаёт ts.tv_usec в наносекундах (PCAP_TSTAMP_PRECISION_NANO)
+    BatchHistogram m_batch_histogram;
+    CaptureCounters m_capture_counters;
+    std::chrono::steady_clock::time_point m_next_stats_poll;
+
+    std::unique_ptr<FlowCache> m_flow_cache; // Кэш горячих потоков (nullptr - без кэша)
+    std::array<PacketInfo, PacketParser::MAX_BATCH> m_batch; // Разобранные пакеты, ожидающие применения
+    size_t m_batch_size;
+
+    std::unique_ptr<SpscRing<PacketRecord>> m_record_ring; // Очередь конвейера (nullptr - без конвейера)
+    std::array<PacketRecord, PacketParser::MAX_BATCH> m_records; // Упакованная пачка потока захвата
+    std::thread m_aggregator_thread;
+    std::atomic<bool> m_producer_done; // Поток захвата больше не пишет в очередь
 };
 
 #endif // PACKET_PROCESSOR_H
@@ -0,0 +1,64 @@
+#ifndef PACKET_RECORD_H
+#define PACKET_RECORD_H
+
+#include <algorithm>
+#include <cstdint>
+#include "PacketParser.h"
+
+/**
+ * @brief Компактная запись разобранного пакета для передачи между потоками (24 байта)
+ *
+ * Вместо размера полезной нагрузки хранится размер заголовков (Ethernet с метками VLAN,
+ * IP и TCP вместе не длиннее 255 байт), размер пакета ограничен 18 битами (не больше
+ * наибольшего snaplen libpcap), флаги TCP - младшими 6 битами (FIN..URG).
+ */
+struct PacketRecord
+{
+    static constexpr uint32_t SIZE_BITS = 18;
+    static constexpr uint32_t HEADERS_BITS = 8;
+    static constexpr uint32_t MAX_PACKET_SIZE = (1U << SIZE_BITS) - 1;
+    static constexpr uint32_t MAX_HEADERS_SIZE = (1U << HEADERS_BITS) - 1;
+    static constexpr uint8_t FLAGS_MASK = 0x3F;
+
+    FlowTuple flow_tuple;
+    uint32_t packed; // Размер пакета (18 бит) | размер заголовков (8 бит) | флаги TCP (6 бит)
+    uint64_t timestamp; // Временная метка пакета
+
+    /**
+     * @brief Упаковка разобранного пакета
+     * @param packet_info Разобранный пакет
+     * @return Запись
+     */
+    static PacketRecord pack(const PacketInfo& packet_info)
+    {
+        // Размер заголовков берётся до ограничения размера, чтобы нагрузка сократилась вместе с пакетом
+        const uint32_t payload_size = std::min(packet_info.payload_size, packet_info.packet_size);
+        const uint32_t headers_size = std::min(packet_info.packet_size - payload_size, MAX_HEADERS_SIZE);
+        const uint32_t packet_size = std::min(packet_info.packet_size, MAX_PACKET_SIZE);
+        return PacketRecord{packet_info.flow_tuple,
+                            packet_size | headers_size << SIZE_BITS |
+                            static_cast<uint32_t>(packet_info.tcp_flags & FLAGS_MASK) << (SIZE_BITS + HEADERS_BITS),
+                            packet_info.timestamp};
+    }
+
+    /**
+     * @brief Распаковка записи
+     * @return Разобранный пакет
+     */
+    [[nodiscard]] PacketInfo unpack() const
+    {
+        const uint32_t packet_size = packed & MAX_PACKET_SIZE;
+        const uint32_t headers_size = (packed >> SIZE_BITS) & MAX_HEADERS_SIZE;
+        PacketInfo packet_info{};
+        packet_info.flow_tuple = flow_tuple;
+        packet_info.packet_size = packet_size;
+        packet_info.payload_size = packet_size > headers_size ? packet_size - headers_size : 0;
+        packet_info.tcp_flags = static_cast<uint8_t>(packed >> (SIZE_BITS + HEADERS_BITS));
+        packet_info.timestamp = timestamp;
+        return packet_info;
+    }
+};
+
+static_assert(sizeof(PacketRecord) == 24, "PacketRecord должен занимать 24 байта");
+
+#endif // PACKET_RECORD_H
@@ -0,0 +1,281 @@
+#include "PacketRing.h"
+#include "StreamClock.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <net/if_arp.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+PacketRing::PacketRing(const CaptureConfig& config)
+    : m_config(config)
+      , m_fd(-1)
+      , m_ring(nullptr)
+      , m_ring_size(0)
+      , m_current_block(0)
+      , m_drops(0)
+{
+}
+
+PacketRing::~PacketRing()
+{
+    close();
+}
+
+bool PacketRing::open(const char* filter_exp)
+{
+    // Протокол 0: сокет не получает кадров до bind() с ETH_P_ALL. С ETH_P_ALL здесь он сразу
+    // принимал бы кадры всех интерфейсов, и они попали бы в кольцо мимо фильтра и интерфейса
+    m_fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if(m_fd < 0)
+    {
+        std::cerr << "[error] Не удалось создать AF_PACKET сокет: " << std::strerror(errno) << "\n";
+        return false;
+    }
+
+    int version = TPACKET_V3;
+    if(setsockopt(m_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+    {
+        std::cerr << "[error] Ядро не поддерживает TPACKET_V3: " << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+
+    // Фильтр подключается до привязки к интерфейсу, чтобы в кольцо не попали лишние кадры
+    if(filter_exp && !attachFilter(filter_exp))
+    {
+        close();
+        return false;
+    }
+
+    tpacket_req3 req{};
+    req.tp_block_size = m_config.ring_block_size;
+    req.tp_block_nr = m_config.ring_block_count;
+    req.tp_frame_size = m_config.ring_frame_size;
+    req.tp_frame_nr = (m_config.ring_block_size / m_config.ring_frame_size) * m_config.ring_block_count;
+    req.tp_retire_blk_tov = m_config.timeout_ms;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+    if(setsockopt(m_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+    {
+        std::cerr << "[error] Не удалось создать кольцо TPACKET_V3: " << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+
+    m_ring_size = static_cast<size_t>(req.tp_block_size) * req.tp_block_nr;
+    void* ring = mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, m_fd, 0);
+    if(ring == MAP_FAILED)
+    {
+        // MAP_LOCKED может быть запрещён RLIMIT_MEMLOCK, пробуем без него
+        ring = mmap(nullptr, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    }
+    if(ring == MAP_FAILED)
+    {
+        std::cerr << "[error] Не удалось отобразить кольцо в память: " << std::strerror(errno) << "\n";
+        m_ring_size = 0;
+        close();
+        return false;
+    }
+    m_ring = static_cast<uint8_t*>(ring);
+    m_current_block = 0;
+
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = static_cast<int>(if_nametoindex(m_config.interface.c_str()));
+    if(addr.sll_ifindex == 0)
+    {
+        std::cerr << "[error] Интерфейс " << m_config.interface << " не найден\n";
+        close();
+        return false;
+    }
+
+    // Кадры кольца разбираются как Ethernet; для других каналов нужен захват через libpcap
+    ifreq ifr{};
+    std::strncpy(ifr.ifr_name, m_config.interface.c_str(), IFNAMSIZ - 1);
+    if(ioctl(m_fd, SIOCGIFHWADDR, &ifr) == 0 &&
+        ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER && ifr.ifr_hwaddr.sa_family != ARPHRD_LOOPBACK)
+    {
+        std::cerr << "[error] Интерфейс " << m_config.interface << " не использует кадры Ethernet, "
+            << "используйте --capture-backend pcap\n";
+        close();
+        return false;
+    }
+
+    if(bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        std::cerr << "[error] Не удалось привязать сокет к интерфейсу " << m_config.interface << ": "
+            << std::strerror(errno) << "\n";
+        close();
+        return false;
+    }
+
+    // Группа fanout задаётся после привязки к интерфейсу
+    if(m_config.fanout_group >= 0 && !joinFanoutGroup(m_fd, m_config.fanout_group))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool PacketRing::joinFanoutGroup(int fd, int group)
+{
+    const int fanout = (group & 0xFFFF) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+    if(setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0)
+    {
+        std::cerr << "[error] Не удалось присоединиться к группе PACKET_FANOUT " << group << ": "
+            << std::strerror(errno) << "\n";
+        return false;
+    }
+    return true;
+}
+
+void PacketRing::close()
+{
+    if(m_ring)
+    {
+        munmap(m_ring, m_ring_size);
+        m_ring = nullptr;
+        m_ring_size = 0;
+    }
+    if(m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+uint64_t PacketRing::getDrops()
+{
+    tpacket_stats_v3 stats{};
+    socklen_t length = sizeof(stats);
+    if(m_fd >= 0 && getsockopt(m_fd, SOL_PACKET, PACKET_STATISTICS, &stats, &length) == 0)
+    {
+        m_drops += stats.tp_drops;
+    }
+    return m_drops;
+}
+
+int PacketRing::dispatch(int timeout_ms, FrameBatchHandler callback, u_char* user)
+{
+    if(!m_ring)
+    {
+        return -1;
+    }
+
+    int processed = 0;
+
+    // Обходим подряд все блоки, которые ядро уже передало пользователю
+    for(uint32_t i = 0; i < m_config.ring_block_count; ++i)
+    {
+        uint8_t* block = m_ring + static_cast<size_t>(m_current_block) * m_config.ring_block_size;
+        auto* desc = reinterpret_cast<tpacket_block_desc*>(block);
+
+        if((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0)
+        {
+            break;
+        }
+
+        processed += walkBlock(block, callback, user);
+
+        // Возвращаем блок ядру только после обработки всех кадров
+        __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        m_current_block = (m_current_block + 1) % m_config.ring_block_count;
+    }
+
+    if(processed == 0)
+    {
+        pollfd pfd{};
+        pfd.fd = m_fd;
+        pfd.events = POLLIN | POLLERR;
+        if(poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR)
+        {
+            std::cerr << "[error] Ошибка ожидания кольца: " << std::strerror(errno) << "\n";
+            return -1;
+        }
+    }
+
+    return processed;
+}
+
+int PacketRing::walkBlock(uint8_t* block, FrameBatchHandler callback, u_char* user)
+{
+    const auto* desc = reinterpret_cast<const tpacket_block_desc*>(block);
+    const uint32_t num_packets = desc->hdr.bh1.num_pkts;
+
+    RawFrame frames[PacketParser::MAX_BATCH];
+    size_t frame_count = 0;
+
+    auto* frame = reinterpret_cast<const tpacket3_hdr*>(block + desc->hdr.bh1.offset_to_first_pkt);
+    for(uint32_t i = 0; i < num_packets; ++i)
+    {
+        // Кадр остаётся в кольце, в пачку попадает только указатель на него
+        RawFrame& raw = frames[frame_count++];
+        raw.data = reinterpret_cast<const u_char*>(frame) + frame->tp_mac;
+        raw.captured_size = frame->tp_snaplen;
+        raw.packet_size = frame->tp_len;
+        raw.timestamp = StreamClock::toMicroseconds(frame->tp_sec, frame->tp_nsec, true);
+
+        if(frame_count == PacketParser::MAX_BATCH)
+        {
+            callback(user, std::span<const RawFrame>(frames, frame_count));
+            frame_count = 0;
+        }
+
+        frame = reinterpret_cast<const tpacket3_hdr*>(
+            reinterpret_cast<const uint8_t*>(frame) + frame->tp_next_offset);
+    }
+
+    if(frame_count > 0)
+    {
+        callback(user, std::span<const RawFrame>(frames, frame_count));
+    }
+
+    return static_cast<int>(num_packets);
+}
+
+bool PacketRing::attachFilter(const char* filter_exp) const
+{
+    // Компилируем фильтр средствами libpcap на «мёртвом» дескрипторе Ethernet;
+    // фильтр возвращает snaplen, поэтому ядро копирует в кольцо только заголовки
+    pcap_t* dead = pcap_open_dead(DLT_EN10MB, static_cast<int>(m_config.snaplen));
+    if(!dead)
+    {
+        std::cerr << "[error] Не удалось создать дескриптор для компиляции фильтра\n";
+        return false;
+    }
+
+    bpf_program program{};
+    if(pcap_compile(dead, &program, filter_exp, 1, PCAP_NETMASK_UNKNOWN) == -1)
+    {
+        std::cerr << "[error] Не удалось скомпилировать фильтр: " << pcap_geterr(dead) << "\n";
+        pcap_close(dead);
+        return false;
+    }
+
+    // bpf_insn и sock_filter имеют одинаковое представление
+    sock_fprog fprog{};
+    fprog.len = static_cast<unsigned short>(program.bf_len);
+    fprog.filter = reinterpret_cast<sock_filter*>(program.bf_insns);
+
+    const bool attached = setsockopt(m_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) == 0;
+    if(!attached)
+    {
+        std::cerr << "[error] Не удалось установить фильтр на сокет: " << std::strerror(errno) << "\n";
+    }
+
+    pcap_freecode(&program);
+    pcap_close(dead);
+    return attached;
+}
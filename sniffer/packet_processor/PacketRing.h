@@ -0,0 +1,118 @@
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <pcap.h>
+#include "CaptureConfig.h"
+#include "PacketParser.h"
+
+/**
+ * @brief Захват пакетов через AF_PACKET TPACKET_V3 кольцо
+ *
+ * Ядро складывает кадры в блоки кольцевого буфера, отображённого в память процесса.
+ * Блоки обходятся на месте: обработчик получает указатели на кадры внутри кольца,
+ * блок возвращается ядру только после обработки всех его кадров.
+ */
+class PacketRing
+{
+public:
+    /**
+     * @brief Обработчик пачки кадров; кадры действительны только до возврата из обработчика
+     */
+    using FrameBatchHandler = void (*)(u_char* user, std::span<const RawFrame> frames);
+
+    /**
+     * @brief Конструктор
+     * @param config Конфигурация захвата
+     */
+    explicit PacketRing(const CaptureConfig& config);
+
+    /**
+     * @brief Деструктор
+     */
+    ~PacketRing();
+
+    PacketRing(const PacketRing&) = delete;
+    PacketRing& operator=(const PacketRing&) = delete;
+
+    /**
+     * @brief Открытие сокета, настройка и отображение кольца
+     * @param filter_exp Выражение BPF фильтра (компилируется libpcap)
+     * @return true при успешном открытии
+     */
+    bool open(const char* filter_exp);
+
+    /**
+     * @brief Закрытие сокета и освобождение кольца
+     */
+    void close();
+
+    /**
+     * @brief Обработка всех готовых блоков кольца
+     *
+     * Если готовых блоков нет, ожидает их появления не дольше timeout_ms.
+     * Кадры блока передаются обработчику пачками до PacketParser::MAX_BATCH.
+     *
+     * @param timeout_ms Максимальное время ожидания (мс)
+     * @param callback Обработчик пачки кадров
+     * @param user Пользовательский указатель для обработчика
+     * @return Количество обработанных кадров или -1 при ошибке
+     */
+    int dispatch(int timeout_ms, FrameBatchHandler callback, u_char* user);
+
+    /**
+     * @brief Присоединение сокета к группе PACKET_FANOUT с распределением по хешу потока
+     *
+     * Все сокеты группы получают непересекающиеся подмножества потоков: пакеты
+     * одного потока всегда попадают в один и тот же сокет.
+     *
+     * @param fd Дескриптор AF_PACKET сокета (в том числе pcap_fileno())
+     * @param group Идентификатор группы
+     * @return true при успешном присоединении
+     */
+    static bool joinFanoutGroup(int fd, int group);
+
+    /**
+     * @brief Получение накопленного количества кадров, потерянных из-за переполнения кольца
+     *
+     * Ядро обнуляет PACKET_STATISTICS при каждом чтении, поэтому значения накапливаются здесь.
+     * Вызывается из потока захвата.
+     *
+     * @return Количество потерянных кадров с момента открытия
+     */
+    uint64_t getDrops();
+
+    /**
+     * @brief Получение файлового дескриптора сокета
+     * @return Дескриптор или -1 если кольцо не открыто
+     */
+    [[nodiscard]] int getFd() const { return m_fd; }
+
+private:
+    /**
+     * @brief Обход кадров одного блока
+     * @param block Указатель на начало блока
+     * @param callback Обработчик пачки кадров
+     * @param user Пользовательский указатель для обработчика
+     * @return Количество кадров в блоке
+     */
+    static int walkBlock(uint8_t* block, FrameBatchHandler callback, u_char* user);
+
+    /**
+     * @brief Подключение BPF фильтра к сокету
+     * @param filter_exp Выражение BPF фильтра
+     * @return true при успешном подключении
+     */
+    bool attachFilter(const char* filter_exp) const;
+
+    CaptureConfig m_config;
+    int m_fd;
+    uint8_t* m_ring;
+    size_t m_ring_size;
+    uint32_t m_current_block;
+    uint64_t m_drops;
+};
+
+#endif // PACKET_RING_H
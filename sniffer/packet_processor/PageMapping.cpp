@@ -0,0 +1,236 @@
+#include "PageMapping.h"
+#include "CpuAffinity.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PageMapping::PageMapping(size_t size, HugePageMode mode, int numa_node)
+{
+    if(size == 0)
+    {
+        return;
+    }
+
+    map(size, mode);
+    // Политика задаётся до первой записи: уже выделенные страницы mbind без MPOL_MF_MOVE не переносит
+    if(numa_node >= 0 && CpuAffinity::bindMemory(m_memory, m_size, numa_node))
+    {
+        m_numa_node = numa_node;
+    }
+}
+
+void PageMapping::map(size_t size, HugePageMode mode)
+{
+    if(mode != HugePageMode::Off && size >= HUGE_PAGE_SIZE)
+    {
+        const size_t huge_size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+        // Явные страницы резервируются из пула при mmap: пустой пул даёт ошибку сразу, а не при записи
+        if(mode == HugePageMode::Explicit)
+        {
+            void* memory = mmap(nullptr, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                                -1, 0);
+            if(memory != MAP_FAILED)
+            {
+                m_memory = memory;
+                m_size = huge_size;
+                m_page_type = PageType::Explicit;
+                return;
+            }
+        }
+
+        if(isTransparentEnabled())
+        {
+            // THP выдаётся только выровненным по большой странице участкам: лишняя страница
+            // отображается с запасом и обрезается с обеих сторон
+            void* raw = mmap(nullptr, huge_size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                             -1, 0);
+            if(raw != MAP_FAILED)
+            {
+                const auto raw_address = reinterpret_cast<uintptr_t>(raw);
+                const uintptr_t aligned = (raw_address + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+                if(aligned > raw_address)
+                {
+                    munmap(raw, aligned - raw_address);
+                }
+                const uintptr_t tail = aligned + huge_size;
+                if(raw_address + huge_size + HUGE_PAGE_SIZE > tail)
+                {
+                    munmap(reinterpret_cast<void*>(tail), raw_address + huge_size + HUGE_PAGE_SIZE - tail);
+                }
+
+                m_memory = reinterpret_cast<void*>(aligned);
+                m_size = huge_size;
+                m_page_type = madvise(m_memory, m_size, MADV_HUGEPAGE) == 0 ? PageType::Transparent : PageType::Normal;
+                return;
+            }
+        }
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+    m_memory = memory;
+    m_size = size;
+}
+
+PageMapping::~PageMapping()
+{
+    release();
+}
+
+PageMapping::PageMapping(PageMapping&& other) noexcept
+    : m_memory(std::exchange(other.m_memory, nullptr))
+      , m_size(std::exchange(other.m_size, 0))
+      , m_page_type(std::exchange(other.m_page_type, PageType::Normal))
+      , m_numa_node(std::exchange(other.m_numa_node, -1))
+      , m_fd(std::exchange(other.m_fd, -1))
+{
+}
+
+PageMapping& PageMapping::operator=(PageMapping&& other) noexcept
+{
+    if(this != &other)
+    {
+        release();
+        m_memory = std::exchange(other.m_memory, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_page_type = std::exchange(other.m_page_type, PageType::Normal);
+        m_numa_node = std::exchange(other.m_numa_node, -1);
+        m_fd = std::exchange(other.m_fd, -1);
+    }
+    return *this;
+}
+
+void PageMapping::releaseFront(size_t bytes)
+{
+    if(bytes >= m_size)
+    {
+        release();
+        return;
+    }
+    munmap(m_memory, bytes);
+    m_memory = static_cast<uint8_t*>(m_memory) + bytes;
+    m_size -= bytes;
+}
+
+void PageMapping::release() noexcept
+{
+    if(m_memory)
+    {
+        munmap(m_memory, m_size);
+        m_memory = nullptr;
+        m_size = 0;
+    }
+    if(m_fd >= 0)
+    {
+        // Закрытие дескриптора снимает блокировку flock
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+PageMapping PageMapping::createFile(const std::string& path, size_t size)
+{
+    // Файл не обрезается до получения блокировки: занятый файл другого процесса остаётся целым
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd < 0)
+    {
+        throw std::runtime_error("Не удалось создать " + path + ": " + std::strerror(errno));
+    }
+    if(flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Файл " + path + " уже используется другим процессом");
+    }
+    if(ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(size)) != 0)
+    {
+        const int error = errno;
+        close(fd);
+        throw std::runtime_error("Не удалось задать размер " + path + ": " + std::strerror(error));
+    }
+    return mapShared(fd, path, size, true);
+}
+
+PageMapping PageMapping::openFile(const std::string& path, bool writable)
+{
+    const int fd = open(path.c_str(), (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if(fd < 0)
+    {
+        throw std::runtime_error("Не удалось открыть " + path + ": " + std::strerror(errno));
+    }
+    if(writable && flock(fd, LOCK_EX | LOCK_NB) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Файл " + path + " уже используется другим процессом");
+    }
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0)
+    {
+        close(fd);
+        throw std::runtime_error("Файл " + path + " пуст");
+    }
+    return mapShared(fd, path, static_cast<size_t>(file_stat.st_size), writable);
+}
+
+PageMapping PageMapping::mapShared(int fd, const std::string& path, size_t size, bool writable)
+{
+    void* memory = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if(memory == MAP_FAILED)
+    {
+        const int error = errno;
+        close(fd);
+        throw std::runtime_error("Не удалось отобразить " + path + ": " + std::strerror(error));
+    }
+    PageMapping mapping;
+    mapping.m_memory = memory;
+    mapping.m_size = size;
+    mapping.m_fd = fd;
+    return mapping;
+}
+
+size_t PageMapping::getPageSize() const
+{
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return m_page_type == PageType::Normal ? page_size : HUGE_PAGE_SIZE;
+}
+
+PageType PageMapping::probe(HugePageMode mode)
+{
+    return PageMapping(HUGE_PAGE_SIZE, mode).getPageType();
+}
+
+std::string PageMapping::pageTypeToString(PageType page_type)
+{
+    switch(page_type)
+    {
+        case PageType::Explicit: return "явные большие страницы 2 МБ (MAP_HUGETLB)";
+        case PageType::Transparent: return "прозрачные большие страницы 2 МБ (THP, madvise)";
+        case PageType::Normal: break;
+    }
+    return "обычные страницы 4 КБ";
+}
+
+bool PageMapping::isTransparentEnabled()
+{
+    // Режим THP не меняется во время работы процесса, файл читается один раз
+    static const bool enabled = []()
+    {
+        std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string line;
+        std::getline(file, line);
+        return line.find("[always]") != std::string::npos || line.find("[madvise]") != std::string::npos;
+    }();
+    return enabled;
+}
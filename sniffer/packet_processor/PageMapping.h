@@ -0,0 +1,190 @@
+#ifndef PAGE_MAPPING_H
+#define PAGE_MAPPING_H
+
+#include "CaptureConfig.h"
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Тип страниц, которыми фактически отображена память
+ */
+enum class PageType
+{
+    Normal, ///< Обычные страницы 4 КБ
+    Transparent, ///< Прозрачные большие страницы (THP, madvise(MADV_HUGEPAGE))
+    Explicit ///< Явные большие страницы из пула hugetlbfs (MAP_HUGETLB)
+};
+
+/**
+ * @brief Анонимное обнулённое отображение памяти с большими страницами, если они доступны
+ *
+ * Большие таблицы (таблица потоков, очереди конвейера) читаются в случайном порядке,
+ * и на миллионах потоков промахи TLB стоят столько же, сколько промахи кэша. Отображение
+ * от HUGE_PAGE_SIZE байт пробует страницы по HugePageMode: явные (только Explicit,
+ * MAP_HUGETLB, размер округляется до большой страницы), затем прозрачные (адрес
+ * выравнивается по большой странице, madvise(MADV_HUGEPAGE)), затем обычные.
+ * Меньшие отображения всегда используют обычные страницы, чтобы маленькие таблицы
+ * не занимали по 2 МБ.
+ *
+ * Память выдаётся ядром лениво при первой записи, поэтому создание не зависит от размера.
+ * Если задан узел NUMA, страницы выделяются на нём независимо от того, какой поток
+ * первым пишет в память (CpuAffinity::bindMemory()).
+ *
+ * Отображение файла (createFile(), openFile()) разделяется с другими процессами
+ * (MAP_SHARED): записанное остаётся в файле после завершения процесса, в том числе
+ * аварийного, и видно читателям файла. Такие отображения всегда на обычных страницах.
+ */
+class PageMapping
+{
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024; // Большая страница x86-64 (PMD)
+
+    /**
+     * @brief Пустое отображение
+     */
+    PageMapping() = default;
+
+    /**
+     * @brief Создание отображения
+     * @param size Размер в байтах
+     * @param mode Допустимые большие страницы
+     * @param numa_node Узел NUMA для страниц (-1 - узел потока, первым записавшего в страницу)
+     * @throw std::bad_alloc если ядро не выделило даже обычные страницы
+     */
+    PageMapping(size_t size, HugePageMode mode, int numa_node = -1);
+
+    /**
+     * @brief Деструктор (munmap)
+     */
+    ~PageMapping();
+
+    PageMapping(const PageMapping&) = delete;
+    PageMapping& operator=(const PageMapping&) = delete;
+    PageMapping(PageMapping&& other) noexcept;
+    PageMapping& operator=(PageMapping&& other) noexcept;
+
+    /**
+     * @brief Начало отображения
+     * @return Указатель (nullptr для пустого отображения)
+     */
+    [[nodiscard]] void* data() const { return m_memory; }
+
+    /**
+     * @brief Размер отображения (с округлением до большой страницы)
+     * @return Размер в байтах
+     */
+    [[nodiscard]] size_t size() const { return m_size; }
+
+    /**
+     * @brief Тип страниц отображения
+     * @return Тип страниц
+     */
+    [[nodiscard]] PageType getPageType() const { return m_page_type; }
+
+    /**
+     * @brief Узел NUMA, на котором выделяются страницы
+     * @return Номер узла (-1 - узел не задан или ядро не приняло политику)
+     */
+    [[nodiscard]] int getNumaNode() const { return m_numa_node; }
+
+    /**
+     * @brief Размер страницы отображения (граница для madvise(MADV_DONTNEED))
+     * @return Размер в байтах
+     */
+    [[nodiscard]] size_t getPageSize() const;
+
+    /**
+     * @brief Отмена отображения начала области: отображение сокращается с начала
+     *
+     * Освобождение большой области порциями вместо одного munmap в деструкторе:
+     * каждая порция возвращает ядру и свои страницы, и их таблицы страниц.
+     * @param bytes Размер порции (кратен getPageSize(); не меньше size() - освобождение целиком)
+     */
+    void releaseFront(size_t bytes);
+
+    /**
+     * @brief Создание обнулённого файла заданного размера и его отображение на запись
+     *
+     * Файл создаётся разреженным, место на диске занимают только записанные страницы.
+     * На время жизни отображения файл закрыт исключительной блокировкой flock(),
+     * чтобы второй процесс не открыл его на запись.
+     *
+     * @param path Путь к файлу (существующий файл перезаписывается)
+     * @param size Размер в байтах
+     * @return Отображение файла
+     * @throw std::runtime_error если файл не создан, занят другим процессом или не отображён
+     */
+    static PageMapping createFile(const std::string& path, size_t size);
+
+    /**
+     * @brief Отображение существующего файла целиком
+     * @param path Путь к файлу
+     * @param writable true - чтение и запись под исключительной блокировкой flock(),
+     *                 false - только чтение без блокировки (писатель продолжает работу)
+     * @return Отображение файла
+     * @throw std::runtime_error если файла нет, он пуст, занят другим писателем или не отображён
+     */
+    static PageMapping openFile(const std::string& path, bool writable);
+
+    /**
+     * @brief Проверка отображения файла
+     * @return true если отображение разделяется с файлом
+     */
+    [[nodiscard]] bool isFile() const { return m_fd >= 0; }
+
+    /**
+     * @brief Тип страниц, который получит большое отображение при заданном режиме
+     *
+     * Создаёт и сразу освобождает отображение одной большой страницы: для явных страниц
+     * ядро резервирует их из пула при mmap, поэтому результат отражает свободный пул.
+     *
+     * @param mode Допустимые большие страницы
+     * @return Тип страниц
+     */
+    static PageType probe(HugePageMode mode);
+
+    /**
+     * @brief Получение названия типа страниц
+     * @param page_type Тип страниц
+     * @return Строковое название
+     */
+    static std::string pageTypeToString(PageType page_type);
+
+private:
+    /**
+     * @brief Отображение страницами, выбранными по режиму (без привязки к узлу)
+     * @param size Размер в байтах
+     * @param mode Допустимые большие страницы
+     */
+    void map(size_t size, HugePageMode mode);
+
+    /**
+     * @brief Отображение открытого файла (MAP_SHARED), дескриптор переходит во владение отображения
+     * @param fd Дескриптор файла
+     * @param path Путь к файлу (для сообщения об ошибке)
+     * @param size Размер в байтах
+     * @param writable Отображение на запись
+     * @return Отображение файла
+     * @throw std::runtime_error если mmap завершился ошибкой
+     */
+    static PageMapping mapShared(int fd, const std::string& path, size_t size, bool writable);
+
+    /**
+     * @brief Проверка, что прозрачные большие страницы включены (always или madvise)
+     * @return true если ядро выдаёт THP по madvise(MADV_HUGEPAGE)
+     */
+    static bool isTransparentEnabled();
+
+    /**
+     * @brief Освобождение отображения
+     */
+    void release() noexcept;
+
+    void* m_memory = nullptr;
+    size_t m_size = 0;
+    PageType m_page_type = PageType::Normal;
+    int m_numa_node = -1;
+    int m_fd = -1; // Дескриптор отображённого файла (держит блокировку flock), -1 - анонимная память
+};
+
+#endif // PAGE_MAPPING_H
@@ -0,0 +1,138 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include "PageMapping.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <span>
+#include <type_traits>
+
+/**
+ * @brief Кольцевая очередь без блокировок для одного писателя и одного читателя
+ *
+ * Индексы растут монотонно, позиция в буфере - индекс & mask. Писатель владеет m_tail,
+ * читатель - m_head; каждый хранит копию чужого индекса и перечитывает её (acquire),
+ * только когда копии не хватает для текущей операции, поэтому строки кэша индексов
+ * переходят между ядрами не чаще раза на пачку. Запись и чтение выполняются пачками.
+ * Буфер - анонимное отображение (PageMapping), очереди от 2 МБ могут лежать на больших страницах.
+ *
+ * @tparam T Тип элемента (тривиально копируемый)
+ */
+template <typename T>
+class SpscRing
+{
+    static_assert(std::is_trivially_copyable_v<T>, "Элементы очереди копируются побайтно в отображение");
+
+public:
+    /**
+     * @brief Конструктор
+     * @param capacity Ёмкость (округляется вверх до степени двойки)
+     * @param huge_pages Большие страницы для буфера
+     * @param numa_node Узел NUMA буфера (-1 - по первой записи)
+     */
+    explicit SpscRing(size_t capacity, HugePageMode huge_pages = HugePageMode::Off, int numa_node = -1)
+        : m_tail(0)
+          , m_cached_head(0)
+          , m_head(0)
+          , m_cached_tail(0)
+          , m_capacity(std::bit_ceil(std::max<size_t>(capacity, 2)))
+          , m_mask(m_capacity - 1)
+          , m_mapping(m_capacity * sizeof(T), huge_pages, numa_node)
+          , m_slots(static_cast<T*>(m_mapping.data()))
+    {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /**
+     * @brief Запись пачки элементов (только поток-писатель)
+     * @param items Элементы
+     * @return Количество записанных элементов (меньше items.size(), если очередь заполнена)
+     */
+    size_t push(std::span<const T> items)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if(m_capacity - (tail - m_cached_head) < items.size())
+        {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+        }
+        const size_t count = std::min(items.size(), m_capacity - (tail - m_cached_head));
+        for(size_t i = 0; i < count; ++i)
+        {
+            m_slots[(tail + i) & m_mask] = items[i];
+        }
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief Чтение пачки элементов (только поток-читатель)
+     * @param items Буфер для элементов
+     * @return Количество прочитанных элементов (0 - очередь пуста)
+     */
+    size_t pop(std::span<T> items)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if(m_cached_tail - head < items.size())
+        {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+        }
+        const size_t count = std::min(items.size(), m_cached_tail - head);
+        for(size_t i = 0; i < count; ++i)
+        {
+            items[i] = m_slots[(head + i) & m_mask];
+        }
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    /**
+     * @brief Текущее количество элементов (из любого потока, приблизительно)
+     * @return Количество элементов
+     */
+    [[nodiscard]] size_t size() const
+    {
+        // Читатель не обгоняет писателя: head читается раньше tail
+        const size_t head = m_head.load(std::memory_order_acquire);
+        return m_tail.load(std::memory_order_acquire) - head;
+    }
+
+    /**
+     * @brief Проверка пустоты очереди
+     * @return true если элементов нет
+     */
+    [[nodiscard]] bool empty() const { return size() == 0; }
+
+    /**
+     * @brief Ёмкость очереди
+     * @return Количество элементов
+     */
+    [[nodiscard]] size_t capacity() const { return m_capacity; }
+
+    /**
+     * @brief Тип страниц буфера
+     * @return Тип страниц
+     */
+    [[nodiscard]] PageType getPageType() const { return m_mapping.getPageType(); }
+
+    /**
+     * @brief Узел NUMA буфера
+     * @return Номер узла (-1 - узел не задан или ядро не приняло политику)
+     */
+    [[nodiscard]] int getNumaNode() const { return m_mapping.getNumaNode(); }
+
+private:
+    alignas(64) std::atomic<size_t> m_tail; // Следующая позиция записи (пишет только писатель)
+    size_t m_cached_head; // Копия m_head у писателя
+    alignas(64) std::atomic<size_t> m_head; // Следующая позиция чтения (пишет только читатель)
+    size_t m_cached_tail; // Копия m_tail у читателя
+    alignas(64) size_t m_capacity;
+    size_t m_mask;
+    PageMapping m_mapping;
+    T* m_slots;
+};
+
+#endif // SPSC_RING_H
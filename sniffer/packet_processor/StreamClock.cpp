@@ -0,0 +1,41 @@
+#include "StreamClock.h"
+#include <algorithm>
+
+StreamClock::StreamClock(bool idle_wall_time)
+    : m_idle_wall_time(idle_wall_time)
+      , m_packet_time(0)
+      , m_seen_packet_time(0)
+      , m_last_now(0)
+{
+}
+
+uint64_t StreamClock::now() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const uint64_t packet_time = m_packet_time.load(std::memory_order_relaxed);
+    uint64_t current_time = packet_time;
+    if(m_idle_wall_time)
+    {
+        const auto steady_now = std::chrono::steady_clock::now();
+        if(packet_time == 0)
+        {
+            // До первого пакета живого захвата метки пакетов ещё неизвестны
+            current_time = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+        else if(packet_time != m_seen_packet_time)
+        {
+            m_seen_packet_time = packet_time;
+            m_seen_at = steady_now;
+        }
+        else
+        {
+            // Новых пакетов нет: время идёт от момента, когда метка была увидена впервые
+            current_time += std::chrono::duration_cast<std::chrono::microseconds>(steady_now - m_seen_at).count();
+        }
+    }
+
+    m_last_now = std::max(m_last_now, current_time);
+    return m_last_now;
+}
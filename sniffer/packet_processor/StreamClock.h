@@ -0,0 +1,82 @@
+#ifndef STREAM_CLOCK_H
+#define STREAM_CLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @brief Монотонные часы потока пакетов (микросекунды)
+ *
+ * Время задают временные метки пакетов: потоки захвата продвигают часы наибольшей меткой
+ * пачки (advance()), а скорости, истечение потоков и сроки отчётов берут время из now().
+ * Поэтому при воспроизведении файла скорость считается во времени файла, а не
+ * относительно системных часов, и отчёт не делает собственных обращений к часам на каждый поток.
+ *
+ * Если включён переход на системное время (живой захват), то при отсутствии новых пакетов
+ * часы идут дальше по steady_clock от момента, когда читатель впервые увидел последнюю
+ * метку, и простаивающие потоки истекают без трафика. До первого пакета живого захвата
+ * часы показывают системное время. При воспроизведении файла часы стоят на последнем пакете.
+ *
+ * advance() можно вызывать из нескольких потоков без блокировок; now() рассчитан на поток
+ * отчётов и защищён мьютексом.
+ */
+class StreamClock
+{
+public:
+    /**
+     * @brief Конструктор
+     * @param idle_wall_time Продолжать ход по системному времени при отсутствии пакетов
+     */
+    explicit StreamClock(bool idle_wall_time = true);
+
+    /**
+     * @brief Продвижение часов временем пакета (время назад не идёт)
+     * @param packet_time Временная метка пакета в микросекундах
+     */
+    void advance(uint64_t packet_time)
+    {
+        uint64_t current = m_packet_time.load(std::memory_order_relaxed);
+        while(packet_time > current &&
+            !m_packet_time.compare_exchange_weak(current, packet_time, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /**
+     * @brief Текущее время потока
+     * @return Время в микросекундах, не меньше предыдущего результата
+     */
+    [[nodiscard]] uint64_t now() const;
+
+    /**
+     * @brief Наибольшая временная метка пакетов
+     * @return Время последнего пакета в микросекундах (0 - пакетов не было)
+     */
+    [[nodiscard]] uint64_t getPacketTime() const { return m_packet_time.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Перевод временной метки pcap в микросекунды
+     * @param seconds Секунды
+     * @param fraction Доля секунды (микро- или наносекунды)
+     * @param nanoseconds true если fraction в наносекундах
+     * @return Временная метка в микросекундах
+     */
+    static constexpr uint64_t toMicroseconds(uint64_t seconds, uint64_t fraction, bool nanoseconds)
+    {
+        return seconds * 1000000 + (nanoseconds ? fraction / 1000 : fraction);
+    }
+
+private:
+    const bool m_idle_wall_time;
+    alignas(64) std::atomic<uint64_t> m_packet_time;
+
+    // Состояние читателя
+    alignas(64) mutable std::mutex m_mutex;
+    mutable uint64_t m_seen_packet_time; // Метка, которую читатель видел последней
+    mutable std::chrono::steady_clock::time_point m_seen_at; // Когда читатель впервые её увидел
+    mutable uint64_t m_last_now;
+};
+
+#endif // STREAM_CLOCK_H
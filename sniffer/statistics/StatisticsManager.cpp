@@ -5,37 +5,70 @@
 #include <algorithm>
 #include <sstream>
 
-StatisticsManager::StatisticsManager()
-    : m_flow_tracker(nullptr)
-      , m_last_cleanup_time(0)
+std::string RetiredFlowTotals::toString() const
+{
+    std::ostringstream oss;
+    oss << "закрыто " << closed
+        << ", по таймауту " << idle
+        << ", вытеснено " << evicted
+        << ", байт " << bytes
+        << ", пакетов " << packets;
+    return oss.str();
+}
+
+StatisticsManager::StatisticsManager(bool idle_wall_time)
+    : m_stream_clock(idle_wall_time)
 {
 }
 
 void StatisticsManager::updateFlowStats(const FlowTuple& flow_tuple, uint32_t packet_size,
-                                        uint32_t payload_size, uint64_t timestamp) const
+                                        uint32_t payload_size, uint64_t timestamp, uint8_t tcp_flags)
 {
-    if(m_flow_tracker)
+    m_stream_clock.advance(timestamp);
+    if(FlowTracker* flow_tracker = shardFor(flow_tuple))
     {
-        m_flow_tracker->updateFlow(flow_tuple, packet_size, payload_size, timestamp);
+        flow_tracker->updateFlow(flow_tuple, packet_size, payload_size, timestamp, tcp_flags);
     }
 }
 
-void StatisticsManager::printTopFlows(size_t count) const
+void StatisticsManager::printTopFlows(size_t count, uint64_t current_time, bool clear_screen) const
 {
-    auto top_flows = getTopFlows(count);
+    if(current_time == 0)
+    {
+        current_time = m_stream_clock.now();
+    }
+
+    const bool approximate = isApproximate();
+    HeavyHitterSummary summary;
+    auto top_flows = approximate ? getApproxTopFlows(count, current_time, summary) : getTopFlows(count, current_time);
 
     if(top_flows.empty())
     {
         std::cout << "\n[info] Активных TCP потоков не обнаружено\n";
+        if(!m_capture_counters.empty())
+        {
+            std::cout << "[info] Захват: " << getCaptureHealth().toString() << "\n";
+        }
         return;
     }
 
     // Очистка экрана (ANSI escape sequence)
-    std::cout << "\033[2J\033[H";
+    if(clear_screen)
+    {
+        std::cout << "\033[2J\033[H";
+    }
 
-    // Заголовок
-    std::cout << "=== ТОП-" << count << " TCP потоков по скорости передачи данных ===\n";
-    std::cout << std::string(88, '=') << "\n";
+    // Заголовок; в приближённом режиме добавляется столбец погрешности объёма
+    const size_t width = approximate ? 98 : 88;
+    if(approximate)
+    {
+        std::cout << "=== ТОП-" << count << " TCP потоков по объёму (Space-Saving, приближённо) ===\n";
+    }
+    else
+    {
+        std::cout << "=== ТОП-" << count << " TCP потоков по скорости передачи данных ===\n";
+    }
+    std::cout << std::string(width, '=') << "\n";
 
     // Заголовки с правильными ширинами полей
     std::cout << std::left
@@ -45,10 +78,14 @@ void StatisticsManager::printTopFlows(size_t count) const
         << std::setw(8) << "Port"
         << std::setw(12) << "Speed"
         << std::setw(10) << "AvgSize"
-        << std::setw(10) << "Bytes"
-        << std::setw(8) << "Packets" << "\n";
+        << std::setw(10) << "Bytes";
+    if(approximate)
+    {
+        std::cout << std::setw(10) << "Error";
+    }
+    std::cout << std::setw(8) << "Packets" << "\n";
 
-    std::cout << std::string(88, '-') << "\n";
+    std::cout << std::string(width, '-') << "\n";
 
     // Вывод потоков с теми же ширинами полей
     for(const auto& flow : top_flows)
@@ -58,106 +95,221 @@ void StatisticsManager::printTopFlows(size_t count) const
             << std::setw(8) << flow.src_port
             << std::setw(16) << flow.dst_ip_str
             << std::setw(8) << flow.dst_port
-            << std::setw(12) << formatSpeed(flow.average_speed)
+            << std::setw(12) << FlowStats::formatSpeed(flow.average_speed)
             << std::setw(10) << std::fixed << std::setprecision(1) << flow.average_packet_size
-            << std::setw(10) << flow.total_bytes
-            << std::setw(8) << flow.packet_count << "\n";
+            << std::setw(10) << flow.total_bytes;
+        if(approximate)
+        {
+            std::cout << std::setw(10) << flow.bytes_error;
+        }
+        std::cout << std::setw(8) << flow.packet_count << "\n";
     }
 
-    std::cout << std::string(88, '=') << "\n";
-    std::cout << "Всего активных потоков: " << (m_flow_tracker ? m_flow_tracker->getActiveFlowCount() : 0) << "\n";
-    std::cout << "Для завершения работы используйте Ctrl-C\n\n";
+    std::cout << std::string(width, '=') << "\n";
+    if(approximate)
+    {
+        std::cout << "Истинный объём потока - от Bytes - Error до Bytes; поток объёмом больше "
+            << summary.threshold << " байт гарантированно в сводке\n";
+        std::cout << "Потоков в сводке: " << summary.tracked << " из " << summary.capacity
+            << " счётчиков, учтено байт: " << summary.total_bytes << "\n";
+    }
+    else
+    {
+        std::cout << "Всего активных потоков: " << getActiveFlowCount() << "\n";
+        std::cout << "Завершённые потоки: " << getRetiredFlowTotals().toString() << "\n";
+    }
+    if(!m_capture_counters.empty())
+    {
+        std::cout << "Захват: " << getCaptureHealth().toString() << "\n";
+    }
+    if(clear_screen)
+    {
+        std::cout << "Для завершения работы используйте Ctrl-C\n";
+    }
+    std::cout << "\n";
 }
 
 void StatisticsManager::setFlowTracker(FlowTracker& flow_tracker)
 {
-    m_flow_tracker = &flow_tracker;
+    m_flow_trackers.clear();
+    addFlowTracker(flow_tracker);
 }
 
-void StatisticsManager::cleanupOldFlows()
+void StatisticsManager::addFlowTracker(FlowTracker& flow_tracker)
 {
-    uint64_t current_time = std::chrono::duration_cast<std::chrono::seconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
+    flow_tracker.setRetiredFlowHandler([this](const FlowTuple&, const FlowStats& flow_stats, FlowRetireReason reason)
+    {
+        onFlowRetired(flow_stats, reason);
+    });
+    m_flow_trackers.push_back(&flow_tracker);
+}
 
-    if(current_time - m_last_cleanup_time > CLEANUP_INTERVAL)
+void StatisticsManager::onFlowRetired(const FlowStats& flow_stats, FlowRetireReason reason)
+{
+    // Несколько потоков захвата удаляют потоки одновременно, поэтому здесь атомарное сложение
+    switch(reason)
     {
-        if(m_flow_tracker)
-        {
-            m_flow_tracker->cleanupOldFlows(60); // Удаляем потоки неактивные более 60 секунд
-        }
-        m_last_cleanup_time = current_time;
+        case FlowRetireReason::Closed: m_retired_closed.fetch_add(1, std::memory_order_relaxed); break;
+        case FlowRetireReason::Idle: m_retired_idle.fetch_add(1, std::memory_order_relaxed); break;
+        case FlowRetireReason::Evicted: m_retired_evicted.fetch_add(1, std::memory_order_relaxed); break;
     }
+    m_retired_bytes.fetch_add(flow_stats.getTotalBytes(), std::memory_order_relaxed);
+    m_retired_packets.fetch_add(flow_stats.getPacketCount(), std::memory_order_relaxed);
 }
 
-std::vector<TopFlowInfo> StatisticsManager::getTopFlows(size_t count) const
+RetiredFlowTotals StatisticsManager::getRetiredFlowTotals() const
 {
-    std::vector<TopFlowInfo> top_flows;
+    RetiredFlowTotals totals;
+    totals.closed = m_retired_closed.load(std::memory_order_relaxed);
+    totals.idle = m_retired_idle.load(std::memory_order_relaxed);
+    totals.evicted = m_retired_evicted.load(std::memory_order_relaxed);
+    totals.bytes = m_retired_bytes.load(std::memory_order_relaxed);
+    totals.packets = m_retired_packets.load(std::memory_order_relaxed);
+    return totals;
+}
+
+void StatisticsManager::addCaptureCounters(const CaptureCounters& counters)
+{
+    m_capture_counters.push_back(&counters);
+}
 
-    if(!m_flow_tracker)
+CaptureHealth StatisticsManager::getCaptureHealth() const
+{
+    CaptureHealth health;
+    for(const CaptureCounters* counters : m_capture_counters)
     {
-        return top_flows;
+        health += counters->getHealth();
     }
+    return health;
+}
 
-    auto all_flows = m_flow_tracker->getAllFlows();
-    uint64_t current_time = std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
+size_t StatisticsManager::getActiveFlowCount() const
+{
+    size_t total = 0;
+    for(const FlowTracker* flow_tracker : m_flow_trackers)
+    {
+        total += flow_tracker->getActiveFlowCount();
+    }
+    return total;
+}
 
-    // Преобразуем в TopFlowInfo
-    for(const auto& flow_pair : all_flows)
+FlowTracker* StatisticsManager::shardFor(const FlowTuple& flow_tuple) const
+{
+    if(m_flow_trackers.empty())
     {
-        const FlowTuple& flow_tuple = flow_pair.first;
-        const FlowStats& flow_stats = flow_pair.second;
+        return nullptr;
+    }
+    if(m_flow_trackers.size() == 1)
+    {
+        return m_flow_trackers.front();
+    }
+    return m_flow_trackers[FlowTupleHash{}(flow_tuple) % m_flow_trackers.size()];
+}
 
-        TopFlowInfo flow_info;
-        flow_info.flow_tuple = flow_tuple;
-        flow_info.src_ip_str = PacketParser::ipToString(flow_tuple.src_ip);
-        flow_info.dst_ip_str = PacketParser::ipToString(flow_tuple.dst_ip);
-        flow_info.src_port = flow_tuple.src_port;
-        flow_info.dst_port = flow_tuple.dst_port;
-        flow_info.average_speed = flow_stats.getAverageSpeed(current_time);
-        flow_info.average_packet_size = flow_stats.getAveragePacketSize();
-        flow_info.total_bytes = flow_stats.getTotalBytes();
-        flow_info.packet_count = flow_stats.getPacketCount();
+void StatisticsManager::cleanupOldFlows(uint64_t current_time) const
+{
+    if(current_time == 0)
+    {
+        current_time = m_stream_clock.now();
+    }
 
-        top_flows.push_back(flow_info);
+    for(FlowTracker* flow_tracker : m_flow_trackers)
+    {
+        flow_tracker->expireFlows(current_time);
     }
+}
 
-    // Сортируем по скорости (убывание)
-    std::ranges::sort(top_flows,
-                      [](const TopFlowInfo& a, const TopFlowInfo& b)
+std::vector<TopFlowInfo> StatisticsManager::getTopFlows(size_t count, uint64_t current_time) const
+{
+    // Каждый шард публикует снимок и отдаёт из него свои count самых быстрых потоков,
+    // объединяются count * шардов записей
+    std::vector<RankedFlow> candidates;
+    for(FlowTracker* flow_tracker : m_flow_trackers)
+    {
+        std::vector<RankedFlow> shard_top = flow_tracker->publishSnapshot()->getTopFlows(count, current_time);
+        candidates.insert(candidates.end(), shard_top.begin(), shard_top.end());
+    }
+
+    count = std::min(count, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + static_cast<ptrdiff_t>(count), candidates.end(),
+                      [](const RankedFlow& a, const RankedFlow& b)
                       {
-                          return a.average_speed > b.average_speed;
+                          return a.speed > b.speed;
                       });
 
-    // Возвращаем топ-N
-    if(top_flows.size() > count)
+    // Строки форматируются только для выводимых строк
+    std::vector<TopFlowInfo> top_flows;
+    top_flows.reserve(count);
+    for(size_t i = 0; i < count; ++i)
     {
-        top_flows.resize(count);
+        const RankedFlow& flow = candidates[i];
+        TopFlowInfo flow_info;
+        flow_info.flow_tuple = flow.flow_tuple;
+        flow_info.src_ip_str = PacketParser::ipToString(flow.flow_tuple.src_ip);
+        flow_info.dst_ip_str = PacketParser::ipToString(flow.flow_tuple.dst_ip);
+        flow_info.src_port = flow.flow_tuple.src_port;
+        flow_info.dst_port = flow.flow_tuple.dst_port;
+        flow_info.average_speed = flow.speed;
+        flow_info.average_packet_size = flow.flow_stats.getAveragePacketSize();
+        flow_info.total_bytes = flow.flow_stats.getTotalBytes();
+        flow_info.packet_count = flow.flow_stats.getPacketCount();
+
+        top_flows.push_back(flow_info);
     }
 
     return top_flows;
 }
 
-std::string StatisticsManager::formatSpeed(double speed)
+std::vector<TopFlowInfo> StatisticsManager::getApproxTopFlows(size_t count, uint64_t current_time,
+                                                              HeavyHitterSummary& summary) const
 {
-    std::ostringstream oss;
+    std::vector<TopFlowInfo> top_flows;
 
-    if(speed >= 1024 * 1024 * 1024) // >= 1 GB/s
-    {
-        oss << std::fixed << std::setprecision(1) << (speed / (1024 * 1024 * 1024)) << " GB/s";
-    }
-    else if(speed >= 1024 * 1024) // >= 1 MB/s
-    {
-        oss << std::fixed << std::setprecision(1) << (speed / (1024 * 1024)) << " MB/s";
-    }
-    else if(speed >= 1024) // >= 1 KB/s
+    // Шарды делят потоки по хешу, поэтому сводки не пересекаются и объединяются конкатенацией;
+    // гарантия присутствия для объединения - наибольший из порогов шардов
+    for(const FlowTracker* flow_tracker : m_flow_trackers)
     {
-        oss << std::fixed << std::setprecision(1) << (speed / 1024) << " KB/s";
+        HeavyHitterSummary shard = flow_tracker->getHeavyHitters(count);
+        summary.threshold = std::max(summary.threshold, shard.threshold);
+        summary.total_bytes += shard.total_bytes;
+        summary.tracked += shard.tracked;
+        summary.capacity += shard.capacity;
+
+        for(const HeavyHitter& entry : shard.top)
+        {
+            TopFlowInfo flow_info;
+            flow_info.flow_tuple = entry.flow_tuple;
+            flow_info.src_ip_str = PacketParser::ipToString(entry.flow_tuple.src_ip);
+            flow_info.dst_ip_str = PacketParser::ipToString(entry.flow_tuple.dst_ip);
+            flow_info.src_port = entry.flow_tuple.src_port;
+            flow_info.dst_port = entry.flow_tuple.dst_port;
+            const uint64_t duration_us = current_time > entry.first_packet_time ? current_time - entry.first_packet_time : 0;
+            flow_info.average_speed = duration_us == 0 ? 0.0
+                                                       : static_cast<double>(entry.bytes) * 1000000.0 / static_cast<double>(duration_us);
+            flow_info.average_packet_size = static_cast<double>(entry.total_packet_size) /
+                static_cast<double>(entry.packet_count);
+            flow_info.total_bytes = entry.bytes;
+            flow_info.packet_count = entry.packet_count;
+            flow_info.bytes_error = entry.error;
+
+            top_flows.push_back(flow_info);
+        }
     }
-    else
+
+    std::ranges::sort(top_flows,
+                      [](const TopFlowInfo& a, const TopFlowInfo& b)
+                      {
+                          return a.total_bytes > b.total_bytes;
+                      });
+    if(top_flows.size() > count)
     {
-        oss << std::fixed << std::setprecision(0) << speed << " B/s";
+        top_flows.resize(count);
     }
 
-    return oss.str();
+    return top_flows;
+}
+
+bool StatisticsManager::isApproximate() const
+{
+    return !m_flow_trackers.empty() && m_flow_trackers.front()->isApproximate();
 }
@@ -3,9 +3,11 @@
 
 #include "../packet_processor/PacketParser.h"
 #include "../flow_tracker/FlowTracker.h"
+#include "../packet_processor/CaptureCounters.h"
+#include "../packet_processor/StreamClock.h"
+#include <atomic>
 #include <vector>
 #include <string>
-#include <chrono>
 
 /**
  * @brief Структура для хранения информации о топ-потоке
@@ -21,6 +23,25 @@ struct TopFlowInfo
     double average_packet_size;
     uint64_t total_bytes;
     uint64_t packet_count;
+    uint64_t bytes_error = 0; // Наибольшая переоценка total_bytes (приближённый режим)
+};
+
+/**
+ * @brief Итоги потоков, удалённых трекерами
+ */
+struct RetiredFlowTotals
+{
+    uint64_t closed = 0; // Завершены FIN/RST
+    uint64_t idle = 0; // Удалены по таймауту простоя
+    uint64_t evicted = 0; // Вытеснены при достижении предела таблицы
+    uint64_t bytes = 0; // Полезная нагрузка удалённых потоков
+    uint64_t packets = 0; // Пакеты удалённых потоков
+
+    /**
+     * @brief Форматирование строки итогов
+     * @return Строка вида "закрыто 10, по таймауту 2, вытеснено 0, байт 1000, пакетов 50"
+     */
+    [[nodiscard]] std::string toString() const;
 };
 
 /**
@@ -31,8 +52,9 @@ class StatisticsManager
 public:
     /**
      * @brief Конструктор
+     * @param idle_wall_time Часы потока идут по системному времени при отсутствии пакетов (живой захват)
      */
-    StatisticsManager();
+    explicit StatisticsManager(bool idle_wall_time = true);
 
     /**
      * @brief Деструктор
@@ -44,46 +66,138 @@ public:
      * @param flow_tuple 4-tuple потока
      * @param packet_size Размер пакета на уровне Ethernet
      * @param payload_size Размер полезной нагрузки TCP
-     * @param timestamp Временная метка пакета
+     * @param timestamp Временная метка пакета (продвигает часы потока)
+     * @param tcp_flags Флаги TCP пакета (TCP_FLAG_*)
      */
     void updateFlowStats(const FlowTuple& flow_tuple, uint32_t packet_size,
-                         uint32_t payload_size, uint64_t timestamp) const;
+                         uint32_t payload_size, uint64_t timestamp, uint8_t tcp_flags = 0);
 
     /**
      * @brief Вывод топ-N потоков по скорости передачи данных
      * @param count Количество потоков для вывода
+     * @param current_time Момент расчёта скорости в микросекундах (0 - текущее время часов потока)
+     * @param clear_screen Очищать ли экран перед выводом
+     */
+    void printTopFlows(size_t count, uint64_t current_time = 0, bool clear_screen = true) const;
+
+    /**
+     * @brief Часы потока пакетов, общие для всех потоков захвата
+     *
+     * Потоки захвата продвигают их временем пакетов; скорости, истечение потоков
+     * и сроки отчётов берут время отсюда.
+     *
+     * @return Ссылка на часы
      */
-    void printTopFlows(size_t count) const;
+    [[nodiscard]] StreamClock& getStreamClock() { return m_stream_clock; }
+
+    /**
+     * @brief Часы потока пакетов (только чтение)
+     * @return Ссылка на часы
+     */
+    [[nodiscard]] const StreamClock& getStreamClock() const { return m_stream_clock; }
 
     /**
      * @brief Установка трекера потоков
+     *
+     * Заменяет все ранее добавленные шарды единственным трекером.
+     * Трекер передаёт менеджеру итоги удаляемых потоков, поэтому менеджер должен жить дольше него.
+     *
      * @param flow_tracker Ссылка на трекер потоков
      */
     void setFlowTracker(FlowTracker& flow_tracker);
 
     /**
-     * @brief Очистка устаревших потоков
+     * @brief Добавление шарда потоков
+     *
+     * Каждый рабочий поток захвата владеет своим шардом; шарды объединяются
+     * только при формировании отчёта. Трекер передаёт менеджеру итоги удаляемых
+     * потоков, поэтому менеджер должен жить дольше него.
+     *
+     * @param flow_tracker Ссылка на трекер потоков шарда
+     */
+    void addFlowTracker(FlowTracker& flow_tracker);
+
+    /**
+     * @brief Регистрация счётчиков потока захвата для строки состояния захвата
+     * @param counters Счётчики потока захвата (должны жить дольше менеджера)
+     */
+    void addCaptureCounters(const CaptureCounters& counters);
+
+    /**
+     * @brief Суммарное состояние захвата по всем потокам захвата
+     * @return Снимок счётчиков
      */
-    void cleanupOldFlows();
+    [[nodiscard]] CaptureHealth getCaptureHealth() const;
+
+    /**
+     * @brief Получение суммарного количества активных потоков во всех шардах
+     * @return Количество активных потоков
+     */
+    [[nodiscard]] size_t getActiveFlowCount() const;
+
+    /**
+     * @brief Итоги потоков, удалённых всеми шардами
+     * @return Снимок счётчиков
+     */
+    [[nodiscard]] RetiredFlowTotals getRetiredFlowTotals() const;
+
+    /**
+     * @brief Удаление неактивных потоков по времени часов потока
+     *
+     * Продвигает колёса таймеров всех шардов (FlowTracker::expireFlows()), чтобы потоки
+     * истекали и при отсутствии трафика; полного обхода таблиц нет.
+     *
+     * @param current_time Текущее время в микросекундах (0 - текущее время часов потока)
+     */
+    void cleanupOldFlows(uint64_t current_time = 0) const;
 
 private:
     /**
      * @brief Получение топ-N потоков по скорости
      * @param count Количество потоков
+     * @param current_time Момент расчёта скорости в микросекундах
      * @return Вектор топ-потоков
      */
-    [[nodiscard]] std::vector<TopFlowInfo> getTopFlows(size_t count) const;
+    [[nodiscard]] std::vector<TopFlowInfo> getTopFlows(size_t count, uint64_t current_time) const;
+
+    /**
+     * @brief Получение топ-N потоков по объёму из сводок Space-Saving всех шардов
+     * @param count Количество потоков
+     * @param current_time Момент расчёта скорости в микросекундах
+     * @param summary Сюда записываются суммарные порог, объём и заполнение сводок
+     * @return Вектор топ-потоков с погрешностью объёма
+     */
+    [[nodiscard]] std::vector<TopFlowInfo> getApproxTopFlows(size_t count, uint64_t current_time,
+                                                             HeavyHitterSummary& summary) const;
+
+    /**
+     * @brief Проверка приближённого режима шардов
+     * @return true если шарды ведут сводки Space-Saving
+     */
+    [[nodiscard]] bool isApproximate() const;
+
+    /**
+     * @brief Выбор шарда для потока
+     * @param flow_tuple 4-tuple потока
+     * @return Указатель на трекер шарда или nullptr если шардов нет
+     */
+    [[nodiscard]] FlowTracker* shardFor(const FlowTuple& flow_tuple) const;
 
     /**
-     * @brief Форматирование скорости для вывода
-     * @param speed Скорость в байтах в секунду
-     * @return Отформатированная строка
+     * @brief Учёт итогов удалённого потока (вызывается трекерами из потоков захвата)
+     * @param flow_stats Итоговая статистика потока
+     * @param reason Причина удаления
      */
-    static std::string formatSpeed(double speed);
+    void onFlowRetired(const FlowStats& flow_stats, FlowRetireReason reason);
 
-    FlowTracker* m_flow_tracker;
-    uint64_t m_last_cleanup_time;
-    static constexpr uint64_t CLEANUP_INTERVAL = 30; // секунды
+    StreamClock m_stream_clock;
+    std::vector<FlowTracker*> m_flow_trackers;
+    std::vector<const CaptureCounters*> m_capture_counters;
+    std::atomic<uint64_t> m_retired_closed{0};
+    std::atomic<uint64_t> m_retired_idle{0};
+    std::atomic<uint64_t> m_retired_evicted{0};
+    std::atomic<uint64_t> m_retired_bytes{0};
+    std::atomic<uint64_t> m_retired_packets{0};
 };
 
 #endif // STATISTICS_MANAGER_H